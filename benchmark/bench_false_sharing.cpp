@@ -0,0 +1,71 @@
+/** @file bench_false_sharing.cpp
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Per-thread engines packed in a std::vector versus one per cache line in an AArray.
+ *
+ * Engines such as lcg64_shift are much smaller than a cache line, so packed engines of different threads share lines
+ * and every draw invalidates the line in the other cores.  The compiler barrier after each draw forces the engine
+ * state through memory, as when it is reached through the manager's per-thread table.
+ */
+
+#include <type_traits>
+#include <vector>
+#include <trng/lcg64_shift.hpp>
+#include <trng/yarn2.hpp>
+#include "ParallelRngManager/ParallelRngManager.h"
+#include "bench_util.h"
+
+namespace {
+
+using namespace parallel_rng;
+using bench::run_team;
+using bench::thread_counts;
+
+const IdxT samples_per_thread = 1<<18;
+
+/** Draw samples_per_thread values from engines[omp_get_thread_num()] */
+template<class EnginesT>
+IdxT draw_own_engine(EnginesT &engines)
+{
+    auto &gen = engines[omp_get_thread_num()];
+    typename std::remove_reference<decltype(gen)>::type::result_type x = 0;
+    for(IdxT n=0; n<samples_per_thread; n++) {
+        x ^= gen();
+        benchmark::ClobberMemory();
+    }
+    benchmark::DoNotOptimize(x);
+    return samples_per_thread;
+}
+
+template<class RngT>
+RngT thread_engine(int nthreads, int t)
+{
+    RngT rng(bench::seed);
+    rng.split(nthreads, t);
+    return rng;
+}
+
+template<class RngT>
+void packed_engines(benchmark::State &state)
+{
+    const int nthreads = state.range(0);
+    std::vector<RngT> engines;
+    for(int t=0; t<nthreads; t++) engines.push_back(thread_engine<RngT>(nthreads, t));
+    run_team(state, sizeof(typename RngT::result_type), [&]() { return draw_own_engine(engines); });
+}
+
+template<class RngT>
+void aligned_engines(benchmark::State &state)
+{
+    const int nthreads = state.range(0);
+    aligned_array::AArray<RngT> engines(nthreads, aligned_array::alignment::estimate_cache_alignment());
+    for(int t=0; t<nthreads; t++) engines.push_back(thread_engine<RngT>(nthreads, t));
+    run_team(state, sizeof(typename RngT::result_type), [&]() { return draw_own_engine(engines); });
+}
+
+BENCHMARK_TEMPLATE(packed_engines, trng::lcg64_shift)->Apply(thread_counts);
+BENCHMARK_TEMPLATE(aligned_engines, trng::lcg64_shift)->Apply(thread_counts);
+BENCHMARK_TEMPLATE(packed_engines, trng::yarn2)->Apply(thread_counts);
+BENCHMARK_TEMPLATE(aligned_engines, trng::yarn2)->Apply(thread_counts);
+
+} /* namespace */
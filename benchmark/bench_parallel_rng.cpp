@@ -0,0 +1,216 @@
+/** @file bench_parallel_rng.cpp
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Throughput of ParallelRngManager sampling for each engine, API, FloatT, and OpenMP thread count.
+ *
+ * Each thread of the team samples from its own stream through the manager.  Bulk benchmarks fill a preallocated
+ * vector, so they measure generation rather than allocation.
+ */
+
+#include <vector>
+#include <trng/lcg64_shift.hpp>
+#include <trng/yarn2.hpp>
+#include <trng/yarn3.hpp>
+#include <trng/yarn3s.hpp>
+#include <trng/yarn5s.hpp>
+#include "ParallelRngManager/ParallelRngManager.h"
+#include "bench_util.h"
+
+namespace {
+
+using namespace parallel_rng;
+using bench::run_team;
+using bench::thread_counts;
+
+/** Samples made by each thread per iteration */
+const IdxT samples_per_thread = 1<<16;
+/** Samples per bulk call */
+const IdxT bulk_size = 1<<12;
+/** Categories for resample_dist */
+const IdxT num_weights = 256;
+
+/** Single thread, with engine values per call N = 64, 128, ..., 2^16.  Compares scalar and BulkRngT fills to find
+ * the bulk_min_size break-even point.
+ */
+void bulk_sizes(benchmark::internal::Benchmark *b)
+{
+    for(int64_t N=64; N<=int64_t(samples_per_thread); N*=2) b->Args({1, N});
+    b->ArgNames({"threads", "N"})->UseRealTime();
+}
+
+template<class RngT>
+void generator(benchmark::State &state)
+{
+    auto M = make_parallel_rng_manager<RngT>(bench::seed);
+    using ResultT = typename RngT::result_type;
+    run_team(state, sizeof(ResultT), [&]() {
+        auto &gen = M.generator();
+        ResultT x = 0;
+        for(IdxT n=0; n<samples_per_thread; n++) x ^= gen();
+        benchmark::DoNotOptimize(x);
+        return samples_per_thread;
+    });
+}
+
+template<class RngT>
+void generic_generator(benchmark::State &state)
+{
+    auto M = make_parallel_rng_manager<RngT>(bench::seed);
+    using ResultT = typename RngT::result_type;
+    run_team(state, sizeof(ResultT), [&]() {
+        auto gen = M.generic_generator();
+        ResultT x = 0;
+        for(IdxT n=0; n<samples_per_thread; n++) x ^= gen();
+        benchmark::DoNotOptimize(x);
+        return samples_per_thread;
+    });
+}
+
+template<class RngT>
+void generic_generator_fill(benchmark::State &state)
+{
+    auto M = make_parallel_rng_manager<RngT>(bench::seed);
+    using ResultT = typename RngT::result_type;
+    run_team(state, sizeof(ResultT), [&]() {
+        auto gen = M.generic_generator();
+        std::vector<ResultT> samp(bulk_size);
+        for(IdxT n=0; n<samples_per_thread; n+=bulk_size) {
+            gen.fill(samp.data(), bulk_size);
+            benchmark::DoNotOptimize(samp.data());
+        }
+        return samples_per_thread;
+    });
+}
+
+template<class RngT>
+void fill_scalar(benchmark::State &state)
+{
+    auto M = make_parallel_rng_manager<RngT>(bench::seed);
+    using ResultT = typename RngT::result_type;
+    const IdxT N = state.range(1);
+    run_team(state, sizeof(ResultT), [&]() {
+        auto &gen = M.generator();
+        std::vector<ResultT> samp(N);
+        for(IdxT n=0; n<samples_per_thread; n+=N) {
+            for(IdxT i=0; i<N; i++) samp[i] = gen();
+            benchmark::DoNotOptimize(samp.data());
+        }
+        return samples_per_thread;
+    });
+}
+
+/** As fill_scalar, but with a BulkRngT constructed for each call, as in the manager's bulk uniform fills */
+template<class RngT>
+void fill_leapfrog(benchmark::State &state)
+{
+    auto M = make_parallel_rng_manager<RngT>(bench::seed);
+    using ResultT = typename RngT::result_type;
+    using BulkRngT = typename ParallelRngManager<RngT>::BulkRngT;
+    const IdxT N = state.range(1);
+    run_team(state, sizeof(ResultT), [&]() {
+        auto &gen = M.generator();
+        std::vector<ResultT> samp(N);
+        for(IdxT n=0; n<samples_per_thread; n+=N) {
+            BulkRngT lanes(gen);
+            lanes.generate(samp.data(), N);
+            lanes.commit(gen);
+            benchmark::DoNotOptimize(samp.data());
+        }
+        return samples_per_thread;
+    });
+}
+
+template<class RngT, class FloatT>
+void randu_scalar(benchmark::State &state)
+{
+    auto M = make_parallel_rng_manager<RngT,FloatT>(bench::seed);
+    run_team(state, sizeof(FloatT), [&]() {
+        FloatT sum = 0;
+        for(IdxT n=0; n<samples_per_thread; n++) sum += M.randu();
+        benchmark::DoNotOptimize(sum);
+        return samples_per_thread;
+    });
+}
+
+template<class RngT, class FloatT>
+void randu_bulk(benchmark::State &state)
+{
+    auto M = make_parallel_rng_manager<RngT,FloatT>(bench::seed);
+    run_team(state, sizeof(FloatT), [&]() {
+        arma::Col<FloatT> samp(bulk_size);
+        for(IdxT n=0; n<samples_per_thread; n+=bulk_size) {
+            M.fill_randu(samp);
+            benchmark::DoNotOptimize(samp.memptr());
+        }
+        return samples_per_thread;
+    });
+}
+
+template<class RngT, class FloatT>
+void randn_scalar(benchmark::State &state)
+{
+    auto M = make_parallel_rng_manager<RngT,FloatT>(bench::seed);
+    run_team(state, sizeof(FloatT), [&]() {
+        FloatT sum = 0;
+        for(IdxT n=0; n<samples_per_thread; n++) sum += M.randn();
+        benchmark::DoNotOptimize(sum);
+        return samples_per_thread;
+    });
+}
+
+template<class RngT, class FloatT>
+void randn_bulk(benchmark::State &state)
+{
+    auto M = make_parallel_rng_manager<RngT,FloatT>(bench::seed);
+    run_team(state, sizeof(FloatT), [&]() {
+        arma::Col<FloatT> samp(bulk_size);
+        for(IdxT n=0; n<samples_per_thread; n+=bulk_size) {
+            M.fill_randn(samp);
+            benchmark::DoNotOptimize(samp.memptr());
+        }
+        return samples_per_thread;
+    });
+}
+
+template<class RngT>
+void resample_dist(benchmark::State &state)
+{
+    auto M = make_parallel_rng_manager<RngT>(bench::seed);
+    arma::vec weights(num_weights);
+    for(IdxT k=0; k<num_weights; k++) weights(k) = 1 + k%7;
+    run_team(state, sizeof(IdxT), [&]() {
+        arma::Col<IdxT> samp(bulk_size);
+        for(IdxT n=0; n<samples_per_thread; n+=bulk_size) {
+            M.fill_resample(weights, samp);
+            benchmark::DoNotOptimize(samp.memptr());
+        }
+        return samples_per_thread;
+    });
+}
+
+#define PARALLEL_RNG_ENGINE_BENCHMARKS(RngT) \
+    BENCHMARK_TEMPLATE(generator, RngT)->Apply(thread_counts); \
+    BENCHMARK_TEMPLATE(generic_generator, RngT)->Apply(thread_counts); \
+    BENCHMARK_TEMPLATE(generic_generator_fill, RngT)->Apply(thread_counts); \
+    BENCHMARK_TEMPLATE(fill_scalar, RngT)->Apply(bulk_sizes); \
+    BENCHMARK_TEMPLATE(fill_leapfrog, RngT)->Apply(bulk_sizes); \
+    BENCHMARK_TEMPLATE(randu_scalar, RngT, double)->Apply(thread_counts); \
+    BENCHMARK_TEMPLATE(randu_scalar, RngT, float)->Apply(thread_counts); \
+    BENCHMARK_TEMPLATE(randu_bulk, RngT, double)->Apply(thread_counts); \
+    BENCHMARK_TEMPLATE(randu_bulk, RngT, float)->Apply(thread_counts); \
+    BENCHMARK_TEMPLATE(randn_scalar, RngT, double)->Apply(thread_counts); \
+    BENCHMARK_TEMPLATE(randn_scalar, RngT, float)->Apply(thread_counts); \
+    BENCHMARK_TEMPLATE(randn_bulk, RngT, double)->Apply(thread_counts); \
+    BENCHMARK_TEMPLATE(randn_bulk, RngT, float)->Apply(thread_counts); \
+    BENCHMARK_TEMPLATE(resample_dist, RngT)->Apply(thread_counts)
+
+PARALLEL_RNG_ENGINE_BENCHMARKS(trng::lcg64_shift);
+PARALLEL_RNG_ENGINE_BENCHMARKS(trng::yarn2);
+PARALLEL_RNG_ENGINE_BENCHMARKS(trng::yarn3);
+PARALLEL_RNG_ENGINE_BENCHMARKS(trng::yarn3s);
+PARALLEL_RNG_ENGINE_BENCHMARKS(trng::yarn5s);
+PARALLEL_RNG_ENGINE_BENCHMARKS(Philox4x32);
+PARALLEL_RNG_ENGINE_BENCHMARKS(Philox4x64);
+PARALLEL_RNG_ENGINE_BENCHMARKS(Threefry4x64);
+
+} /* namespace */
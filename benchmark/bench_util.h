@@ -0,0 +1,58 @@
+/** @file bench_util.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Helpers to run google-benchmark kernels on OpenMP teams.
+ *
+ * ParallelRngManager identifies threads by their OpenMP thread number, so kernels must run on OpenMP threads rather
+ * than the std::threads of benchmark::Benchmark::Threads().  Each benchmark takes the team size as range(0).
+ */
+#ifndef _PARALLEL_RNG_BENCH_UTIL_H
+#define _PARALLEL_RNG_BENCH_UTIL_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <omp.h>
+#include <benchmark/benchmark.h>
+
+namespace parallel_rng {
+namespace bench {
+
+const uint64_t seed = 1234567;
+
+/** Team sizes 1, 2, 4, ..., and omp_get_max_threads() */
+inline
+void thread_counts(benchmark::internal::Benchmark *b)
+{
+    int max_threads = omp_get_max_threads();
+    for(int t=1; t<max_threads; t*=2) b->Arg(t);
+    b->Arg(max_threads);
+    b->ArgName("threads")->UseRealTime();
+}
+
+/** Run kernel() on every thread of a team of state.range(0) threads, once per benchmark iteration.
+ *
+ * kernel() returns the number of samples it made.  Reports the wall time per sample over all threads, i.e., the inverse
+ * of items_per_second, and bytes_per_second of output for samples of sample_bytes each.
+ */
+template<class Kernel>
+void run_team(benchmark::State &state, std::size_t sample_bytes, Kernel kernel)
+{
+    const int nthreads = state.range(0);
+    int64_t samples = 0;
+    for(auto _: state) {
+        int64_t team_samples = 0;
+        #pragma omp parallel num_threads(nthreads) reduction(+:team_samples)
+        team_samples += kernel();
+        samples += team_samples;
+    }
+    state.SetItemsProcessed(samples);
+    state.SetBytesProcessed(samples*sample_bytes);
+    state.counters["time_per_sample"] =
+        benchmark::Counter(samples, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+} /* namespace parallel_rng::bench */
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_BENCH_UTIL_H */
@@ -8,6 +8,9 @@
  * space is wasted internally.
  * 
  * Full STL iterator semantics are provided.
+ *
+ * The buffer comes from an allocation policy (see Allocators.h), by default posix_memalign.  Elements never move, so
+ * reserve() only grows the capacity where the policy can extend the buffer in place.
  * 
  */
 #ifndef _ALIGNED_ARRAY_AARRAY_H
@@ -23,6 +26,8 @@
 #include <fstream>
 #include <algorithm>
 
+#include "ParallelRngManager/AlignedArray/Allocators.h"
+
 namespace aligned_array
 {
     
@@ -52,28 +57,30 @@ namespace alignment
     
     
 //Forward declare namespace scope operators
-template<class T>
+template<class T, class AllocT=AlignedAllocator>
 class AArray;
     
     
-template<class T>
-typename AArray<T>::const_iterator 
-operator+(typename AArray<T>::size_type n, const typename AArray<T>::const_iterator &o) noexcept;
+template<class T, class AllocT>
+typename AArray<T,AllocT>::const_iterator 
+operator+(typename AArray<T,AllocT>::size_type n, const typename AArray<T,AllocT>::const_iterator &o) noexcept;
 
-template<class T>
-typename AArray<T>::iterator 
-operator+(typename AArray<T>::size_type n, const typename AArray<T>::iterator &o) noexcept;
+template<class T, class AllocT>
+typename AArray<T,AllocT>::iterator 
+operator+(typename AArray<T,AllocT>::size_type n, const typename AArray<T,AllocT>::iterator &o) noexcept;
 
-template<class T, bool IsConst>
-void swap(typename AArray<T>::template Iterator<IsConst> &lhs, typename AArray<T>::template Iterator<IsConst> &rhs) noexcept;
+template<class T, class AllocT, bool IsConst>
+void swap(typename AArray<T,AllocT>::template Iterator<IsConst> &lhs,
+          typename AArray<T,AllocT>::template Iterator<IsConst> &rhs) noexcept;
 
 
-template<class T>
+template<class T, class AllocT>
 class AArray 
 {
 public:
     template<bool> class Iterator;
     using value_type = T;
+    using allocator_type = AllocT;
     using size_type = size_t;
     using small_size_type = uint32_t; //Type for some elements that will not need 64-bits in any sane scenario
     using difference_type = std::ptrdiff_t;
@@ -85,11 +92,12 @@ public:
     using iterator = Iterator<false>;
     using const_iterator = Iterator<true>;
     
-    AArray(size_type max_size, size_type align = alignment::default_cache_alignment())
+    AArray(size_type max_size, size_type align = alignment::default_cache_alignment(), const AllocT &alloc = AllocT())
         : _max_size{max_size},
           _size{0},
           align_bits{ (small_size_type) std::ceil(std::log2(align)) },
-          block_size{ (small_size_type) std::ceil(sizeof(T) / (double) align) << align_bits }
+          block_size{ (small_size_type) std::ceil(sizeof(T) / (double) align) << align_bits },
+          alloc(alloc)
     {
         if( align < alignof(T) || align < alignof(void *) || ((align-1) & align) != 0) 
             throw std::invalid_argument("Align must be power of 2, not less than alignof(T) or alignof(void*)");
@@ -104,7 +112,8 @@ public:
         : _max_size{o._max_size},
           _size{0},
           align_bits{o.align_bits},
-          block_size{o.block_size}
+          block_size{o.block_size},
+          alloc(o.alloc)
     { 
         alloc_buf(); 
         for(auto& e: o) emplace_back(e);//Copy construct each element to new space
@@ -115,6 +124,7 @@ public:
           _size{o._size},
           align_bits{o.align_bits},
           block_size{o.block_size},
+          alloc(o.alloc),
           first{o.first}
     { 
         o.first = nullptr; //take ownership
@@ -128,6 +138,7 @@ public:
         _size = 0; //start empty before copy
         align_bits = o.align_bits;
         block_size = o.block_size;
+        alloc = o.alloc;
         alloc_buf();
         for(auto& e: o) emplace_back(e);//Copy construct each element to new space
         return *this;
@@ -141,6 +152,7 @@ public:
         _size = o._size;
         align_bits = o.align_bits;
         block_size = o.block_size;
+        alloc = o.alloc;
         first = o.first; 
         o.first = nullptr; //take ownership
         return *this;
@@ -158,6 +170,23 @@ public:
     size_type max_size() const noexcept { return _max_size; }
     size_type capacity() const noexcept { return _max_size; }
     bool empty() const noexcept { return !_size; }
+    allocator_type get_allocator() const { return alloc; }
+
+    /** Grow the capacity to at least new_capacity without moving any element.  Returns false, leaving the array
+     * unchanged, if the allocator cannot extend the buffer in place.
+     */
+    bool reserve(size_type new_capacity)
+    {
+        if(new_capacity <= _max_size) return true;
+        if(!first) {
+            _max_size = new_capacity;
+            alloc_buf();
+            return true;
+        }
+        if(!alloc.extend(first, _max_size*block_size, new_capacity*block_size)) return false;
+        _max_size = new_capacity;
+        return true;
+    }
     
     void clear() noexcept
     { 
@@ -177,6 +206,7 @@ public:
         std::swap(_size, o._size);
         std::swap(align_bits, o.align_bits);
         std::swap(block_size, o.block_size);
+        std::swap(alloc, o.alloc);
         std::swap(first, o.first);
     }
     
@@ -226,6 +256,7 @@ private:
     size_type _size;
     small_size_type align_bits;
     small_size_type block_size;
+    AllocT alloc;
     ByteT *first;
 
     void alloc_buf()
@@ -234,21 +265,13 @@ private:
             first = nullptr;
             return;
         }
-        size_type buf_size = align() + _max_size*block_size; //Allow at least align extra bytes which is enough to store a pointer
-        auto buf = new ByteT[buf_size];
-        uintptr_t first_uint = ((uintptr_t(buf) >> align_bits) + 1) << align_bits; //Align to first cache line past head of buffer.
-        first = reinterpret_cast<ByteT*>( first_uint ); //First aligned position within buf after head
-        auto hidden_buf = reinterpret_cast<ByteT**>(first) - 1; //Location to stash the real buf ptr to free later
-        *hidden_buf = buf; //Store buf pointer in the extra align sized space before first
+        first = static_cast<ByteT*>(alloc.allocate(_max_size*block_size, align()));
     }
     
     void free_buf() noexcept
     {
         if(!first) return;
-        auto hidden_buf = reinterpret_cast<ByteT**>(first) - 1;
-        ByteT *buf = *hidden_buf; //Retrieve buf pointer from the extra align sized space before first;
-        //DEBUG_ASSERT( first-buf <= difference_type(align()) , assert::handler{},"Hidden buf pointer is corrupted! Ouch!");
-        delete[](buf);
+        alloc.deallocate(first, _max_size*block_size, align());
         first = nullptr;
     }
         
@@ -280,7 +303,7 @@ public:
         Iterator(AArray_pointer arr, size_t idx=0) noexcept : arr(arr), idx(idx) {}
         
         //Functions as copy constructor for non-const_iterator and as converting constructor for const_iterator
-        Iterator(const AArray<T>::Iterator<false> &o) noexcept
+        Iterator(const AArray::Iterator<false> &o) noexcept
             : arr(o.arr), idx(o.idx) 
         { }
         
@@ -332,10 +355,10 @@ public:
         bool operator>=(const Iterator<OtherIsConst> &o) const noexcept { return idx >= o.idx; } 
         
         friend
-        Iterator aligned_array::operator+<T>(size_type, const Iterator&) noexcept;
+        Iterator aligned_array::operator+<T,AllocT>(size_type, const Iterator&) noexcept;
 
         friend 
-        void aligned_array::swap<T,IsConst>(Iterator& lhs, Iterator& rhs) noexcept;
+        void aligned_array::swap<T,AllocT,IsConst>(Iterator& lhs, Iterator& rhs) noexcept;
         
     private:
         using AArrayPrtT = typename type_for_const<IsConst, AArray*, const AArray*>::type;
@@ -345,19 +368,20 @@ public:
 
 };
  
-template<class T>
-typename AArray<T>::iterator 
-operator+(typename AArray<T>::size_type n, const typename AArray<T>::iterator &o) noexcept
+template<class T, class AllocT>
+typename AArray<T,AllocT>::iterator 
+operator+(typename AArray<T,AllocT>::size_type n, const typename AArray<T,AllocT>::iterator &o) noexcept
 { return o+n; }
 
-template<class T>
-typename AArray<T>::const_iterator 
-operator+(typename AArray<T>::size_type n, const typename AArray<T>::const_iterator &o) noexcept
+template<class T, class AllocT>
+typename AArray<T,AllocT>::const_iterator 
+operator+(typename AArray<T,AllocT>::size_type n, const typename AArray<T,AllocT>::const_iterator &o) noexcept
 { return o+n; }
 
 
-template<class T, bool IsConst>
-void swap(typename AArray<T>::template Iterator<IsConst> &lhs, typename AArray<T>::template Iterator<IsConst> &rhs) noexcept
+template<class T, class AllocT, bool IsConst>
+void swap(typename AArray<T,AllocT>::template Iterator<IsConst> &lhs,
+          typename AArray<T,AllocT>::template Iterator<IsConst> &rhs) noexcept
 { lhs.swap(rhs); }
     
 } /* namespace parallel_rng */
@@ -0,0 +1,305 @@
+/** @file Allocators.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Aligned buffer allocation policies for AArray.
+ *
+ * An allocation policy provides
+ *  - void* allocate(size_t bytes, size_t align), which throws std::bad_alloc on failure,
+ *  - void deallocate(void *p, size_t bytes, size_t align) noexcept, and
+ *  - bool extend(void *p, size_t bytes, size_t new_bytes) noexcept, which grows an allocation in place if it can.
+ *
+ * AlignedAllocator is the default.  HugePageAllocator backs buffers with transparent huge pages, and
+ * HugeTlbAllocator with explicitly reserved huge pages, reducing TLB misses over large arrays.  ArenaAllocator carves
+ * buffers out of a caller-owned Arena.  Mapped allocations are rounded up to whole pages and can be extended in place
+ * into that slack, or into unmapped space after them.  PolicyAllocator adapts any policy to std containers.
+ */
+#ifndef _ALIGNED_ARRAY_ALLOCATORS_H
+#define _ALIGNED_ARRAY_ALLOCATORS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <atomic>
+#include <fstream>
+#include <new>
+#include <string>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <sys/mman.h>
+    #include <unistd.h>
+    #define ALIGNED_ARRAY_USE_MMAP
+#elif defined(_WIN32)
+    #include <malloc.h>
+#endif
+
+namespace aligned_array
+{
+
+namespace allocation
+{
+    /** Size of huge pages, from /proc/meminfo on Linux, otherwise 2MiB */
+    inline
+    std::size_t huge_page_size()
+    {
+        static const std::size_t size = []() {
+            std::size_t kb = 2048;
+            #if defined(__linux__)
+                std::ifstream meminfo("/proc/meminfo");
+                std::string key;
+                while(meminfo >> key) {
+                    if(key == "Hugepagesize:") {
+                        meminfo >> kb;
+                        break;
+                    }
+                    meminfo.ignore(256, '\n');
+                }
+            #endif
+            return kb*1024;
+        }();
+        return size;
+    }
+
+    inline
+    std::size_t round_up(std::size_t bytes, std::size_t granularity)
+    { return (bytes + granularity - 1) / granularity * granularity; }
+
+#ifdef ALIGNED_ARRAY_USE_MMAP
+    /** Anonymous mapping of bytes aligned to align, trimming the excess of an oversized mapping */
+    inline
+    void* map_aligned(std::size_t bytes, std::size_t align, int extra_flags)
+    {
+        std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        if(align < page) align = page;
+        std::size_t span = bytes + align - page;
+        void *p = ::mmap(nullptr, span, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|extra_flags, -1, 0);
+        if(p == MAP_FAILED) throw std::bad_alloc();
+        uintptr_t base = reinterpret_cast<uintptr_t>(p);
+        uintptr_t first = (base + align - 1) / align * align;
+        if(first > base) ::munmap(p, first - base);
+        if(first + bytes < base + span) ::munmap(reinterpret_cast<void*>(first + bytes), base + span - first - bytes);
+        return reinterpret_cast<void*>(first);
+    }
+
+    inline
+    bool remap_in_place(void *p, std::size_t bytes, std::size_t new_bytes) noexcept
+    {
+        if(new_bytes <= bytes) return true;
+        #if defined(__linux__)
+            return ::mremap(p, bytes, new_bytes, 0) != MAP_FAILED; //No MREMAP_MAYMOVE
+        #else
+            return false;
+        #endif
+    }
+#endif
+} /* namespace aligned_array::allocation */
+
+/** posix_memalign, or _aligned_malloc on Windows */
+struct AlignedAllocator
+{
+    void* allocate(std::size_t bytes, std::size_t align)
+    {
+        void *p = nullptr;
+        #if defined(_WIN32)
+            p = _aligned_malloc(bytes, align);
+        #else
+            if(::posix_memalign(&p, align, bytes)) p = nullptr;
+        #endif
+        if(!p) throw std::bad_alloc();
+        return p;
+    }
+
+    void deallocate(void *p, std::size_t, std::size_t) noexcept
+    {
+        #if defined(_WIN32)
+            _aligned_free(p);
+        #else
+            std::free(p);
+        #endif
+    }
+
+    bool extend(void *, std::size_t bytes, std::size_t new_bytes) noexcept { return new_bytes <= bytes; }
+};
+
+/** Anonymous mapping in whole huge pages, aligned to a huge page, with madvise(MADV_HUGEPAGE) so the kernel backs it
+ *  with transparent huge pages.  Without mmap this is an AlignedAllocator.
+ */
+struct HugePageAllocator
+{
+    void* allocate(std::size_t bytes, std::size_t align)
+    {
+        #ifdef ALIGNED_ARRAY_USE_MMAP
+            std::size_t huge = allocation::huge_page_size();
+            std::size_t size = allocation::round_up(bytes, huge);
+            void *p = allocation::map_aligned(size, align > huge ? align : huge, 0);
+            #ifdef MADV_HUGEPAGE
+                ::madvise(p, size, MADV_HUGEPAGE);
+            #endif
+            return p;
+        #else
+            return AlignedAllocator{}.allocate(bytes, align);
+        #endif
+    }
+
+    void deallocate(void *p, std::size_t bytes, std::size_t align) noexcept
+    {
+        #ifdef ALIGNED_ARRAY_USE_MMAP
+            (void) align;
+            ::munmap(p, allocation::round_up(bytes, allocation::huge_page_size()));
+        #else
+            AlignedAllocator{}.deallocate(p, bytes, align);
+        #endif
+    }
+
+    bool extend(void *p, std::size_t bytes, std::size_t new_bytes) noexcept
+    {
+        #ifdef ALIGNED_ARRAY_USE_MMAP
+            std::size_t huge = allocation::huge_page_size();
+            std::size_t size = allocation::round_up(bytes, huge), new_size = allocation::round_up(new_bytes, huge);
+            if(!allocation::remap_in_place(p, size, new_size)) return false;
+            #ifdef MADV_HUGEPAGE
+                if(new_size > size) ::madvise(static_cast<char*>(p) + size, new_size - size, MADV_HUGEPAGE);
+            #endif
+            return true;
+        #else
+            (void) p;
+            return new_bytes <= bytes;
+        #endif
+    }
+};
+
+/** Mapping of explicitly reserved huge pages with MAP_HUGETLB (see /proc/sys/vm/nr_hugepages).  Throws
+ *  std::bad_alloc if no huge pages are available or the platform does not support them.
+ */
+struct HugeTlbAllocator
+{
+    void* allocate(std::size_t bytes, std::size_t align)
+    {
+        #if defined(ALIGNED_ARRAY_USE_MMAP) && defined(MAP_HUGETLB)
+            std::size_t huge = allocation::huge_page_size();
+            if(align > huge) throw std::bad_alloc();
+            void *p = ::mmap(nullptr, allocation::round_up(bytes, huge), PROT_READ|PROT_WRITE,
+                             MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+            if(p == MAP_FAILED) throw std::bad_alloc();
+            return p;
+        #else
+            (void) bytes; (void) align;
+            throw std::bad_alloc();
+        #endif
+    }
+
+    void deallocate(void *p, std::size_t bytes, std::size_t) noexcept
+    {
+        #if defined(ALIGNED_ARRAY_USE_MMAP) && defined(MAP_HUGETLB)
+            ::munmap(p, allocation::round_up(bytes, allocation::huge_page_size()));
+        #else
+            (void) p; (void) bytes;
+        #endif
+    }
+
+    bool extend(void *p, std::size_t bytes, std::size_t new_bytes) noexcept
+    {
+        #if defined(ALIGNED_ARRAY_USE_MMAP) && defined(MAP_HUGETLB)
+            std::size_t huge = allocation::huge_page_size();
+            return allocation::remap_in_place(p, allocation::round_up(bytes, huge), allocation::round_up(new_bytes, huge));
+        #else
+            (void) p;
+            return new_bytes <= bytes;
+        #endif
+    }
+};
+
+/** @brief Lock-free bump allocator over a caller-owned buffer.
+ *
+ * Only the most recent allocation can be freed or extended, which suits buffers that live as long as the arena.
+ * The buffer must outlive every array allocated from it.
+ */
+class Arena
+{
+public:
+    Arena(void *buf, std::size_t size) noexcept : base{reinterpret_cast<uintptr_t>(buf)}, _size{size}, top{0} {}
+    Arena(const Arena &) = delete;
+    Arena& operator=(const Arena &) = delete;
+
+    std::size_t size() const noexcept { return _size; }
+    std::size_t used() const noexcept { return top.load(std::memory_order_acquire); }
+
+    void* allocate(std::size_t bytes, std::size_t align)
+    {
+        std::size_t t = top.load(std::memory_order_relaxed);
+        for(;;) {
+            std::size_t start = allocation::round_up(base + t, align) - base;
+            if(start > _size || bytes > _size - start) throw std::bad_alloc();
+            if(top.compare_exchange_weak(t, start + bytes, std::memory_order_acq_rel, std::memory_order_relaxed))
+                return reinterpret_cast<void*>(base + start);
+        }
+    }
+
+    void deallocate(void *p, std::size_t bytes) noexcept
+    {
+        std::size_t end = reinterpret_cast<uintptr_t>(p) + bytes - base;
+        top.compare_exchange_strong(end, reinterpret_cast<uintptr_t>(p) - base, std::memory_order_acq_rel);
+    }
+
+    bool extend(void *p, std::size_t bytes, std::size_t new_bytes) noexcept
+    {
+        if(new_bytes <= bytes) return true;
+        std::size_t start = reinterpret_cast<uintptr_t>(p) - base;
+        if(new_bytes > _size - start) return false;
+        std::size_t end = start + bytes;
+        return top.compare_exchange_strong(end, start + new_bytes, std::memory_order_acq_rel);
+    }
+
+private:
+    uintptr_t base;
+    std::size_t _size;
+    std::atomic<std::size_t> top; //Offset of the first free byte
+};
+
+/** Allocates from an Arena, which must outlive the arrays using it */
+class ArenaAllocator
+{
+public:
+    explicit ArenaAllocator(Arena &arena) noexcept : arena{&arena} {}
+
+    void* allocate(std::size_t bytes, std::size_t align) { return arena->allocate(bytes, align); }
+    void deallocate(void *p, std::size_t bytes, std::size_t) noexcept { arena->deallocate(p, bytes); }
+    bool extend(void *p, std::size_t bytes, std::size_t new_bytes) noexcept { return arena->extend(p, bytes, new_bytes); }
+
+private:
+    Arena *arena;
+};
+
+/** @brief Standard library allocator taking memory from an allocation policy, for containers such as std::vector.
+ *
+ * Copies share nothing with the original, so two PolicyAllocators compare equal only for a stateless policy.
+ */
+template<class T, class AllocT=AlignedAllocator>
+class PolicyAllocator
+{
+public:
+    using value_type = T;
+    template<class U> struct rebind { using other = PolicyAllocator<U,AllocT>; };
+
+    PolicyAllocator(const AllocT &policy = AllocT()) : policy(policy) {}
+    template<class U>
+    PolicyAllocator(const PolicyAllocator<U,AllocT> &o) : policy(o.get_policy()) {}
+
+    T* allocate(std::size_t n) { return static_cast<T*>(policy.allocate(n*sizeof(T), align())); }
+    void deallocate(T *p, std::size_t n) noexcept { policy.deallocate(p, n*sizeof(T), align()); }
+
+    const AllocT& get_policy() const noexcept { return policy; }
+
+    friend bool operator==(const PolicyAllocator &a, const PolicyAllocator &b) noexcept
+    { return std::is_empty<AllocT>::value || &a == &b; }
+    friend bool operator!=(const PolicyAllocator &a, const PolicyAllocator &b) noexcept { return !(a == b); }
+
+private:
+    AllocT policy;
+
+    static constexpr std::size_t align() { return alignof(T) < alignof(void*) ? alignof(void*) : alignof(T); }
+};
+
+} /* namespace aligned_array */
+
+#endif /* _ALIGNED_ARRAY_ALLOCATORS_H */
@@ -7,47 +7,103 @@
  * a minimum requires min, max, and operator().  We use reference capture to make a temporary
  * type-erased container for use in passing a generic random number generator in code that cannot be
  * templated (e.g., virtual function calls, or in combination with other type-erasure methods).
- * 
+ *
+ * The erased operations are a static table of functions instantiated for each RNG type, so an AnyRng is just
+ * two pointers.  Making or copying one never allocates.  Each call through it is one indirect call, so code drawing
+ * many values should use fill() or fill_uniform(), whose loops over the concrete RNG are compiled with the RNG
+ * and inlined.
  */
 #ifndef _ANY_RNG_ANYRNG_H
 #define _ANY_RNG_ANYRNG_H
 
-#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <limits>
 
 namespace any_rng
 {
 
 /** Generic, type-erased container for a random number generator.
- * 
- * Stores a reference to rng.  This is by design.  This will become invalid 
+ *
+ * Stores a reference to rng.  This is by design.  This will become invalid
  * if this object outlives the RNG it refers too.  RNGs are expected to be global or
  * at least have lifetimes that span the entire lifetime of the code.  Therefore it
  * is normally safe to use this type erased object as if it were.
- * 
+ *
  * In and of itself this class does not check for reference validity or threaded useage.
  * This is intended as a single-threaded data structure.
- * 
+ *
  */
 template<typename ResultT>
 class AnyRng
 {
 public:
     template<typename RNG>
-    explicit AnyRng(RNG &rng) 
+    explicit AnyRng(RNG &rng)
         : min{RNG::min()},
           max{RNG::max()},
-          _generate{ [&rng](){return rng();} }
+          _rng{&rng},
+          _ops{&Ops<RNG>::table}
     { }
-    
+
     using result_type = ResultT;
-    ResultT operator()() { return _generate(); }
+    ResultT operator()() { return _ops->generate(_rng); }
+
+    /** Fill out with the next n values.  Identical to n calls of operator(). */
+    void fill(ResultT *out, std::size_t n) { _ops->fill(_rng, out, n); }
+
+    /** Fill out with n doubles uniform on [0,1), one RNG value each.  Full 64-bit RNGs give the top 53 bits. */
+    void fill_uniform(double *out, std::size_t n) { _ops->fill_uniform(_rng, out, n); }
 
     const ResultT min;
     const ResultT max;
 private:
-    std::function<ResultT()> _generate;
+    struct OpsTable
+    {
+        ResultT (*generate)(void *rng);
+        void (*fill)(void *rng, ResultT *out, std::size_t n);
+        void (*fill_uniform)(void *rng, double *out, std::size_t n);
+    };
+
+    template<typename RNG>
+    struct Ops
+    {
+        static const OpsTable table;
+
+        static ResultT generate(void *rng) { return (*static_cast<RNG*>(rng))(); }
+
+        static void fill(void *rng, ResultT *out, std::size_t n)
+        {
+            RNG &gen = *static_cast<RNG*>(rng);
+            for(std::size_t i=0; i<n; i++) out[i] = gen();
+        }
+
+        static void fill_uniform(void *rng, double *out, std::size_t n)
+        {
+            RNG &gen = *static_cast<RNG*>(rng);
+            using RangeT = typename RNG::result_type;
+            const RangeT range = RNG::max() - RNG::min();
+            if(RNG::min() == 0 && range == std::numeric_limits<uint64_t>::max()) {
+                for(std::size_t i=0; i<n; i++) out[i] = (static_cast<uint64_t>(gen()) >> 11) * (1.0/9007199254740992.0);
+            } else {
+                //Exact for ranges up to 2^53, and rounded below 1 otherwise
+                const double scale = 1/(static_cast<double>(range) + 1);
+                const double below_one = std::nextafter(1.0, 0.0);
+                for(std::size_t i=0; i<n; i++)
+                    out[i] = std::fmin(static_cast<double>(gen() - RNG::min())*scale, below_one);
+            }
+        }
+    };
+
+    void *_rng;
+    const OpsTable *_ops;
 };
 
+template<typename ResultT>
+template<typename RNG>
+const typename AnyRng<ResultT>::OpsTable AnyRng<ResultT>::Ops<RNG>::table = {&generate, &fill, &fill_uniform};
+
 } /* namespace any_rng */
 
 #endif /* _ANY_RNG_ANYRNG_H */
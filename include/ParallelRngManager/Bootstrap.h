@@ -0,0 +1,61 @@
+/** @file Bootstrap.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Kernels for bootstrap replicates of N observations.
+ *
+ * A replicate is either N indices drawn uniformly with replacement from [0,N), or the number of times each observation
+ * is drawn.  Counts avoid materializing indices when only weighted statistics are needed.  Multinomial counts are the
+ * histogram of exactly the indices bootstrap::indices() draws from the same stream.  Poisson counts are independent
+ * Poisson(1) variates, so replicate sizes vary around N, but each count takes a single uniform and no random writes.
+ *
+ * ParallelRngManager::bootstrap_indices() and bootstrap_counts() run one replicate per sub-stream.
+ */
+#ifndef _PARALLEL_RNG_BOOTSTRAP_H
+#define _PARALLEL_RNG_BOOTSTRAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+#include "ParallelRngManager/Poisson.h"
+#include "ParallelRngManager/Permutation.h"
+
+namespace parallel_rng {
+
+/** Count vector schemes for ParallelRngManager::bootstrap_counts() */
+enum class BootstrapScheme {
+    Multinomial, ///< Counts of N uniform draws with replacement.  Each replicate sums to N.
+    Poisson      ///< Independent Poisson(1) counts.  Replicate sizes vary around N.
+};
+
+namespace bootstrap {
+
+/** out[0..N) = N uniform indices into [0,N) */
+template<class OutT, class RngT>
+void indices(OutT *out, std::size_t N, RngT &gen)
+{
+    for(std::size_t n=0; n<N; n++) out[n] = OutT(permutation::uniform_index(N, gen));
+}
+
+/** out[0..N) = counts of each observation in one replicate */
+template<class OutT, class RngT>
+void counts(BootstrapScheme scheme, OutT *out, std::size_t N, RngT &gen)
+{
+    switch(scheme) {
+        case BootstrapScheme::Multinomial:
+            std::fill(out, out+N, OutT(0));
+            for(std::size_t n=0; n<N; n++) out[permutation::uniform_index(N, gen)] += 1;
+            break;
+        case BootstrapScheme::Poisson: {
+            PoissonDistribution<uint64_t> poisson(1);
+            for(std::size_t n=0; n<N; n++) out[n] = OutT(poisson(gen));
+            break;
+        }
+    }
+}
+
+} /* namespace parallel_rng::bootstrap */
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_BOOTSTRAP_H */
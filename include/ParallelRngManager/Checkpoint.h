@@ -0,0 +1,80 @@
+/** @file Checkpoint.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Versioned binary checkpoint format for ParallelRngManager state.
+ *
+ * A checkpoint is laid out in native byte order, which is verified on load:
+ *  - Header: magic, format version, byte order mark, init_seed, num_threads, number of streams, and engine name.
+ *  - One fixed-size StreamRecord per materialized stream, giving the thread path of the stream, and the offset and
+ *    size of its engine state.
+ *  - The engine states, each in the engine's own stream format, which TRNG guarantees to restore exactly.
+ *
+ * Records are fixed size and states are addressed by offset, so a checkpoint can be restored in place from a memory
+ * mapped file.
+ */
+#ifndef _PARALLEL_RNG_CHECKPOINT_H
+#define _PARALLEL_RNG_CHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace parallel_rng {
+
+namespace checkpoint {
+
+static const char magic[8] = {'P','R','N','G','C','K','P','T'};
+static const uint32_t version = 1;
+static const uint32_t byte_order_mark = 0x01020304;
+/** Maximum depth of a stored thread path */
+static const std::size_t max_depth = 8;
+static const std::size_t engine_name_size = 32;
+
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t init_seed;
+    uint64_t num_threads;
+    uint64_t num_streams;
+    char engine_name[engine_name_size];
+};
+
+struct StreamRecord
+{
+    uint64_t depth;
+    uint64_t ids[max_depth];
+    uint64_t state_offset; //From the start of the checkpoint
+    uint64_t state_size;
+};
+
+/** @brief Read-only view of a whole file.
+ *
+ * The file is memory mapped where the platform supports it, so restoring a checkpoint only touches the pages it reads.
+ * Otherwise the file is read into memory.
+ */
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &filename);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile& operator=(const MappedFile &) = delete;
+
+    const char* data() const { return _data; }
+    std::size_t size() const { return _size; }
+
+private:
+    const char *_data;
+    std::size_t _size;
+    bool mapped;
+    std::vector<char> buffer;
+};
+
+} /* namespace parallel_rng::checkpoint */
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_CHECKPOINT_H */
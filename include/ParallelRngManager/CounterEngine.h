@@ -0,0 +1,320 @@
+/** @file CounterEngine.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Counter-based Philox and Threefry engines usable as a ParallelRngManager RngT.
+ *
+ * A counter-based engine has no serial state.  Block b of stream s is a keyed bijection of the counter (b,s), with
+ * the key taken from the seed.  Any position can be reached in O(1), and blocks are independent so bulk generation
+ * has no dependency chain between successive values.
+ *
+ * CounterEngine follows the TRNG parallel engine interface:
+ *  - split(s,n) is the leapfrog sub-stream x[n], x[n+s], x[n+2s], ...
+ *  - jump(k) skips k values in O(1)
+ * In addition it exposes the counter directly: stream(), set_stream(), position(), seek(), and a bulk generate().
+ *
+ * References:
+ *  - J. K. Salmon, M. A. Moraes, R. O. Dror, and D. E. Shaw. "Parallel Random Numbers: As Easy as 1, 2, 3". SC11, 2011.
+ */
+#ifndef _PARALLEL_RNG_COUNTERENGINE_H
+#define _PARALLEL_RNG_COUNTERENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <limits>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+
+namespace parallel_rng {
+
+namespace counter {
+
+/** Pack a 64-bit value into 64/bits(WordT) words, low word first */
+template<class WordT>
+inline
+void pack(uint64_t v, WordT *w)
+{
+    for(std::size_t i=0; i<sizeof(uint64_t)/sizeof(WordT); i++) w[i] = WordT(v >> (8*sizeof(WordT)*i));
+}
+
+inline
+void mulhilo(uint32_t a, uint32_t b, uint32_t &hi, uint32_t &lo)
+{
+    uint64_t p = uint64_t(a)*b;
+    hi = uint32_t(p >> 32);
+    lo = uint32_t(p);
+}
+
+inline
+void mulhilo(uint64_t a, uint64_t b, uint64_t &hi, uint64_t &lo)
+{
+#ifdef __SIZEOF_INT128__
+    __extension__ typedef unsigned __int128 uint128_t;
+    uint128_t p = static_cast<uint128_t>(a)*b;
+    hi = uint64_t(p >> 64);
+    lo = uint64_t(p);
+#else
+    const uint64_t mask = 0xFFFFFFFF;
+    uint64_t a0 = a & mask, a1 = a >> 32, b0 = b & mask, b1 = b >> 32;
+    uint64_t p00 = a0*b0, p01 = a0*b1, p10 = a1*b0, p11 = a1*b1;
+    uint64_t mid = (p00 >> 32) + (p01 & mask) + (p10 & mask);
+    lo = (mid << 32) | (p00 & mask);
+    hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+}
+
+/** Philox4xW-10 bijection.  Multipliers and Weyl key increments from Salmon et al. */
+template<class WordT>
+struct Philox4
+{
+    using word_type = WordT;
+    static constexpr std::size_t words = 4;
+    static constexpr std::size_t key_words = 2;
+    static constexpr int rounds = 10;
+    using ctr_type = std::array<WordT,words>;
+    using key_type = std::array<WordT,key_words>;
+
+    static constexpr WordT M0 = sizeof(WordT)==4 ? WordT(0xD2511F53) : WordT(0xD2E7470EE14C6C93);
+    static constexpr WordT M1 = sizeof(WordT)==4 ? WordT(0xCD9E8D57) : WordT(0xCA5A826395121157);
+    static constexpr WordT W0 = sizeof(WordT)==4 ? WordT(0x9E3779B9) : WordT(0x9E3779B97F4A7C15);
+    static constexpr WordT W1 = sizeof(WordT)==4 ? WordT(0xBB67AE85) : WordT(0xBB67AE8584CAA73B);
+
+    static const char* name() { return sizeof(WordT)==4 ? "philox4x32" : "philox4x64"; }
+
+    static void encrypt(ctr_type &x, key_type k)
+    {
+        for(int r=0; r<rounds; r++) {
+            WordT hi0, lo0, hi1, lo1;
+            mulhilo(M0, x[0], hi0, lo0);
+            mulhilo(M1, x[2], hi1, lo1);
+            x = ctr_type{{WordT(hi1^x[1]^k[0]), lo1, WordT(hi0^x[3]^k[1]), lo0}};
+            k[0] += W0;
+            k[1] += W1;
+        }
+    }
+};
+
+/** Threefry4x64-20 bijection.  Rotation constants are those of Threefish-256. */
+struct Threefry4x64
+{
+    using word_type = uint64_t;
+    static constexpr std::size_t words = 4;
+    static constexpr std::size_t key_words = 4;
+    static constexpr int rounds = 20;
+    using ctr_type = std::array<uint64_t,words>;
+    using key_type = std::array<uint64_t,key_words>;
+
+    static const char* name() { return "threefry4x64"; }
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64-r)); }
+
+    static void encrypt(ctr_type &x, const key_type &k)
+    {
+        static const int R[8][2] = {{14,16}, {52,57}, {23,40}, {5,37}, {25,33}, {46,12}, {58,22}, {32,32}};
+        std::array<uint64_t,5> ks;
+        ks[4] = 0x1BD11BDAA9FC1A22;
+        for(int i=0; i<4; i++) {
+            ks[i] = k[i];
+            ks[4] ^= k[i];
+            x[i] += k[i];
+        }
+        for(int r=0; r<rounds; r++) {
+            const int *rot = R[r%8];
+            if(r%2 == 0) {
+                x[0] += x[1]; x[1] = rotl(x[1],rot[0]); x[1] ^= x[0];
+                x[2] += x[3]; x[3] = rotl(x[3],rot[1]); x[3] ^= x[2];
+            } else {
+                x[0] += x[3]; x[3] = rotl(x[3],rot[0]); x[3] ^= x[0];
+                x[2] += x[1]; x[1] = rotl(x[1],rot[1]); x[1] ^= x[2];
+            }
+            if(r%4 == 3) { //Key injection
+                int s = (r+1)/4;
+                for(int i=0; i<4; i++) x[i] += ks[(s+i)%5];
+                x[3] += s;
+            }
+        }
+    }
+};
+
+template<class WordT> constexpr WordT Philox4<WordT>::M0;
+template<class WordT> constexpr WordT Philox4<WordT>::M1;
+template<class WordT> constexpr WordT Philox4<WordT>::W0;
+template<class WordT> constexpr WordT Philox4<WordT>::W1;
+
+} /* namespace parallel_rng::counter */
+
+/** @brief Counter-based engine over a keyed bijection.
+ *
+ * Value e of stream s is word e%W of block encrypt((e/W, s), seed), for W words per block.  The engine state is just
+ * (seed, stream, position, stride), so copies, jumps and splits are O(1).
+ */
+template<class BijectionT>
+class CounterEngine
+{
+public:
+    using bijection_type = BijectionT;
+    using result_type = typename BijectionT::word_type;
+    using ctr_type = typename BijectionT::ctr_type;
+    using key_type = typename BijectionT::key_type;
+    static constexpr std::size_t block_words = BijectionT::words;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    explicit CounterEngine(uint64_t seed_=0, uint64_t stream_=0)
+        : _stride{1}, _pos{0}, cached_block{no_block}
+    {
+        seed(seed_);
+        set_stream(stream_);
+    }
+
+    /** Seeding generators are any other class, so copies of a non-const engine still use the copy constructor */
+    template<class GenT>
+    using is_seed_generator = std::integral_constant<bool, std::is_class<GenT>::value &&
+                                    !std::is_same<typename std::decay<GenT>::type, CounterEngine>::value>;
+
+    /** Seed from a seeding generator, as for TRNG engines */
+    template<class GenT, class=typename std::enable_if<is_seed_generator<GenT>::value>::type>
+    explicit CounterEngine(GenT &g)
+        : CounterEngine(uint64_t(g()))
+    { }
+
+    void seed(uint64_t seed_)
+    {
+        _seed = seed_;
+        key.fill(0);
+        counter::pack(_seed, key.data());
+        cached_block = no_block;
+    }
+
+    template<class GenT, class=typename std::enable_if<is_seed_generator<GenT>::value>::type>
+    void seed(GenT &g)
+    { seed(uint64_t(g())); }
+
+    result_type operator()()
+    {
+        uint64_t block = _pos / block_words;
+        if(block != cached_block) {
+            buf = encrypt_block(block);
+            cached_block = block;
+        }
+        result_type v = buf[_pos % block_words];
+        _pos += _stride;
+        return v;
+    }
+
+    /** Write the next n values to out.  Contiguous streams encrypt whole blocks directly into out. */
+    void generate(result_type *out, std::size_t n)
+    {
+        if(_stride != 1) {
+            for(std::size_t i=0; i<n; i++) out[i] = (*this)();
+            return;
+        }
+        for(; n && _pos % block_words; n--) *out++ = (*this)();
+        const uint64_t first = _pos / block_words;
+        const std::size_t nblocks = n / block_words;
+        #pragma omp simd
+        for(std::size_t b=0; b<nblocks; b++) {
+            ctr_type x = encrypt_block(first+b);
+            for(std::size_t i=0; i<block_words; i++) out[b*block_words+i] = x[i];
+        }
+        _pos += nblocks*block_words;
+        out += nblocks*block_words;
+        for(n -= nblocks*block_words; n; n--) *out++ = (*this)();
+    }
+
+    /** Leapfrog split.  This engine becomes sub-stream n of s, i.e., values n, n+s, n+2s, ... */
+    void split(unsigned int s, unsigned int n)
+    {
+        if(s < 1 || n >= s) throw std::invalid_argument("CounterEngine: invalid argument for split.");
+        _pos += n*_stride;
+        _stride *= s;
+    }
+
+    void jump(unsigned long long k) { _pos += k*_stride; }
+    void jump2(unsigned int s) { jump(1ULL << s); }
+    void discard(unsigned long long k) { jump(k); }
+
+    /** Independent stream id.  Streams with the same seed never share blocks. */
+    uint64_t stream() const { return _stream; }
+    void set_stream(uint64_t stream_)
+    {
+        _stream = stream_;
+        cached_block = no_block;
+    }
+
+    /** Index of the next value in the underlying contiguous stream */
+    uint64_t position() const { return _pos; }
+    uint64_t stride() const { return _stride; }
+    void seek(uint64_t pos) { _pos = pos; }
+
+    static const char* name() { return BijectionT::name(); }
+
+    friend bool operator==(const CounterEngine &a, const CounterEngine &b)
+    { return a._seed==b._seed && a._stream==b._stream && a._pos==b._pos && a._stride==b._stride; }
+    friend bool operator!=(const CounterEngine &a, const CounterEngine &b)
+    { return !(a==b); }
+
+    /** TRNG-style stream format "[name (seed stream) (position stride)]" */
+    friend std::ostream& operator<<(std::ostream &out, const CounterEngine &R)
+    {
+        auto flags = out.flags();
+        out.flags(std::ios_base::dec | std::ios_base::fixed | std::ios_base::left);
+        out << '[' << name() << ' ' << '(' << R._seed << ' ' << R._stream << ')' << ' '
+            << '(' << R._pos << ' ' << R._stride << ')' << ']';
+        out.flags(flags);
+        return out;
+    }
+
+    friend std::istream& operator>>(std::istream &in, CounterEngine &R)
+    {
+        uint64_t seed_, stream_, pos, stride;
+        in.ignore(64,'(');
+        in >> seed_ >> stream_;
+        in.ignore(64,'(');
+        in >> pos >> stride;
+        in.ignore(64,']');
+        if(in) {
+            R.seed(seed_);
+            R.set_stream(stream_);
+            R._pos = pos;
+            R._stride = stride;
+        }
+        return in;
+    }
+
+private:
+    static constexpr uint64_t no_block = std::numeric_limits<uint64_t>::max();
+    uint64_t _seed;
+    uint64_t _stream;
+    uint64_t _stride;
+    uint64_t _pos;
+    key_type key;
+    uint64_t cached_block;
+    ctr_type buf;
+
+    ctr_type encrypt_block(uint64_t block) const
+    {
+        ctr_type x;
+        x.fill(0);
+        counter::pack(block, x.data());
+        counter::pack(_stream, x.data()+x.size()/2);
+        BijectionT::encrypt(x, key);
+        return x;
+    }
+};
+
+template<class BijectionT>
+constexpr std::size_t CounterEngine<BijectionT>::block_words;
+
+template<class BijectionT>
+constexpr uint64_t CounterEngine<BijectionT>::no_block;
+
+using Philox4x32 = CounterEngine<counter::Philox4<uint32_t>>;
+using Philox4x64 = CounterEngine<counter::Philox4<uint64_t>>;
+using Threefry4x64 = CounterEngine<counter::Threefry4x64>;
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_COUNTERENGINE_H */
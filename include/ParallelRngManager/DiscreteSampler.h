@@ -0,0 +1,188 @@
+/** @file DiscreteSampler.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Reusable alias-table sampler for discrete distributions.
+ *
+ * Building the table is O(K) for K categories and every draw afterwards is O(1) with a single random table access,
+ * unlike std::discrete_distribution, which does a binary search per draw.
+ *
+ * The table is built with the sweeping variant of Vose's method.  Lights (p<1) and heavies (p>=1) are processed
+ * in index order, and the result depends only on the prefix sums of light deficits L and heavy excesses H:
+ *  - light i is aliased to the first heavy j with H[j+1] > L[i]
+ *  - heavy j is closed by the first light i with L[i] >= H[j+1], giving prob 1+H[j+1]-L[i] and alias to heavy j+1
+ * Each entry can therefore be computed independently, so large tables are built in parallel over the OpenMP team.
+ * Prefix sums use fixed-size blocks, so the table is bit-identical for any number of threads.
+ *
+ * Reference:
+ *  - L. Hübschle-Schneider and P. Sanders. "Parallel Weighted Random Sampling". ESA 2019.
+ */
+#ifndef _PARALLEL_RNG_DISCRETESAMPLER_H
+#define _PARALLEL_RNG_DISCRETESAMPLER_H
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+
+#include <omp.h>
+#include <armadillo>
+
+#include "ParallelRngManager/Ziggurat.h"
+#include "ParallelRngManager/ParallelScan.h"
+
+namespace parallel_rng {
+
+/** @brief Alias table over K categories with O(1) sampling.
+ *
+ * Immutable after construction, so a single sampler can be shared by all threads, each using its own stream.
+ */
+template<class IdxT=arma::uword>
+class DiscreteSampler
+{
+public:
+    using result_type = IdxT;
+    /** Tables with at least this many categories are built in parallel.  The table is identical either way. */
+    static constexpr IdxT parallel_min_size = 1<<16;
+
+    template<class Weights>
+    explicit DiscreteSampler(const Weights &weights);
+
+    IdxT size() const { return table.size(); }
+
+    /** Probability of category k */
+    double probability(IdxT k) const { return probs.at(k); }
+
+    /** Single O(1) draw using one 64-bit value from gen */
+    template<class RngT>
+    IdxT operator()(RngT &gen) const
+    {
+        double x = ziggurat::unit_interval<double>(ziggurat::random_u64(gen)) * table.size();
+        IdxT k = std::min(IdxT(x), IdxT(table.size()-1));
+        const Entry &e = table[k];
+        return (x - k < e.prob) ? k : e.alias;
+    }
+
+    /** Bulk entry point.  Fill [first,last) with samples. */
+    template<class OutIt, class RngT>
+    void generate(OutIt first, OutIt last, RngT &gen) const
+    { for(; first!=last; ++first) *first = (*this)(gen); }
+
+private:
+    struct Entry
+    {
+        double prob; //Probability of keeping column k, rather than taking its alias
+        IdxT alias;
+    };
+    static constexpr IdxT block_size = scan::block_size;
+
+    std::vector<Entry> table;
+    std::vector<double> probs;
+
+    static IdxT num_blocks(IdxT n) { return scan::num_blocks(n); }
+};
+
+template<class IdxT>
+constexpr IdxT DiscreteSampler<IdxT>::parallel_min_size;
+
+template<class IdxT>
+constexpr IdxT DiscreteSampler<IdxT>::block_size;
+
+template<class IdxT>
+template<class Weights>
+DiscreteSampler<IdxT>::DiscreteSampler(const Weights &weights)
+{
+    auto w = weights.begin();
+    const IdxT K = std::distance(weights.begin(), weights.end());
+    if(K == 0) throw std::invalid_argument("DiscreteSampler: weights are empty.");
+    const IdxT nblocks = num_blocks(K);
+    const bool par = K >= parallel_min_size;
+
+    //Normalize so mean weight is 1
+    std::vector<double> block_totals(nblocks,0);
+    bool valid = true;
+    #pragma omp parallel for if(par) reduction(&&:valid)
+    for(IdxT b=0; b<nblocks; b++) {
+        double s = 0;
+        for(IdxT k=b*block_size; k<std::min(K,(b+1)*block_size); k++) {
+            double wk = w[k];
+            valid = valid && std::isfinite(wk) && wk >= 0;
+            s += wk;
+        }
+        block_totals[b] = s;
+    }
+    double W = 0;
+    for(auto s: block_totals) W += s;
+    if(!valid || !(W > 0) || !std::isfinite(W)) throw std::invalid_argument("DiscreteSampler: weights must be finite, non-negative, and not all zero.");
+
+    probs.resize(K);
+    table.resize(K);
+    std::vector<double> p(K);
+    std::vector<IdxT> block_nlight(nblocks);
+    #pragma omp parallel for if(par)
+    for(IdxT b=0; b<nblocks; b++) {
+        IdxT nlight = 0;
+        for(IdxT k=b*block_size; k<std::min(K,(b+1)*block_size); k++) {
+            probs[k] = w[k] / W;
+            p[k] = (w[k] / W) * K;
+            if(p[k] < 1) nlight++;
+        }
+        block_nlight[b] = nlight;
+    }
+
+    //Partition into lights and heavies in index order
+    std::vector<IdxT> light_offset(nblocks+1,0);
+    for(IdxT b=0; b<nblocks; b++) light_offset[b+1] = light_offset[b] + block_nlight[b];
+    const IdxT nlight = light_offset[nblocks];
+    const IdxT nheavy = K - nlight;
+    std::vector<IdxT> lights(nlight), heavies(nheavy);
+    std::vector<double> L(nlight+1), H(nheavy+1); //L[i]: deficit of lights before i.  H[j]: excess of heavies before j
+    L[0] = H[0] = 0;
+    #pragma omp parallel for if(par)
+    for(IdxT b=0; b<nblocks; b++) {
+        IdxT i = light_offset[b];
+        IdxT j = b*block_size - light_offset[b];
+        for(IdxT k=b*block_size; k<std::min(K,(b+1)*block_size); k++) {
+            if(p[k] < 1) {
+                lights[i] = k;
+                L[++i] = 1 - p[k];
+            } else {
+                heavies[j] = k;
+                H[++j] = p[k] - 1;
+            }
+        }
+    }
+    scan::block_prefix_sum(L.data()+1, nlight, nlight >= parallel_min_size);
+    scan::block_prefix_sum(H.data()+1, nheavy, nheavy >= parallel_min_size);
+
+    //Lights keep their own probability and alias the heavy that covers their deficit
+    #pragma omp parallel for if(par)
+    for(IdxT b=0; b<num_blocks(nlight); b++) {
+        IdxT i = b*block_size;
+        IdxT m = std::upper_bound(H.begin()+1, H.end(), L[i]) - H.begin(); //first m with H[m] > L[i]
+        for(; i<std::min(nlight,(b+1)*block_size); i++) {
+            while(m <= nheavy && !(H[m] > L[i])) m++;
+            IdxT k = lights[i];
+            if(m <= nheavy) table[k] = Entry{p[k], heavies[m-1]};
+            else table[k] = Entry{1, k}; //Rounding residue
+        }
+    }
+
+    //Heavies are closed by the first light that exhausts them, and alias the next heavy
+    #pragma omp parallel for if(par)
+    for(IdxT b=0; b<num_blocks(nheavy); b++) {
+        IdxT j = b*block_size;
+        IdxT i = std::lower_bound(L.begin(), L.end(), H[j+1]) - L.begin(); //first i with L[i] >= H[j+1]
+        for(; j<std::min(nheavy,(b+1)*block_size); j++) {
+            while(i <= nlight && L[i] < H[j+1]) i++;
+            IdxT k = heavies[j];
+            if(j+1 < nheavy && i <= nlight) table[k] = Entry{1 + H[j+1] - L[i], heavies[j+1]};
+            else table[k] = Entry{1, k}; //Last heavy, or rounding residue
+        }
+    }
+}
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_DISCRETESAMPLER_H */
@@ -0,0 +1,171 @@
+/** @file Instrumentation.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Opt-in per-thread counters of calls, draws, bytes, and cycles for each sampling API.
+ *
+ * Instrumentation is compiled in only when PARALLEL_RNG_INSTRUMENT is defined (CMake option OPT_INSTRUMENT).
+ * Otherwise PARALLEL_RNG_PROBE expands to nothing, and ParallelRngManager::instrument_snapshot() is always empty.
+ *
+ * Each stream's ThreadCounters are kept in its per-thread state slot, so counters share cache lines with nothing
+ * another thread writes.  Cycles are read from the time stamp counter on x86, and are nanoseconds elsewhere.
+ *
+ * With PARALLEL_RNG_INSTRUMENT_PERF also defined on Linux, each probe also reads the calling thread's cache misses
+ * and retired instructions from a perf_event_open group.  That costs a read() system call at each end of a probe, so
+ * it is best used with bulk fills.  If perf events are not permitted (see /proc/sys/kernel/perf_event_paranoid),
+ * those counters stay zero.
+ */
+#ifndef _PARALLEL_RNG_INSTRUMENTATION_H
+#define _PARALLEL_RNG_INSTRUMENTATION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+#endif
+
+namespace parallel_rng {
+
+namespace instrument {
+
+#ifdef PARALLEL_RNG_INSTRUMENT
+    static const bool enabled = true;
+#else
+    static const bool enabled = false;
+#endif
+
+#if defined(PARALLEL_RNG_INSTRUMENT_PERF) && defined(__linux__)
+    static const bool perf_enabled = true;
+#else
+    static const bool perf_enabled = false;
+#endif
+
+/** Instrumented ParallelRngManager methods.  Forms that forward to another instrumented method are counted there. */
+enum class Api : int
+{
+    Randu,
+    Randn,
+    FillRandu,
+    FillRandn,
+    ResampleDist,
+    FillResample,
+    FillRanduParallel,
+    FillRandnParallel
+};
+static const std::size_t num_apis = 8;
+
+const char* api_name(Api api);
+
+struct ApiCounters
+{
+    uint64_t calls = 0;
+    uint64_t draws = 0; //Samples returned
+    uint64_t bytes = 0; //Bytes of samples returned
+    uint64_t cycles = 0;
+    uint64_t cache_misses = 0;
+    uint64_t instructions = 0;
+
+    ApiCounters& operator+=(const ApiCounters &o);
+};
+
+/** Counters of one stream key, written only by the thread that owns the key */
+struct ThreadCounters
+{
+    std::array<ApiCounters,num_apis> api;
+
+    ApiCounters& operator[](Api a) { return api[static_cast<std::size_t>(a)]; }
+    const ApiCounters& operator[](Api a) const { return api[static_cast<std::size_t>(a)]; }
+};
+
+/** @brief Copy of the counters of every stream key that has made an instrumented call.
+ *
+ * Take snapshots from serial code, as the counters are not read atomically.
+ */
+struct Snapshot
+{
+    std::vector<std::size_t> keys; //Stream key of each thread.  Threads of the outer team have their thread number.
+    std::vector<ThreadCounters> threads;
+
+    ApiCounters total(Api a) const;
+    ThreadCounters total() const;
+    /** JSON object with per-thread counters of each API that was called, and totals with per-draw ratios */
+    void write_json(std::ostream &out) const;
+    std::string json() const;
+};
+
+/** Time stamp counter where available, otherwise nanoseconds of a steady clock */
+inline
+uint64_t cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/** Cache misses and instructions of the calling thread from its own perf event group, opened on first use.
+ *  Returns false, leaving the arguments unchanged, if perf events are unavailable.
+ */
+bool read_perf_counters(uint64_t &cache_misses, uint64_t &instructions);
+
+/** @brief Adds one call to an ApiCounters on destruction, with the cycles and perf counts of its lifetime */
+class Probe
+{
+public:
+    Probe(ApiCounters &counters, uint64_t draws, uint64_t bytes) :
+        counters(counters), draws(draws), bytes(bytes), cache_misses(0), instructions(0)
+    {
+        if(perf_enabled) read_perf_counters(cache_misses, instructions);
+        start = cycles();
+    }
+
+    ~Probe()
+    {
+        uint64_t stop = cycles();
+        counters.calls++;
+        counters.draws += draws;
+        counters.bytes += bytes;
+        counters.cycles += stop - start;
+        if(perf_enabled) {
+            uint64_t misses = cache_misses, instr = instructions;
+            if(read_perf_counters(misses, instr)) {
+                counters.cache_misses += misses - cache_misses;
+                counters.instructions += instr - instructions;
+            }
+        }
+    }
+
+    Probe(const Probe &) = delete;
+    Probe& operator=(const Probe &) = delete;
+
+private:
+    ApiCounters &counters;
+    uint64_t draws;
+    uint64_t bytes;
+    uint64_t cache_misses;
+    uint64_t instructions;
+    uint64_t start;
+};
+
+} /* namespace parallel_rng::instrument */
+
+} /* namespace parallel_rng */
+
+/** Count the enclosing ParallelRngManager method as a call of instrument::Api::api making draws samples of
+ * bytes total size.  Expands to nothing unless PARALLEL_RNG_INSTRUMENT is defined.
+ */
+#ifdef PARALLEL_RNG_INSTRUMENT
+    #define PARALLEL_RNG_PROBE(api, draws, bytes) \
+        instrument::Probe _parallel_rng_probe(thread_counters()[instrument::Api::api], (draws), (bytes))
+#else
+    #define PARALLEL_RNG_PROBE(...)
+#endif
+
+#endif /* _PARALLEL_RNG_INSTRUMENTATION_H */
@@ -0,0 +1,281 @@
+/** @file LeapfrogEngine.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Multi-lane leapfrog engine for bulk generation from a single TRNG stream.
+ *
+ * A single TRNG stream is a serial dependency chain: each value requires the previous state.  For bulk
+ * generation we instead run L independent lanes, where lane j is the leapfrog sub-stream
+ * x[j], x[j+L], x[j+2L], ... of the parent stream (TRNG split(L,j)).  The lanes are interleaved back into
+ * a buffer so the values are emitted in exactly the order the parent would have produced them.  Consumers
+ * see a standard UniformRandomBitGenerator, or use generate() to have whole blocks written directly to their output.
+ * After use commit() advances the parent by the number of values consumed, so the lanes reproduce the parent's values
+ * exactly and bulk and scalar use can be freely mixed.
+ *
+ * For trng::lcg64_shift the lanes are stored as a structure-of-arrays and advanced with an `omp simd` loop, so
+ * the compiler can keep all lanes in AVX2/AVX-512 registers.  Other TRNG engines use an array of split engines,
+ * which still removes the serial dependency between successive values.  CounterEngine needs no lanes at all, and
+ * generates whole blocks in stream order.
+ */
+#ifndef _PARALLEL_RNG_LEAPFROGENGINE_H
+#define _PARALLEL_RNG_LEAPFROGENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include <trng/lcg64_shift.hpp>
+
+#include "ParallelRngManager/CounterEngine.h"
+
+namespace parallel_rng {
+
+/** @brief Generic lane kernel.  Holds Lanes copies of the parent engine each split into a leapfrog sub-stream.
+ *
+ * Works for any TRNG parallel engine supporting split(s,n).
+ */
+template<class RngT, std::size_t Lanes>
+class LaneKernel
+{
+public:
+    using result_type = typename RngT::result_type;
+
+    explicit LaneKernel(const RngT &parent)
+    {
+        for(std::size_t j=0; j<Lanes; j++) {
+            lanes[j] = parent;
+            lanes[j].split(Lanes,j);
+        }
+    }
+
+    /** Write depth*Lanes values to out in parent stream order */
+    void generate(result_type *out, std::size_t depth)
+    {
+        for(std::size_t d=0; d<depth; d++) for(std::size_t j=0; j<Lanes; j++) out[d*Lanes+j] = lanes[j]();
+    }
+
+private:
+    std::array<RngT,Lanes> lanes;
+};
+
+namespace lcg64_shift_state {
+
+using word = trng::lcg64_shift::result_type;
+
+/** Parse (a, b, r) from the TRNG stream I/O format "[lcg64_shift (a b) (r)]" */
+inline
+bool read_stream(const trng::lcg64_shift &gen, word state[3])
+{
+    std::stringstream ss;
+    ss << gen;
+    ss.ignore(64,'(');
+    ss >> state[0] >> state[1];
+    ss.ignore(64,'(');
+    ss >> state[2];
+    return bool(ss);
+}
+
+/** True if the object representation of lcg64_shift is the words {a, b, r}, checked against read_stream() */
+inline
+bool layout_is_words()
+{
+    if(!std::is_trivially_copyable<trng::lcg64_shift>::value || sizeof(trng::lcg64_shift) != 3*sizeof(word)) return false;
+    trng::lcg64_shift probe;
+    probe.split(3,1);
+    probe();
+    word parsed[3];
+    word copied[3];
+    if(!read_stream(probe, parsed)) return false;
+    std::memcpy(copied, &probe, sizeof(copied));
+    return std::equal(parsed, parsed+3, copied);
+}
+
+/** Read (a, b, r) of gen.
+ *
+ * TRNG has no state accessors.  The state is copied directly out of the engine when its layout was verified on
+ * first use, so construction costs no stream I/O, and is otherwise parsed from the stream I/O format.
+ */
+inline
+void read(const trng::lcg64_shift &gen, word state[3])
+{
+    static const bool copyable = layout_is_words();
+    if(copyable) std::memcpy(state, &gen, 3*sizeof(word));
+    else if(!read_stream(gen, state)) throw std::logic_error("LaneKernel: unable to read lcg64_shift state.");
+}
+
+} /* namespace parallel_rng::lcg64_shift_state */
+
+/** @brief Structure-of-arrays lane kernel for trng::lcg64_shift.
+ *
+ * Every leapfrog lane shares the multiplier a^L and increment b(1+a+...+a^(L-1)), so only the 64-bit state differs.
+ * The parent state is read once, and the lane parameters and initial states are computed by stepping it L times,
+ * which is much cheaper than L calls to split().
+ */
+template<std::size_t Lanes>
+class LaneKernel<trng::lcg64_shift, Lanes>
+{
+public:
+    using result_type = trng::lcg64_shift::result_type;
+
+    explicit LaneKernel(const trng::lcg64_shift &parent)
+        : a{1}, b{0}
+    {
+        result_type state[3];
+        lcg64_shift_state::read(parent, state);
+        const result_type parent_a = state[0];
+        const result_type parent_b = state[1];
+        result_type s = state[2];
+        for(std::size_t j=0; j<Lanes; j++) {
+            s = parent_a*s + parent_b;
+            r[j] = s;
+            b = b*parent_a + parent_b;
+            a *= parent_a;
+        }
+    }
+
+    /** Write depth*Lanes values to out in parent stream order */
+    void generate(result_type *out, std::size_t depth)
+    {
+        //Local copies, as out may alias the members, which would force a reload after every store
+        const result_type A = a;
+        const result_type B = b;
+        alignas(64) result_type s[Lanes];
+        for(std::size_t j=0; j<Lanes; j++) s[j] = r[j];
+        for(std::size_t d=0; d<depth; d++) {
+            auto out_d = out+d*Lanes;
+            #pragma omp simd aligned(s:64)
+            for(std::size_t j=0; j<Lanes; j++) {
+                out_d[j] = shift(s[j]);
+                s[j] = A*s[j] + B;
+            }
+        }
+        for(std::size_t j=0; j<Lanes; j++) r[j] = s[j];
+    }
+
+private:
+    result_type a;
+    result_type b;
+    alignas(64) std::array<result_type,Lanes> r; //State of the next output of each lane
+
+    static result_type shift(result_type t)
+    {
+        t ^= (t >> 17);
+        t ^= (t << 31);
+        t ^= (t >> 8);
+        return t;
+    }
+};
+
+/** @brief Lane kernel for counter-based engines.  Blocks are independent, so values are encrypted directly in order. */
+template<class BijectionT, std::size_t Lanes>
+class LaneKernel<CounterEngine<BijectionT>, Lanes>
+{
+public:
+    using result_type = typename CounterEngine<BijectionT>::result_type;
+
+    explicit LaneKernel(const CounterEngine<BijectionT> &parent)
+        : engine{parent}
+    { }
+
+    /** Write depth*Lanes values to out in parent stream order */
+    void generate(result_type *out, std::size_t depth)
+    { engine.generate(out, depth*Lanes); }
+
+private:
+    CounterEngine<BijectionT> engine;
+};
+
+/** @brief Buffered multi-lane engine generating the parent stream in blocks of Lanes*Depth values.
+ *
+ * Satisfies UniformRandomBitGenerator so it can drive any std distribution.  The parent engine is not
+ * modified until commit() is called, which advances the parent past exactly the values consumed.
+ *
+ * Usage:
+ * @code
+ *   LeapfrogEngine<RngT> lanes(gen);
+ *   for(IdxT n=0;n<N;n++) samp(n) = dist(lanes);
+ *   lanes.commit(gen);
+ * @endcode
+ */
+template<class RngT, std::size_t Lanes=8, std::size_t Depth=32>
+class LeapfrogEngine
+{
+public:
+    using result_type = typename RngT::result_type;
+    static constexpr std::size_t lanes = Lanes;
+    static constexpr std::size_t block_size = Lanes*Depth;
+    static constexpr result_type min() { return RngT::min(); }
+    static constexpr result_type max() { return RngT::max(); }
+
+    explicit LeapfrogEngine(const RngT &parent)
+        : kernel{parent}, pos{block_size}, blocks{0}
+    { }
+
+    result_type operator()()
+    {
+        if(pos == block_size) refill();
+        return buf[pos++];
+    }
+
+    /** Write the next n values to out.  Identical to n calls of operator(), but whole blocks are generated directly
+     * into out, skipping the buffer.
+     */
+    void generate(result_type *out, std::size_t n)
+    {
+        std::size_t m = std::min(n, block_size-pos);
+        std::copy(buf.data()+pos, buf.data()+pos+m, out);
+        pos += m;
+        out += m;
+        n -= m;
+        std::size_t nblocks = n / block_size;
+        if(nblocks) {
+            kernel.generate(out, nblocks*Depth);
+            blocks += nblocks;
+            out += nblocks*block_size;
+            n -= nblocks*block_size;
+        }
+        if(n) {
+            refill();
+            std::copy(buf.data(), buf.data()+n, out);
+            pos = n;
+        }
+    }
+
+    /** Number of values emitted since construction */
+    unsigned long long consumed() const { return blocks ? (blocks-1)*block_size + pos : 0; }
+
+    /** Advance parent past all values emitted by this engine.  Parent must be the engine this was constructed from. */
+    void commit(RngT &parent) const
+    {
+        auto n = consumed();
+        if(n) parent.jump(n);
+    }
+
+private:
+    LaneKernel<RngT,Lanes> kernel;
+    alignas(64) std::array<result_type,block_size> buf;
+    std::size_t pos;
+    unsigned long long blocks; //Blocks generated.  Counting per block keeps operator() to one store.
+
+    //Kept out of operator() so the per-value path stays small enough to inline
+    void refill()
+    {
+        kernel.generate(buf.data(), Depth);
+        pos = 0;
+        blocks++;
+    }
+};
+
+template<class RngT, std::size_t Lanes, std::size_t Depth>
+constexpr std::size_t LeapfrogEngine<RngT,Lanes,Depth>::lanes;
+
+template<class RngT, std::size_t Lanes, std::size_t Depth>
+constexpr std::size_t LeapfrogEngine<RngT,Lanes,Depth>::block_size;
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_LEAPFROGENGINE_H */
@@ -0,0 +1,139 @@
+/** @file MultivariateNormal.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Multivariate normal sampler with a cached covariance factor.
+ *
+ * The factor L with L*L^T = cov is computed once at construction, by Cholesky decomposition or, if the covariance is
+ * only positive semidefinite, from the eigendecomposition as V*sqrt(D).  N samples are drawn by filling a d x N block
+ * with standard normals from a ParallelRngManager, and transforming it in place with one GEMM per block of block_cols
+ * columns.  Blocks are fixed, so the GEMM results do not depend on how blocks are assigned to threads.
+ */
+#ifndef _PARALLEL_RNG_MULTIVARIATENORMAL_H
+#define _PARALLEL_RNG_MULTIVARIATENORMAL_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "ParallelRngManager/ParallelRngManager.h"
+
+namespace parallel_rng {
+
+template<class FloatT=double>
+class MultivariateNormalSampler
+{
+public:
+    using VecT = arma::Col<FloatT>;
+    using MatT = arma::Mat<FloatT>;
+    /** Columns transformed by each GEMM */
+    static constexpr IdxT block_cols = 1024;
+
+    MultivariateNormalSampler(const VecT &mean, const MatT &cov);
+
+    IdxT dim() const { return mu.n_elem; }
+    const VecT& mean() const { return mu; }
+    const MatT& factor() const { return L; } // Lower triangular unless the covariance is singular
+    bool semidefinite() const { return _semidefinite; } // Factor was computed from the eigendecomposition
+
+    /* Samples are columns.  GenT is a ParallelRngManager or one of its stream handles. */
+    template<class GenT>
+    VecT sample(GenT &gen) { VecT samp(dim()); fill(gen, samp); return samp; }
+
+    template<class GenT>
+    MatT sample(GenT &gen, IdxT N) { MatT samp(dim(), N); fill(gen, samp); return samp; }
+
+    template<class GenT>
+    void fill(GenT &gen, MatT &samp);
+
+    /* Parallel sampling.  The normals come from fill_randn_parallel(), so the output is identical for any number of
+     * threads, but differs from sample().  Call from serial code.
+     */
+    template<class ManagerT>
+    MatT sample_parallel(ManagerT &manager, IdxT N) { MatT samp(dim(), N); fill_parallel(manager, samp); return samp; }
+
+    template<class ManagerT>
+    void fill_parallel(ManagerT &manager, MatT &samp);
+
+private:
+    VecT mu;
+    MatT L;
+    bool _semidefinite;
+
+    void check_shape(const MatT &samp) const;
+    void transform(MatT &samp, bool parallel) const;
+};
+
+template<class FloatT>
+constexpr IdxT MultivariateNormalSampler<FloatT>::block_cols;
+
+template<class FloatT>
+MultivariateNormalSampler<FloatT>::MultivariateNormalSampler(const VecT &mean, const MatT &cov)
+    : mu(mean), _semidefinite{false}
+{
+    const IdxT d = mean.n_elem;
+    if(d == 0) throw ParallelRngManagerError("MultivariateNormalSampler: mean is empty.");
+    if(cov.n_rows != d || cov.n_cols != d) throw ParallelRngManagerError("MultivariateNormalSampler: covariance size does not match mean.");
+    FloatT scale = 0;
+    for(IdxT n=0; n<cov.n_elem; n++) scale = std::max(scale, std::abs(cov(n)));
+    const FloatT tol = 100*d*std::numeric_limits<FloatT>::epsilon()*scale;
+    for(IdxT j=0; j<d; j++) for(IdxT i=j+1; i<d; i++) {
+        if(std::abs(cov(i,j) - cov(j,i)) > tol) throw ParallelRngManagerError("MultivariateNormalSampler: covariance is not symmetric.");
+    }
+    if(arma::chol(L, cov, "lower")) return;
+    //Singular covariance.  Use L = V*sqrt(D), clamping eigenvalues lost to round-off at 0.
+    VecT eval;
+    MatT evec;
+    if(!arma::eig_sym(eval, evec, cov)) throw ParallelRngManagerError("MultivariateNormalSampler: eigendecomposition failed.");
+    L.set_size(d, d);
+    for(IdxT j=0; j<d; j++) {
+        if(eval(j) < -tol) throw ParallelRngManagerError("MultivariateNormalSampler: covariance is not positive semidefinite.");
+        FloatT s = std::sqrt(std::max(eval(j), FloatT(0)));
+        for(IdxT i=0; i<d; i++) L(i,j) = evec(i,j)*s;
+    }
+    _semidefinite = true;
+}
+
+template<class FloatT>
+template<class GenT>
+void MultivariateNormalSampler<FloatT>::fill(GenT &gen, MatT &samp)
+{
+    check_shape(samp);
+    gen.fill_randn(samp);
+    transform(samp, false);
+}
+
+template<class FloatT>
+template<class ManagerT>
+void MultivariateNormalSampler<FloatT>::fill_parallel(ManagerT &manager, MatT &samp)
+{
+    check_shape(samp);
+    manager.fill_randn_parallel(samp);
+    transform(samp, true);
+}
+
+template<class FloatT>
+void MultivariateNormalSampler<FloatT>::check_shape(const MatT &samp) const
+{
+    if(samp.n_rows != dim()) throw ParallelRngManagerError("MultivariateNormalSampler: samp rows do not match dimension.");
+}
+
+/** Replace each column z of samp with L*z + mu, one GEMM per block of block_cols columns */
+template<class FloatT>
+void MultivariateNormalSampler<FloatT>::transform(MatT &samp, bool parallel) const
+{
+    const IdxT d = dim();
+    const IdxT nblocks = (samp.n_cols + block_cols - 1) / block_cols;
+    #pragma omp parallel for if(parallel && nblocks > 1) schedule(static)
+    for(IdxT b=0; b<nblocks; b++) {
+        const IdxT c0 = b*block_cols;
+        const IdxT nc = std::min(block_cols, IdxT(samp.n_cols) - c0);
+        const MatT Z(samp.colptr(c0), d, nc); //Copy of the standard normals
+        MatT X(samp.colptr(c0), d, nc, false, true); //Writes through to samp
+        X = L*Z;
+        for(IdxT j=0; j<nc; j++) for(IdxT i=0; i<d; i++) X(i,j) += mu(i);
+    }
+}
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_MULTIVARIATENORMAL_H */
@@ -0,0 +1,48 @@
+/** @file Numa.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief NUMA placement of per-thread state and pinning of OpenMP threads.
+ *
+ * Memory is placed on the node of the thread that first writes each page.  Per-thread state allocated by one thread
+ * therefore lives on that thread's node, and threads on other sockets reach it remotely on every draw.  With
+ * StreamPlacement::NumaLocal, each StreamTable slot has its own pages, which are moved to the node of the thread that
+ * materializes it.  Placement is only meaningful if threads stay on their nodes, so pin_openmp_threads() binds each
+ * thread of a team to its own CPU, as OMP_PROC_BIND=true with OMP_PLACES=cores would.
+ *
+ * These are Linux system calls.  Elsewhere placement and pinning do nothing and report failure.
+ */
+#ifndef _PARALLEL_RNG_NUMA_H
+#define _PARALLEL_RNG_NUMA_H
+
+#include <cstddef>
+
+namespace parallel_rng {
+
+/** Placement of StreamTable slots.  Cache keeps slots on separate cache lines.  NumaLocal puts each slot on its own
+ * pages on the NUMA node of the thread that materializes it.
+ */
+enum class StreamPlacement { Cache, NumaLocal };
+
+namespace numa {
+
+std::size_t page_size();
+std::size_t num_nodes(); // Number of NUMA nodes, or 1 if unknown
+int current_node(); // Node of the CPU running the calling thread, or -1 if unknown
+
+/** Move the pages of [addr, addr+len) to the calling thread's node, and prefer that node for any later faults.
+ *  addr must be page aligned.  Returns false if the pages could not be bound.
+ */
+bool bind_local(void *addr, std::size_t len);
+
+/** Pin thread t of a new OpenMP team to the t-th CPU available to the process, modulo the number of CPUs.
+ *
+ * OpenMP runtimes reuse the same OS threads for later teams of up to the same size, so thread t, its stream, and its
+ * stream's pages stay on one CPU.  Call from serial code before sampling.  Returns the number of threads pinned.
+ */
+int pin_openmp_threads();
+
+} /* namespace parallel_rng::numa */
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_NUMA_H */
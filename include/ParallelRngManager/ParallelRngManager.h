@@ -8,8 +8,18 @@
 #define _PARALLEL_RNG_PARALLELRNGMANAGER_H
 
 #include <cstdint>
+#include <array>
+#include <limits>
 #include <exception>
+#include <stdexcept>
 #include <functional>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <unordered_set>
 
 #include <omp.h>
 
@@ -18,6 +28,21 @@
 
 #include "ParallelRngManager/AnyRng/AnyRng.h"
 #include "ParallelRngManager/AlignedArray/AArray.h"
+#include "ParallelRngManager/CounterEngine.h"
+#include "ParallelRngManager/LeapfrogEngine.h"
+#include "ParallelRngManager/UnitUniform.h"
+#include "ParallelRngManager/Ziggurat.h"
+#include "ParallelRngManager/Gamma.h"
+#include "ParallelRngManager/Poisson.h"
+#include "ParallelRngManager/Permutation.h"
+#include "ParallelRngManager/Bootstrap.h"
+#include "ParallelRngManager/DiscreteSampler.h"
+#include "ParallelRngManager/Resampling.h"
+#include "ParallelRngManager/Numa.h"
+#include "ParallelRngManager/StreamTable.h"
+#include "ParallelRngManager/StreamPathIndex.h"
+#include "ParallelRngManager/Checkpoint.h"
+#include "ParallelRngManager/Instrumentation.h"
 
 
 #ifdef PARALLEL_RNG_DEBUG
@@ -46,6 +71,12 @@
     #endif
 #endif
 
+namespace trng {
+    //Parallel TRNG engines with a period below 2^64.  See parallel_rng::engine_period_bits.
+    class mrg2;
+    class yarn2;
+}
+
 namespace parallel_rng {
   
 
@@ -76,27 +107,473 @@ SeedT generate_seed();
  */
 IdxT openmp_estimate_max_threads();
 
-template<class RngT=DefaultParallelRngT, class FloatT=double>
+/** @brief Make rng the n-th of s per-thread streams.
+ *
+ * TRNG engines use a leapfrog split.  Counter-based engines instead take independent stream ids, so each thread
+ * still reads contiguous blocks.
+ */
+template<class RngT>
+void split_thread_stream(RngT &rng, IdxT s, IdxT n)
+{
+    rng.split(s,n);
+}
+
+template<class BijectionT>
+void split_thread_stream(CounterEngine<BijectionT> &rng, IdxT s, IdxT n)
+{
+    rng.set_stream(rng.stream()*s + n);
+}
+
+/** @brief Base 2 logarithm of the period of a TRNG engine, rounded down.
+ *
+ * Engines are assumed to have a period of at least 2^64.  Specialize this for engines with a shorter period, so that
+ * StreamLayout places their streams within one period.
+ */
+template<class RngT>
+struct engine_period_bits : std::integral_constant<unsigned,64> {};
+
+/** Period (2^31-1)^2-1 */
+template<>
+struct engine_period_bits<trng::mrg2> : std::integral_constant<unsigned,61> {};
+
+/** Period (2^31-1)^2-1 */
+template<>
+struct engine_period_bits<trng::yarn2> : std::integral_constant<unsigned,61> {};
+
+/** @brief Positions in the root stream of a TRNG engine of the streams derived from it.
+ *
+ * Jumps wrap around the period, so every stream is placed within the first 2^period_bits values of the root stream,
+ * where period_bits is at most 64.  The leapfrogged per-thread streams use the values before the first eighth of
+ * that range.  Nested thread streams use the second eighth, overflow thread streams the second quarter, and task
+ * streams the second half.
+ */
+template<class RngT>
+struct StreamLayout
+{
+    static constexpr unsigned period_bits = engine_period_bits<RngT>::value < 64 ? engine_period_bits<RngT>::value : 64;
+    static_assert(period_bits >= 60, "StreamLayout: engine period is too short for the stream layout.");
+
+    /** Leapfrogged per-thread streams may use root positions below this before reaching other streams */
+    static constexpr uint64_t thread_stream_end = uint64_t(1)<<(period_bits-3);
+
+    /** Values available to each task stream */
+    static constexpr uint64_t task_stream_length = uint64_t(1)<<32;
+    /** Position of the first task stream */
+    static constexpr uint64_t task_stream_offset = uint64_t(1)<<(period_bits-1);
+    static constexpr uint64_t max_task_streams = task_stream_offset / task_stream_length;
+
+    /** Values available to each overflow thread stream */
+    static constexpr uint64_t overflow_stream_length = uint64_t(1)<<40;
+    /** Position of the first overflow thread stream */
+    static constexpr uint64_t overflow_stream_offset = uint64_t(1)<<(period_bits-2);
+    static constexpr uint64_t max_overflow_streams = overflow_stream_offset / overflow_stream_length;
+
+    /** Values available to each nested thread stream */
+    static constexpr uint64_t nested_stream_length = uint64_t(1)<<40;
+    /** Position of the first nested thread stream */
+    static constexpr uint64_t nested_stream_offset = thread_stream_end;
+    static constexpr uint64_t max_nested_streams = nested_stream_offset / nested_stream_length;
+};
+
+template<class RngT> constexpr unsigned StreamLayout<RngT>::period_bits;
+template<class RngT> constexpr uint64_t StreamLayout<RngT>::thread_stream_end;
+template<class RngT> constexpr uint64_t StreamLayout<RngT>::task_stream_length;
+template<class RngT> constexpr uint64_t StreamLayout<RngT>::task_stream_offset;
+template<class RngT> constexpr uint64_t StreamLayout<RngT>::max_task_streams;
+template<class RngT> constexpr uint64_t StreamLayout<RngT>::overflow_stream_length;
+template<class RngT> constexpr uint64_t StreamLayout<RngT>::overflow_stream_offset;
+template<class RngT> constexpr uint64_t StreamLayout<RngT>::max_overflow_streams;
+template<class RngT> constexpr uint64_t StreamLayout<RngT>::nested_stream_length;
+template<class RngT> constexpr uint64_t StreamLayout<RngT>::nested_stream_offset;
+template<class RngT> constexpr uint64_t StreamLayout<RngT>::max_nested_streams;
+
+/** Stream id bit of task streams of counter-based engines, which per-thread streams never reach */
+static const uint64_t counter_task_stream_bit = uint64_t(1)<<63;
+/** Stream id bit of overflow thread streams of counter-based engines */
+static const uint64_t counter_overflow_stream_bit = uint64_t(1)<<62;
+/** Stream id bit of nested thread streams of counter-based engines */
+static const uint64_t counter_nested_stream_bit = uint64_t(1)<<61;
+
+/** @brief Make root, a freshly seeded engine, the stream of thread n beyond the s split streams, i.e., n>=s.
+ *
+ * A leapfrog split cannot be extended without renumbering the existing streams, so these threads instead get a
+ * disjoint block of the root stream.  TRNG engines jump to a block of overflow_stream_length values in the second
+ * quarter of the StreamLayout, which allows 2^22 overflow threads for engines with a period of at least 2^64.
+ * Counter-based engines use stream id 2^62+n-s.
+ */
+template<class RngT>
+void select_overflow_stream(RngT &root, IdxT s, IdxT n)
+{
+    using Layout = StreamLayout<RngT>;
+    uint64_t k = n - s;
+    if(k >= Layout::max_overflow_streams) throw ParallelRngManagerError("select_overflow_stream: thread index too large.");
+    root.jump(Layout::overflow_stream_offset + k*Layout::overflow_stream_length);
+}
+
+template<class BijectionT>
+void select_overflow_stream(CounterEngine<BijectionT> &root, IdxT s, IdxT n)
+{
+    uint64_t k = n - s;
+    if(k >= counter_overflow_stream_bit) throw ParallelRngManagerError("select_overflow_stream: thread index too large.");
+    root.set_stream(counter_overflow_stream_bit | k);
+}
+
+/** Number of nested thread streams of an engine.  2^21 for TRNG engines with a period of at least 2^64. */
+template<class RngT>
+struct max_nested_streams : std::integral_constant<uint64_t, StreamLayout<RngT>::max_nested_streams> {};
+
+/** Counter-based engines use stream ids 2^61+id */
+template<class BijectionT>
+struct max_nested_streams<CounterEngine<BijectionT>> : std::integral_constant<uint64_t, counter_nested_stream_bit> {};
+
+/** @brief Index of the nested stream of a thread path, as a node of a tree with the given fanout.
+ *
+ * ids[0..depth) are the thread numbers of the path, each below fanout, and depth>1.  Paths of depth d get consecutive
+ * indices after those of depth d-1.  Throws ParallelRngManagerError unless the index is below num_streams.
+ */
+inline
+uint64_t nested_stream_index(const IdxT *ids, IdxT depth, uint64_t fanout, uint64_t num_streams)
+{
+    const uint64_t max_id = num_streams + fanout; //Bounds id before the fanout of the root is subtracted
+    uint64_t id = 0;
+    for(IdxT l=0; l<depth; l++) {
+        if(ids[l] >= fanout) throw ParallelRngManagerError("Nested thread ids exceed the nested team size limit.");
+        id = l ? (id+1)*fanout + ids[l] : ids[l];
+        if(id >= max_id || (l+1 < depth && id >= max_id/fanout))
+            throw ParallelRngManagerError("Nested parallel regions exceed the nested streams of this engine.");
+    }
+    return id - fanout;
+}
+
+/** Deepest nesting, up to max_depth, at which every thread path has a nested stream index below num_streams */
+inline
+IdxT max_nested_depth(uint64_t fanout, uint64_t num_streams, IdxT max_depth)
+{
+    //Paths of depth 2..d use fanout^2 + ... + fanout^d indices
+    uint64_t used = 0, level = fanout;
+    for(IdxT d=2; d<=max_depth; d++) {
+        if(level > num_streams / fanout) return d-1;
+        level *= fanout;
+        if(level > num_streams - used) return d-1;
+        used += level;
+    }
+    return max_depth;
+}
+
+/** @brief Make root, a freshly seeded engine, the nested thread stream with index id.
+ *
+ * TRNG engines jump to a disjoint block of nested_stream_length values in the second eighth of the StreamLayout.
+ * Counter-based engines use stream id 2^61+id.  See max_nested_streams.
+ */
+template<class RngT>
+void select_nested_stream(RngT &root, uint64_t id)
+{
+    using Layout = StreamLayout<RngT>;
+    if(id >= Layout::max_nested_streams) throw ParallelRngManagerError("select_nested_stream: stream id too large.");
+    root.jump(Layout::nested_stream_offset + id*Layout::nested_stream_length);
+}
+
+template<class BijectionT>
+void select_nested_stream(CounterEngine<BijectionT> &root, uint64_t id)
+{
+    if(id >= counter_nested_stream_bit) throw ParallelRngManagerError("select_nested_stream: stream id too large.");
+    root.set_stream(counter_nested_stream_bit | id);
+}
+
+/** @brief Make root, a freshly seeded engine, the stream of work item task.
+ *
+ * TRNG engines jump to a disjoint block of task_stream_length values in the second half of the StreamLayout, which
+ * allows 2^31 tasks for engines with a period of at least 2^64.  Counter-based engines use the stream id with the high
+ * bit set, and allow 2^63 tasks.
+ */
+template<class RngT>
+void select_task_stream(RngT &root, uint64_t task)
+{
+    using Layout = StreamLayout<RngT>;
+    if(task >= Layout::max_task_streams) throw ParallelRngManagerError("select_task_stream: task index too large.");
+    root.jump(Layout::task_stream_offset + task*Layout::task_stream_length);
+}
+
+template<class BijectionT>
+void select_task_stream(CounterEngine<BijectionT> &root, uint64_t task)
+{
+    if(task >= counter_task_stream_bit) throw ParallelRngManagerError("select_task_stream: task index too large.");
+    root.set_stream(counter_task_stream_bit | task);
+}
+
+template<class RngT=DefaultParallelRngT, class FloatT=double, class AllocT=aligned_array::AlignedAllocator>
 class ParallelRngManager
 {
 public:
     using VecT = arma::Col<FloatT>;
     using MatT = arma::Mat<FloatT>;
-    using NormalDistT = std::normal_distribution<FloatT>;
-    using UniformDistT = std::uniform_real_distribution<FloatT>;
+    using NormalDistT = ZigguratNormalDistribution<FloatT>;
+    using UniformDistT = UnitUniformDistribution<FloatT>;
+    using ExponentialDistT = ZigguratExponentialDistribution<FloatT>;
+    using GammaDistT = GammaDistribution<FloatT>;
+    using BetaDistT = BetaDistribution<FloatT>;
+    using DirichletDistT = DirichletDistribution<FloatT>;
+    using PoissonDistT = PoissonDistribution<IdxT>;
+    using BinomialDistT = BinomialDistribution<IdxT>;
+    using NegativeBinomialDistT = NegativeBinomialDistribution<IdxT>;
+    using CountMatT = arma::Mat<IdxT>;
     using result_type = typename RngT::result_type;
+    using allocator_type = AllocT;
+    using BulkRngT = LeapfrogEngine<RngT>;
+    /** Bulk calls with at least this many samples use a multi-lane BulkRngT.  Output is identical either way, and
+     * matches repeated scalar calls, except uniform fills with FloatT=float on 64-bit engines, which make two samples
+     * from each engine value where scalar randu() makes one.  Smaller calls cannot repay generating a whole block of
+     * lanes; see the fill_scalar and fill_leapfrog benchmarks.
+     */
+    static constexpr IdxT bulk_min_size = 2*BulkRngT::block_size;
+    /** Parallel fills with fewer than this many samples run on the calling thread.  Output is identical either way. */
+    static constexpr IdxT parallel_min_size = 1<<14;
+    /** Maximum number of nested teams with more than one thread that may enclose a sampling thread.  Engines may run
+     * out of nested streams sooner.  See max_nested_depth().
+     */
+    static constexpr IdxT max_thread_depth = 8;
+    /** Nested teams may have up to max(num_threads, min_nested_fanout) threads */
+    static constexpr IdxT min_nested_fanout = 64;
+    /** Count samplers with per-element parameters split their output into blocks of this many elements,
+     * each with its own sub-stream.  Output is identical for any number of threads.
+     */
+    static constexpr IdxT count_block_size = 1<<12;
+
+    /** @brief Direct handle to the calling thread's stream.
+     *
+     * Get one with local() once per thread, e.g., at the top of a parallel region.  A handle holds pointers to the
+     * thread's engine and distributions, so sampling through it skips the omp_get_thread_num() call and per-thread
+     * table lookups of the manager methods.  It must only be used by the thread that created it, and is invalidated
+     * by seed() and reset().
+     */
+    class StreamHandle
+    {
+    public:
+        RngT& generator() { return *gen; }
+        any_rng::AnyRng<result_type> generic_generator() { return any_rng::AnyRng<result_type>{*gen}; }
+        result_type operator()() { return (*gen)(); }
+
+        FloatT randu() { return (*uni)(*gen); }
+        FloatT randn() { return (*norm)(*gen); }
+        VecT randu(IdxT N) { VecT samp(N); fill_randu(samp); return samp; }
+        VecT randn(IdxT N) { VecT samp(N); fill_randn(samp); return samp; }
+        MatT randu(IdxT rows, IdxT cols) { MatT samp(rows, cols); fill_randu(samp); return samp; }
+        MatT randn(IdxT rows, IdxT cols) { MatT samp(rows, cols); fill_randn(samp); return samp; }
+
+        void fill_randu(MatT &samp) { fill_dist(*uni, *gen, samp.memptr(), samp.n_elem, 1, 1, 0); }
+        void fill_randu(arma::subview<FloatT> &samp) { fill_subview(*uni, *gen, samp); }
+        void fill_randu(arma::subview<FloatT> &&samp) { fill_randu(samp); }
+        void fill_randu(FloatT *samp, IdxT N, IdxT stride=1) { fill_dist(*uni, *gen, samp, N, 1, stride, 0); }
+        void fill_randn(MatT &samp) { fill_dist(*norm, *gen, samp.memptr(), samp.n_elem, 1, 1, 0); }
+        void fill_randn(arma::subview<FloatT> &samp) { fill_subview(*norm, *gen, samp); }
+        void fill_randn(arma::subview<FloatT> &&samp) { fill_randn(samp); }
+        void fill_randn(FloatT *samp, IdxT N, IdxT stride=1) { fill_dist(*norm, *gen, samp, N, 1, stride, 0); }
+
+        FloatT rande(FloatT lambda=1) { return ExponentialDistT(lambda)(*gen); }
+        FloatT randg(FloatT shape, FloatT scale=1) { return GammaDistT(shape, scale)(*gen); }
+        FloatT randbeta(FloatT a, FloatT b) { return BetaDistT(a, b)(*gen); }
+        VecT rande(FloatT lambda, IdxT N) { VecT samp(N); fill_rande(lambda, samp); return samp; }
+        VecT randg(FloatT shape, FloatT scale, IdxT N) { VecT samp(N); fill_randg(shape, scale, samp); return samp; }
+        VecT randbeta(FloatT a, FloatT b, IdxT N) { VecT samp(N); fill_randbeta(a, b, samp); return samp; }
+        MatT rande(FloatT lambda, IdxT rows, IdxT cols)
+        { MatT samp(rows, cols); fill_rande(lambda, samp); return samp; }
+        MatT randg(FloatT shape, FloatT scale, IdxT rows, IdxT cols)
+        { MatT samp(rows, cols); fill_randg(shape, scale, samp); return samp; }
+        MatT randbeta(FloatT a, FloatT b, IdxT rows, IdxT cols)
+        { MatT samp(rows, cols); fill_randbeta(a, b, samp); return samp; }
+
+        /* Per-element parameters.  Element n uses shapes(n), or a(n) and b(n). */
+        VecT randg(const VecT &shapes, FloatT scale=1)
+        { VecT samp(shapes.n_elem); fill_randg(shapes, scale, samp); return samp; }
+        VecT randbeta(const VecT &a, const VecT &b) { VecT samp(a.n_elem); fill_randbeta(a, b, samp); return samp; }
+
+        /* Dirichlet samples are columns, so randdirichlet(alpha, N) is alpha.n_elem x N */
+        VecT randdirichlet(const VecT &alpha) { VecT samp(alpha.n_elem); fill_randdirichlet(alpha, samp); return samp; }
+        MatT randdirichlet(const VecT &alpha, IdxT N)
+        { MatT samp(alpha.n_elem, N); fill_randdirichlet(alpha, samp); return samp; }
+
+        void fill_rande(FloatT lambda, MatT &samp)
+        {
+            ExponentialDistT dist(lambda);
+            fill_dist(dist, *gen, samp.memptr(), samp.n_elem, 1, 1, 0);
+        }
+
+        void fill_randg(FloatT shape, FloatT scale, MatT &samp)
+        {
+            GammaDistT dist(shape, scale);
+            fill_dist(dist, *gen, samp.memptr(), samp.n_elem, 1, 1, 0);
+        }
+
+        void fill_randbeta(FloatT a, FloatT b, MatT &samp)
+        {
+            BetaDistT dist(a, b);
+            fill_dist(dist, *gen, samp.memptr(), samp.n_elem, 1, 1, 0);
+        }
+
+        void fill_randg(const VecT &shapes, FloatT scale, MatT &samp)
+        {
+            if(shapes.n_elem != samp.n_elem) throw ParallelRngManagerError("fill_randg: shapes size does not match samp.");
+            fill_each([&](IdxT n) { return GammaDistT(shapes(n), scale); }, *gen, samp.memptr(), samp.n_elem);
+        }
+
+        void fill_randbeta(const VecT &a, const VecT &b, MatT &samp)
+        {
+            if(a.n_elem != samp.n_elem || b.n_elem != samp.n_elem)
+                throw ParallelRngManagerError("fill_randbeta: parameter sizes do not match samp.");
+            fill_each([&](IdxT n) { return BetaDistT(a(n), b(n)); }, *gen, samp.memptr(), samp.n_elem);
+        }
+
+        void fill_randdirichlet(const VecT &alpha, MatT &samp)
+        {
+            if(alpha.n_elem != samp.n_rows) throw ParallelRngManagerError("fill_randdirichlet: alpha size does not match samp rows.");
+            DirichletDistT dist(alpha);
+            fill_vectors(dist, *gen, samp.memptr(), samp.n_rows, samp.n_cols);
+        }
+
+        IdxT randp(FloatT mean) { return PoissonDistT(mean)(*gen); }
+        IdxT randbinom(IdxT trials, FloatT p) { return BinomialDistT(trials, p)(*gen); }
+        IdxT randnbinom(FloatT size, FloatT mean) { return NegativeBinomialDistT(size, mean)(*gen); }
+
+        /* Counts with per-element parameters, in a matrix the same shape as the parameters.  Each block of
+         * count_block_size elements reads its own sub-stream, so for more than count_block_size elements the output
+         * differs from repeated scalar draws.  Output may be an integer or floating point matrix.
+         */
+        CountMatT randp(const MatT &means) { CountMatT samp(means.n_rows, means.n_cols); fill_randp(means, samp); return samp; }
+        CountMatT randbinom(IdxT trials, const MatT &probs)
+        { CountMatT samp(probs.n_rows, probs.n_cols); fill_randbinom(trials, probs, samp); return samp; }
+        CountMatT randnbinom(FloatT size, const MatT &means)
+        { CountMatT samp(means.n_rows, means.n_cols); fill_randnbinom(size, means, samp); return samp; }
+
+        template<class OutT>
+        void fill_randp(const MatT &means, arma::Mat<OutT> &samp)
+        {
+            check_count_shape(means, samp);
+            fill_counts([&](IdxT n) { return PoissonDistT(means(n)); }, *gen, samp.memptr(), samp.n_elem, false);
+        }
+
+        template<class OutT>
+        void fill_randbinom(IdxT trials, const MatT &probs, arma::Mat<OutT> &samp)
+        {
+            check_count_shape(probs, samp);
+            fill_counts([&](IdxT n) { return BinomialDistT(trials, probs(n)); }, *gen, samp.memptr(), samp.n_elem, false);
+        }
+
+        template<class OutT>
+        void fill_randnbinom(FloatT size, const MatT &means, arma::Mat<OutT> &samp)
+        {
+            check_count_shape(means, samp);
+            fill_counts([&](IdxT n) { return NegativeBinomialDistT(size, means(n)); }, *gen, samp.memptr(), samp.n_elem,
+                        false);
+        }
+
+        /* Permutations.  Large arrays use a parallel scatter shuffle, whose output does not depend on the number
+         * of threads.
+         */
+        arma::Col<IdxT> randperm(IdxT N) { arma::Col<IdxT> perm(N); fill_randperm(*gen, perm); return perm; }
+        template<class T>
+        void shuffle(arma::Col<T> &v) { shuffle_array(*gen, v); }
+        /** k distinct indices from [0,N) in random order */
+        arma::Col<IdxT> sample_without_replacement(IdxT N, IdxT k)
+        { arma::Col<IdxT> samp(k); sample_distinct(*gen, N, samp); return samp; }
+
+        /* Bootstrap replicates as the columns of an N x B matrix.  Replicate b reads sub-stream b of B, so the
+         * output is identical to the manager's bootstrap_*_parallel() forms.
+         */
+        CountMatT bootstrap_indices(IdxT N, IdxT B) { CountMatT samp(N, B); fill_bootstrap_indices(samp); return samp; }
+        CountMatT bootstrap_counts(BootstrapScheme scheme, IdxT N, IdxT B)
+        { CountMatT samp(N, B); fill_bootstrap_counts(scheme, samp); return samp; }
+
+        template<class OutT>
+        void fill_bootstrap_indices(arma::Mat<OutT> &samp)
+        {
+            fill_replicates([](BulkRngT &lanes, OutT *col, IdxT N) { bootstrap::indices(col, N, lanes); },
+                            *gen, samp, samp.n_rows ? samp.n_rows-1 : 0, false);
+        }
+
+        template<class OutT>
+        void fill_bootstrap_counts(BootstrapScheme scheme, arma::Mat<OutT> &samp)
+        {
+            fill_replicates([=](BulkRngT &lanes, OutT *col, IdxT N) { bootstrap::counts(scheme, col, N, lanes); },
+                            *gen, samp, samp.n_rows, false);
+        }
+
+        template<class Weights=VecT,class IdxT=IdxT>
+        IdxT resample_dist(const Weights &weights)
+        {
+            typename DiscreteDist<Weights,IdxT>::type dist = DiscreteDist<Weights,IdxT>::make(weights);
+            return dist(*gen);
+        }
+
+        template<class Weights=VecT,class IdxT=IdxT>
+        arma::Col<IdxT> resample_dist(const Weights &weights, IdxT N)
+        {
+            arma::Col<IdxT> samp(N);
+            fill_resample(weights, samp);
+            return samp;
+        }
+
+        template<class Weights=VecT,class IdxT=IdxT>
+        void fill_resample(const Weights &weights, arma::Mat<IdxT> &samp)
+        { fill_resample<Weights,IdxT>(weights, samp.memptr(), samp.n_elem); }
+
+        template<class Weights=VecT,class IdxT=IdxT>
+        void fill_resample(const Weights &weights, IdxT *samp, IdxT N, IdxT stride=1)
+        {
+            typename DiscreteDist<Weights,IdxT>::type dist = DiscreteDist<Weights,IdxT>::make(weights);
+            fill_dist(dist, *gen, samp, N, 1, stride, 0);
+        }
+
+    protected:
+        friend class ParallelRngManager;
+        StreamHandle(RngT *gen_, UniformDistT *uni_, NormalDistT *norm_) : gen{gen_}, uni{uni_}, norm{norm_} {}
+
+    private:
+        RngT *gen;
+        UniformDistT *uni;
+        NormalDistT *norm;
+    };
+
+    /** @brief Stream owned by a logical work item, with the same sampling API as StreamHandle.
+     *
+     * Created by stream_for(i).  The stream depends only on the seed and i, so any thread may process item i,
+     * under any schedule, with bit-identical results.
+     */
+    class TaskStream : public StreamHandle
+    {
+    public:
+        TaskStream(const TaskStream &o) : StreamHandle{&task_gen, &task_uni, &task_norm},
+            task_gen(o.task_gen), task_uni(o.task_uni), task_norm(o.task_norm) {}
+
+        TaskStream& operator=(const TaskStream &o)
+        {
+            task_gen = o.task_gen;
+            task_uni = o.task_uni;
+            task_norm = o.task_norm;
+            return *this;
+        }
+
+    private:
+        friend class ParallelRngManager;
+        explicit TaskStream(const RngT &gen_) : StreamHandle{&task_gen, &task_uni, &task_norm}, task_gen(gen_) {}
+
+        RngT task_gen;
+        UniformDistT task_uni;
+        NormalDistT task_norm;
+    };
 
     ParallelRngManager();
     ParallelRngManager(SeedT seed);
     ParallelRngManager(SeedT seed, IdxT max_threads);
+    ParallelRngManager(SeedT seed, IdxT max_threads, StreamPlacement placement);
+    ParallelRngManager(SeedT seed, IdxT max_threads, StreamPlacement placement, const AllocT &alloc);
 
     //Allow copying although it will be expensive
     //This can be useful. e.g., testing.
-//     ParallelRngManager(const ParallelRngManager<RngT,FloatT> &) = default;
-//     ParallelRngManager& operator=(const ParallelRngManager<RngT,FloatT> &) = default;
+//     ParallelRngManager(const ParallelRngManager<RngT,FloatT,AllocT> &) = default;
+//     ParallelRngManager& operator=(const ParallelRngManager<RngT,FloatT,AllocT> &) = default;
 //     
-//     ParallelRngManager(ParallelRngManager<RngT,FloatT> &&) = default;
-//     ParallelRngManager& operator=(ParallelRngManager<RngT,FloatT> &&) = default;
+//     ParallelRngManager(ParallelRngManager<RngT,FloatT,AllocT> &&) = default;
+//     ParallelRngManager& operator=(ParallelRngManager<RngT,FloatT,AllocT> &&) = default;
     
     void seed(SeedT seed);
     void reset();
@@ -104,9 +581,47 @@ public:
     void reset(SeedT seed, IdxT max_threads);
     SeedT get_init_seed() const;
     SeedT get_num_threads() const;
+    /** Deepest nesting of teams with more than one thread at which every thread has a stream.  At most
+     * max_thread_depth.  Deeper threads may still have streams, but throw ParallelRngManagerError once the engine's
+     * nested streams run out.
+     */
+    IdxT max_nested_depth() const;
+
+    /* NUMA placement.  With StreamPlacement::NumaLocal each thread's stream state is on its own pages on the thread's
+     * node.  materialize_streams() builds the streams of every thread of a new OpenMP team on that thread, so placement
+     * is done before sampling.  Call it from serial code, after numa::pin_openmp_threads() if threads are not bound.
+     * Samples are identical for any placement.
+     */
+    StreamPlacement stream_placement() const { return placement; }
+    void materialize_streams();
+
+    /* Memory.  Per-thread stream state and the scratch buffers of bulk samplers come from the AllocT allocation
+     * policy, e.g., aligned_array::HugePageAllocator, or aligned_array::ArenaAllocator to keep all RNG state in a
+     * preallocated arena.  Returned armadillo objects use armadillo's allocator, so to sample into policy memory use
+     * the pointer overloads, e.g., fill_randu(samp, N).
+     */
+    allocator_type get_allocator() const { return alloc; }
+
+    /* Checkpointing.  Save or restore the exact state of every stream, so a restored manager continues bit-identically.
+     * Must be called from serial code.
+     */
+    void save_checkpoint(std::ostream &out) const;
+    void save_checkpoint(const std::string &filename) const;
+    void load_checkpoint(std::istream &in);
+    void load_checkpoint(const std::string &filename); // Reads from a memory mapped file
+    void load_checkpoint(const char *buf, std::size_t size);
+
+    /* Instrumentation.  Per-thread counters of the main sampling APIs when compiled with PARALLEL_RNG_INSTRUMENT,
+     * otherwise the snapshot is empty.  Counters are kept with the streams, so seed() and reset() clear them.  Must be
+     * called from serial code.
+     */
+    instrument::Snapshot instrument_snapshot() const;
+    void instrument_reset();
         
+    StreamHandle local(); // Handle to the calling thread's stream for use in tight loops
+    TaskStream stream_for(uint64_t task) const; // Stream keyed by work item, independent of thread and schedule
     RngT& generator();
-    any_rng::AnyRng<result_type> generic_generator(); // Make type-erased gernerator-like object with a reference.
+    any_rng::AnyRng<result_type> generic_generator(); // Type-erased reference to generator().  Never allocates.
     result_type operator()();
         
     FloatT randu();
@@ -116,27 +631,278 @@ public:
     MatT randu(IdxT rows, IdxT cols);
     MatT randn(IdxT rows, IdxT cols);
 
+    /* Exponential, gamma, and beta variates.  Gamma has shape and scale parameters. */
+    FloatT rande(FloatT lambda=1);
+    FloatT randg(FloatT shape, FloatT scale=1);
+    FloatT randbeta(FloatT a, FloatT b);
+    VecT rande(FloatT lambda, IdxT N);
+    VecT randg(FloatT shape, FloatT scale, IdxT N);
+    VecT randbeta(FloatT a, FloatT b, IdxT N);
+    MatT rande(FloatT lambda, IdxT rows, IdxT cols);
+    MatT randg(FloatT shape, FloatT scale, IdxT rows, IdxT cols);
+    MatT randbeta(FloatT a, FloatT b, IdxT rows, IdxT cols);
+    VecT randg(const VecT &shapes, FloatT scale=1); // Element n has shape shapes(n)
+    VecT randbeta(const VecT &a, const VecT &b); // Element n has parameters a(n), b(n)
+    VecT randdirichlet(const VecT &alpha);
+    MatT randdirichlet(const VecT &alpha, IdxT N); // N samples as columns
+
+    /* Poisson, binomial, and negative binomial counts.  Matrix forms take per-element parameters and return a matrix
+     * of the same shape.  Fills may write an integer or floating point matrix.
+     */
+    IdxT randp(FloatT mean);
+    IdxT randbinom(IdxT trials, FloatT p);
+    IdxT randnbinom(FloatT size, FloatT mean);
+    CountMatT randp(const MatT &means);
+    CountMatT randbinom(IdxT trials, const MatT &probs);
+    CountMatT randnbinom(FloatT size, const MatT &means);
+
+    /* Random permutations and sampling without replacement.  Large arrays are shuffled in parallel, with output
+     * that depends only on the calling thread's stream, not the number of threads.
+     */
+    arma::Col<IdxT> randperm(IdxT N);
+    template<class T>
+    void shuffle(arma::Col<T> &v);
+    arma::Col<IdxT> sample_without_replacement(IdxT N, IdxT k); // k distinct indices from [0,N) in random order
+
+    /* Bootstrap replicates of N observations as the B columns of an N x B matrix.  bootstrap_indices() draws N indices
+     * into [0,N) with replacement for each replicate, and bootstrap_counts() gives the number of times each observation
+     * is drawn.  Replicate b reads sub-stream b of B of the calling thread's stream.
+     */
+    CountMatT bootstrap_indices(IdxT N, IdxT B);
+    CountMatT bootstrap_counts(BootstrapScheme scheme, IdxT N, IdxT B);
+
+    /* Categorical sampling.  Weights is any container of weights, or a prebuilt DiscreteSampler for O(1) draws. */
     template<class Weights=VecT,class IdxT=IdxT>
     IdxT resample_dist(const Weights &weights);
     
     template<class Weights=VecT,class IdxT=IdxT>
     arma::Col<IdxT> resample_dist(const Weights &weights, IdxT N);
-    
+
+    /* In-place fills.  Write directly into caller-owned storage in storage order without temporaries. */
+    void fill_randu(MatT &samp);
+    void fill_randu(arma::subview<FloatT> &samp);
+    void fill_randu(arma::subview<FloatT> &&samp);
+    void fill_randu(FloatT *samp, IdxT N, IdxT stride=1);
+    void fill_randn(MatT &samp);
+    void fill_randn(arma::subview<FloatT> &samp);
+    void fill_randn(arma::subview<FloatT> &&samp);
+    void fill_randn(FloatT *samp, IdxT N, IdxT stride=1);
+    void fill_rande(FloatT lambda, MatT &samp);
+    void fill_randg(FloatT shape, FloatT scale, MatT &samp);
+    void fill_randg(const VecT &shapes, FloatT scale, MatT &samp);
+    void fill_randbeta(FloatT a, FloatT b, MatT &samp);
+    void fill_randbeta(const VecT &a, const VecT &b, MatT &samp);
+    void fill_randdirichlet(const VecT &alpha, MatT &samp);
+
+    template<class OutT>
+    void fill_randp(const MatT &means, arma::Mat<OutT> &samp);
+    template<class OutT>
+    void fill_randbinom(IdxT trials, const MatT &probs, arma::Mat<OutT> &samp);
+    template<class OutT>
+    void fill_randnbinom(FloatT size, const MatT &means, arma::Mat<OutT> &samp);
+    template<class OutT>
+    void fill_bootstrap_indices(arma::Mat<OutT> &samp);
+    template<class OutT>
+    void fill_bootstrap_counts(BootstrapScheme scheme, arma::Mat<OutT> &samp);
+
+    template<class Weights=VecT,class IdxT=IdxT>
+    void fill_resample(const Weights &weights, arma::Mat<IdxT> &samp);
+
+    template<class Weights=VecT,class IdxT=IdxT>
+    void fill_resample(const Weights &weights, IdxT *samp, IdxT N, IdxT stride=1);
+
+    /* Low-variance particle filter resampling in O(N+K).  resample() returns N sorted ancestor indices, and
+     * resample_counts() returns the offspring count of each of the K weights.
+     */
+    template<class Weights=VecT,class IdxT=IdxT>
+    arma::Col<IdxT> resample(ResampleScheme scheme, const Weights &weights, IdxT N);
+
+    template<class Weights=VecT,class IdxT=IdxT>
+    arma::Col<IdxT> resample_counts(ResampleScheme scheme, const Weights &weights, IdxT N);
+
+    /* Parallel fills.  Split samp into contiguous blocks over a new OpenMP team.  Each block jumps the calling thread's
+     * stream to its exact offset so the output is bit-identical for any number of threads.  Call from serial code.
+     * The uniform forms are identical to randu(rows,cols) and fill_randu(samp).  The normal forms use a Box-Muller
+     * transform, so they do not match randn(rows,cols) or fill_randn(samp).
+     */
+    MatT randu_parallel(IdxT rows, IdxT cols);
+    MatT randn_parallel(IdxT rows, IdxT cols);
+    void fill_randu_parallel(MatT &samp);
+    void fill_randn_parallel(MatT &samp);
+
+    /* Parallel count fills.  Identical to the serial forms for any number of threads.  Call from serial code. */
+    CountMatT randp_parallel(const MatT &means);
+    CountMatT randbinom_parallel(IdxT trials, const MatT &probs);
+    CountMatT randnbinom_parallel(FloatT size, const MatT &means);
+    template<class OutT>
+    void fill_randp_parallel(const MatT &means, arma::Mat<OutT> &samp);
+    template<class OutT>
+    void fill_randbinom_parallel(IdxT trials, const MatT &probs, arma::Mat<OutT> &samp);
+    template<class OutT>
+    void fill_randnbinom_parallel(FloatT size, const MatT &means, arma::Mat<OutT> &samp);
+
+    /* Parallel bootstrap over replicates.  Identical to the serial forms for any number of threads.  Call from serial
+     * code.
+     */
+    CountMatT bootstrap_indices_parallel(IdxT N, IdxT B);
+    CountMatT bootstrap_counts_parallel(BootstrapScheme scheme, IdxT N, IdxT B);
+    template<class OutT>
+    void fill_bootstrap_indices_parallel(arma::Mat<OutT> &samp);
+    template<class OutT>
+    void fill_bootstrap_counts_parallel(BootstrapScheme scheme, arma::Mat<OutT> &samp);
+
+    /* Parallel resampling.  The cumulative weight scan and the point search are split over a new OpenMP team.
+     * Identical to resample() and resample_counts() for any number of threads.  Call from serial code.
+     */
+    template<class Weights=VecT,class IdxT=IdxT>
+    arma::Col<IdxT> resample_parallel(ResampleScheme scheme, const Weights &weights, IdxT N);
+
+    template<class Weights=VecT,class IdxT=IdxT>
+    arma::Col<IdxT> resample_counts_parallel(ResampleScheme scheme, const Weights &weights, IdxT N);
+
 private:
-    void split_rngs();
+    //Position of a thread in the hierarchy of enclosing teams, and the key of its stream state
+    struct ThreadPath
+    {
+        IdxT key;
+        IdxT depth;
+        std::array<IdxT,max_thread_depth> ids;
+    };
+
+    /** All state of one stream key in one cache-aligned slot.  The engine comes first, so scalar sampling from an
+     * engine smaller than a cache line touches a single line.
+     */
+    struct ThreadState
+    {
+        RngT rng;
+        UniformDistT uni;
+        NormalDistT norm;
+#ifdef PARALLEL_RNG_INSTRUMENT
+        instrument::ThreadCounters counters;
+#endif
+        explicit ThreadState(const RngT &rng_) : rng(rng_) {}
+    };
+
+    ThreadPath thread_path();
+    ThreadPath nested_thread_path(int level);
+    uint64_t nested_fanout() const { return std::max(num_threads, min_nested_fanout); }
+    RngT make_thread_stream(const ThreadPath &path);
+    ThreadState& thread_state(const ThreadPath &path);
+    RngT& thread_generator(const ThreadPath &path);
+    UniformDistT& thread_uniform(const ThreadPath &path);
+    NormalDistT& thread_normal(const ThreadPath &path);
+#ifdef PARALLEL_RNG_INSTRUMENT
+    instrument::ThreadCounters& thread_counters();
+#endif
+
+    template<class DistT, class OutT>
+    static void fill_dist(DistT &dist, RngT &gen, OutT *out, IdxT inner_n, IdxT outer_n,
+                          IdxT inner_stride, IdxT outer_stride);
+
+    template<class DistT, class GenT, class OutT>
+    static void fill_strided(DistT &dist, GenT &gen, OutT *out, IdxT inner_n, IdxT outer_n,
+                             IdxT inner_stride, IdxT outer_stride);
+
+    template<class GenT>
+    static void fill_strided(UniformDistT &dist, GenT &gen, FloatT *out, IdxT inner_n, IdxT outer_n,
+                             IdxT inner_stride, IdxT outer_stride);
+
+    template<class DistT>
+    static void fill_subview(DistT &dist, RngT &gen, arma::subview<FloatT> &samp);
+
+    template<class MakeDistT>
+    static void fill_each(MakeDistT make, RngT &gen, FloatT *out, IdxT N);
+
+    template<class MakeDistT, class GenT>
+    static void fill_each_impl(MakeDistT &make, GenT &gen, FloatT *out, IdxT N);
+
+    template<class DistT>
+    static void fill_vectors(DistT &dist, RngT &gen, FloatT *out, IdxT K, IdxT N);
+
+    template<class MakeDistT, class OutT>
+    static void fill_counts(MakeDistT make, RngT &gen, OutT *out, IdxT N, bool parallel);
+
+    template<class OutT>
+    static void check_count_shape(const MatT &params, const arma::Mat<OutT> &samp);
+
+    static void fill_randperm(RngT &gen, arma::Col<IdxT> &perm);
+    template<class T>
+    static void shuffle_array(RngT &gen, arma::Col<T> &v);
+    static void sample_distinct(RngT &gen, IdxT N, arma::Col<IdxT> &samp);
+
+    template<class ReplicateFunc, class OutT>
+    static void fill_replicates(ReplicateFunc replicate, RngT &gen, arma::Mat<OutT> &samp, IdxT max_value,
+                                bool parallel);
+
+    //Categorical distribution for resample_dist.  A std::discrete_distribution from weights, or a DiscreteSampler reference.
+    template<class Weights, class IdxT>
+    struct DiscreteDist
+    {
+        using type = std::discrete_distribution<IdxT>;
+        static type make(const Weights &weights) { return type(weights.begin(),weights.end()); }
+    };
+
+    template<class SamplerIdxT, class IdxT>
+    struct DiscreteDist<DiscreteSampler<SamplerIdxT>,IdxT>
+    {
+        using type = const DiscreteSampler<SamplerIdxT>&;
+        static type make(const DiscreteSampler<SamplerIdxT> &sampler) { return sampler; }
+    };
+
+    /** Scratch buffer with memory from the allocation policy */
+    template<class T>
+    using BufferT = std::vector<T, aligned_array::PolicyAllocator<T,AllocT>>;
+
+    /** Engine values consumed by each UniformDistT sample */
+    static constexpr IdxT uniform_draws = UniformDistT::template draws_per_sample<RngT>();
+
+    template<class BlockFunc>
+    void parallel_stream_blocks(IdxT N, IdxT draws, bool parallel, BlockFunc block);
+
+    template<class Weights, class IdxT>
+    void resample_counts_impl(ResampleScheme scheme, const Weights &weights, IdxT N, arma::Col<IdxT> &counts,
+                              bool parallel);
+
+    template<class IdxT>
+    void sorted_uniform_indices(const std::vector<double> &C, IdxT N, IdxT *idx, bool parallel);
+
+    template<class GenT>
+    static void fill_normal_pairs(UniformDistT &uniform, GenT &gen, FloatT *out, IdxT begin, IdxT end, IdxT N);
+
     SeedT init_seed;
     IdxT num_threads;
     std::size_t cache_alignment;
+    StreamPlacement placement;
     std::function<SeedT()> seeder;
 
-    aligned_array::AArray<RngT> rngs;
-    //std::normal_distribution implementations are not thread safe.  Use per-thread distributions
-    aligned_array::AArray<NormalDistT> norm_dist;
-    //Note.  Most implementations of std::uniform_real_distribution should be thread safe.
-    //But without a cross-platform guarantee we use per-thread uniform_real_distribution
-    aligned_array::AArray<UniformDistT> uni_dist;
+    //Per-thread state is materialized on first use by each thread id, so only threads that sample pay for it.
+    //The distributions are per-thread so that the layout does not depend on whether they carry state.
+    AllocT alloc;
+    StreamTable<ThreadState,AllocT> thread_states;
+    //Keys of streams for nested teams and thread ids beyond num_threads.  Others use their thread id as a key.
+    StreamPathIndex path_index;
+    //Freshly seeded root stream from which stream_for() derives task streams
+    RngT task_root;
 };
 
+template<class RngT, class FloatT, class AllocT>
+constexpr IdxT ParallelRngManager<RngT,FloatT,AllocT>::bulk_min_size;
+
+template<class RngT, class FloatT, class AllocT>
+constexpr IdxT ParallelRngManager<RngT,FloatT,AllocT>::parallel_min_size;
+
+template<class RngT, class FloatT, class AllocT>
+constexpr IdxT ParallelRngManager<RngT,FloatT,AllocT>::max_thread_depth;
+
+template<class RngT, class FloatT, class AllocT>
+constexpr IdxT ParallelRngManager<RngT,FloatT,AllocT>::min_nested_fanout;
+
+template<class RngT, class FloatT, class AllocT>
+constexpr IdxT ParallelRngManager<RngT,FloatT,AllocT>::uniform_draws;
+
+template<class RngT, class FloatT, class AllocT>
+constexpr IdxT ParallelRngManager<RngT,FloatT,AllocT>::count_block_size;
+
 /* Factory functions */
 
 template<class RngT=DefaultParallelRngT, class FloatT=double>
@@ -153,37 +919,164 @@ ParallelRngManager<RngT,FloatT> make_parallel_rng_manager(SeedT seed)
 
 /* Template class methods */
 
-template<class RngT, class FloatT>
-ParallelRngManager<RngT,FloatT>::ParallelRngManager() : 
+template<class RngT, class FloatT, class AllocT>
+ParallelRngManager<RngT,FloatT,AllocT>::ParallelRngManager() : 
     ParallelRngManager(generate_seed(), openmp_estimate_max_threads())
 {}
 
-template<class RngT, class FloatT>
-ParallelRngManager<RngT,FloatT>::ParallelRngManager(SeedT seed_) : 
+template<class RngT, class FloatT, class AllocT>
+ParallelRngManager<RngT,FloatT,AllocT>::ParallelRngManager(SeedT seed_) : 
     ParallelRngManager(seed_, openmp_estimate_max_threads())
 {}
 
-template<class RngT, class FloatT>
-ParallelRngManager<RngT,FloatT>::ParallelRngManager(SeedT seed_, IdxT num_threads_) : 
+template<class RngT, class FloatT, class AllocT>
+ParallelRngManager<RngT,FloatT,AllocT>::ParallelRngManager(SeedT seed_, IdxT num_threads_) : 
+    ParallelRngManager(seed_, num_threads_, StreamPlacement::Cache)
+{}
+
+template<class RngT, class FloatT, class AllocT>
+ParallelRngManager<RngT,FloatT,AllocT>::ParallelRngManager(SeedT seed_, IdxT num_threads_, StreamPlacement placement_) :
+    ParallelRngManager(seed_, num_threads_, placement_, AllocT())
+{}
+
+template<class RngT, class FloatT, class AllocT>
+ParallelRngManager<RngT,FloatT,AllocT>::ParallelRngManager(SeedT seed_, IdxT num_threads_, StreamPlacement placement_,
+                                                           const AllocT &alloc_) :
     init_seed(seed_),
     num_threads(num_threads_),
     cache_alignment{aligned_array::alignment::estimate_cache_alignment()},
+    placement{placement_},
     seeder{[seed_](){return seed_;}},
-    rngs{num_threads,cache_alignment, RngT{seeder}},
-    norm_dist{num_threads,cache_alignment, NormalDistT{}},
-    uni_dist{num_threads,cache_alignment, UniformDistT{}}
+    alloc(alloc_),
+    thread_states{num_threads,cache_alignment,placement,alloc},
+    path_index{num_threads,cache_alignment},
+    task_root{seeder}
+{ }
+
+/** @brief Path and stream key of the calling thread.
+ *
+ * Outside of nested parallelism a thread is identified by omp_get_thread_num(), which is also its key.
+ */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::ThreadPath
+ParallelRngManager<RngT,FloatT,AllocT>::thread_path()
 {
-    split_rngs();
+    int level = omp_get_level();
+    if(level <= 1) {
+        IdxT id = omp_get_thread_num();
+        if(id < num_threads) return ThreadPath{id, 1, {{id}}};
+    }
+    return nested_thread_path(level);
 }
 
-template<class RngT, class FloatT>
-void ParallelRngManager<RngT,FloatT>::split_rngs()
+/** @brief Path of the calling thread through level nested teams.
+ *
+ * The path lists omp_get_ancestor_thread_num() for each enclosing team with more than one thread.  Trailing zeros are
+ * dropped, as the master of an inner team is the same thread that forked it, and should keep its stream.  A team of
+ * one thread, e.g., an inactive nested region, likewise keeps the stream of the thread that created it.
+ */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::ThreadPath
+ParallelRngManager<RngT,FloatT,AllocT>::nested_thread_path(int level)
 {
-    for(IdxT n=0; n<rngs.size(); n++) rngs[n].split(num_threads,n);
+    ThreadPath path{0, 0, {{0}}};
+    for(int l=1; l<=level; l++) {
+        if(omp_get_team_size(l) <= 1) continue;
+        if(path.depth == max_thread_depth) throw ParallelRngManagerError("Parallel regions nested too deeply.");
+        path.ids[path.depth++] = omp_get_ancestor_thread_num(l);
+    }
+    while(path.depth > 1 && path.ids[path.depth-1] == 0) path.depth--;
+    if(path.depth == 0) path.depth = 1;
+    if(path.depth == 1 && path.ids[0] < num_threads) path.key = path.ids[0];
+    else path.key = path_index.key(path.ids.data(), path.depth);
+    return path;
 }
 
-template<class RngT, class FloatT>
-void ParallelRngManager<RngT,FloatT>::seed(SeedT seed_)
+/** @brief Stream for a thread path, built on its first use.
+ *
+ * Thread ids n below num_threads get the n-th of num_threads split streams, exactly as if all streams were split
+ * up front.  Larger ids, e.g., from a team bigger than the estimated maximum, get a disjoint overflow stream.  Threads
+ * of nested teams get a disjoint nested stream numbered by their path as a node of a tree with fanout
+ * max(num_threads, min_nested_fanout), so the stream depends only on the path and not on the order of first use.
+ */
+template<class RngT, class FloatT, class AllocT>
+RngT ParallelRngManager<RngT,FloatT,AllocT>::make_thread_stream(const ThreadPath &path)
+{
+    RngT rng{seeder};
+    IdxT n = path.ids[0];
+    if(path.depth == 1) {
+        if(n < num_threads) split_thread_stream(rng, num_threads, n);
+        else select_overflow_stream(rng, num_threads, n);
+        return rng;
+    }
+    select_nested_stream(rng, nested_stream_index(path.ids.data(), path.depth, nested_fanout(),
+                                                  max_nested_streams<RngT>::value));
+    return rng;
+}
+
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::ThreadState&
+ParallelRngManager<RngT,FloatT,AllocT>::thread_state(const ThreadPath &path)
+{
+    return thread_states.get(path.key, [&](IdxT) { return ThreadState{make_thread_stream(path)}; });
+}
+
+template<class RngT, class FloatT, class AllocT>
+RngT& ParallelRngManager<RngT,FloatT,AllocT>::thread_generator(const ThreadPath &path)
+{
+    return thread_state(path).rng;
+}
+
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::UniformDistT&
+ParallelRngManager<RngT,FloatT,AllocT>::thread_uniform(const ThreadPath &path)
+{
+    return thread_state(path).uni;
+}
+
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::NormalDistT&
+ParallelRngManager<RngT,FloatT,AllocT>::thread_normal(const ThreadPath &path)
+{
+    return thread_state(path).norm;
+}
+
+#ifdef PARALLEL_RNG_INSTRUMENT
+template<class RngT, class FloatT, class AllocT>
+instrument::ThreadCounters& ParallelRngManager<RngT,FloatT,AllocT>::thread_counters()
+{
+    return thread_state(thread_path()).counters;
+}
+#endif
+
+/** Counters of each stream with at least one instrumented call */
+template<class RngT, class FloatT, class AllocT>
+instrument::Snapshot ParallelRngManager<RngT,FloatT,AllocT>::instrument_snapshot() const
+{
+    instrument::Snapshot snapshot;
+#ifdef PARALLEL_RNG_INSTRUMENT
+    thread_states.for_each([&](IdxT key, const ThreadState &state) {
+        for(auto &c: state.counters.api) {
+            if(!c.calls) continue;
+            snapshot.keys.push_back(key);
+            snapshot.threads.push_back(state.counters);
+            return;
+        }
+    });
+#endif
+    return snapshot;
+}
+
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::instrument_reset()
+{
+#ifdef PARALLEL_RNG_INSTRUMENT
+    thread_states.for_each([](IdxT, ThreadState &state) { state.counters = instrument::ThreadCounters{}; });
+#endif
+}
+
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::seed(SeedT seed_)
 {
     //trng does not easily allow reseeding of split parallel_rng streams.  The
     // .split() function in general changes internal state and repeated calls are invalid.
@@ -192,158 +1085,1188 @@ void ParallelRngManager<RngT,FloatT>::seed(SeedT seed_)
     reset(seed_, num_threads);
 }
 
-template<class RngT, class FloatT>
-void ParallelRngManager<RngT,FloatT>::reset()
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::reset()
 {
     reset(init_seed, num_threads);
 }
 
-template<class RngT, class FloatT>
-void ParallelRngManager<RngT,FloatT>::reset(SeedT seed_)
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::reset(SeedT seed_)
 {
     reset(seed_, num_threads);
 }
 
-template<class RngT, class FloatT>
-void ParallelRngManager<RngT,FloatT>::reset(SeedT seed_, IdxT num_threads_)
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::reset(SeedT seed_, IdxT num_threads_)
 {
     num_threads = num_threads_;
-    rngs.clear();
-    uni_dist.clear();
-    norm_dist.clear();
     seeder = [seed_](){return seed_;}; //change the seeder lambda to reflect new seed.
-    rngs.fill(seeder);
-    uni_dist.fill();
-    norm_dist.fill();
-    split_rngs();
+    //Streams are rebuilt lazily from the new seeder on their next use
+    thread_states = StreamTable<ThreadState,AllocT>{num_threads, cache_alignment, placement, alloc};
+    path_index = StreamPathIndex{num_threads, cache_alignment};
+    task_root = RngT{seeder};
     init_seed = seed_;
 }
 
-template<class RngT, class FloatT>
-SeedT ParallelRngManager<RngT,FloatT>::get_init_seed() const 
+template<class RngT, class FloatT, class AllocT>
+SeedT ParallelRngManager<RngT,FloatT,AllocT>::get_init_seed() const 
 {
     return init_seed;
 }
 
-template<class RngT, class FloatT>
-SeedT ParallelRngManager<RngT,FloatT>::get_num_threads() const 
+template<class RngT, class FloatT, class AllocT>
+IdxT ParallelRngManager<RngT,FloatT,AllocT>::max_nested_depth() const
+{
+    return parallel_rng::max_nested_depth(nested_fanout(), max_nested_streams<RngT>::value, max_thread_depth);
+}
+
+template<class RngT, class FloatT, class AllocT>
+SeedT ParallelRngManager<RngT,FloatT,AllocT>::get_num_threads() const 
 {
     return num_threads;
 }
 
-template<class RngT, class FloatT>
-RngT& ParallelRngManager<RngT,FloatT>::generator()
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::materialize_streams()
 {
-    auto id = omp_get_thread_num();
-    return rngs[id];
+    #pragma omp parallel
+    local();
 }
 
-template<class RngT, class FloatT>
-any_rng::AnyRng<typename ParallelRngManager<RngT,FloatT>::result_type>
-ParallelRngManager<RngT,FloatT>::generic_generator()
+/** @brief Write a binary checkpoint of the manager state to out.
+ *
+ * Only streams that have been used are stored.  The others are rebuilt from the seed on restore, as they would have
+ * been on first use.  The per-thread distributions carry no state and are not stored.
+ */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::save_checkpoint(std::ostream &out) const
+{
+    std::vector<checkpoint::StreamRecord> records;
+    std::string states;
+    auto add_stream = [&](const IdxT *ids, IdxT depth, IdxT key) {
+        const ThreadState *thread = thread_states.find(key);
+        if(!thread) return;
+        checkpoint::StreamRecord rec{};
+        rec.depth = depth;
+        for(IdxT l=0; l<depth; l++) rec.ids[l] = ids[l];
+        std::ostringstream state;
+        state << thread->rng;
+        rec.state_offset = states.size();
+        rec.state_size = state.str().size();
+        states += state.str();
+        records.push_back(rec);
+    };
+    thread_states.for_each([&](IdxT key, const ThreadState &) { if(key < num_threads) add_stream(&key, 1, key); });
+    path_index.for_each([&](const std::size_t *ids, std::size_t depth, std::size_t key) {
+        IdxT path_ids[max_thread_depth];
+        for(std::size_t l=0; l<depth; l++) path_ids[l] = ids[l];
+        add_stream(path_ids, depth, key);
+    });
+
+    checkpoint::Header header{};
+    std::memcpy(header.magic, checkpoint::magic, sizeof(header.magic));
+    header.version = checkpoint::version;
+    header.byte_order = checkpoint::byte_order_mark;
+    header.init_seed = init_seed;
+    header.num_threads = num_threads;
+    header.num_streams = records.size();
+    std::strncpy(header.engine_name, RngT::name(), checkpoint::engine_name_size-1);
+    const uint64_t states_offset = sizeof(header) + records.size()*sizeof(checkpoint::StreamRecord);
+    for(auto &rec: records) rec.state_offset += states_offset;
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(records.data()), records.size()*sizeof(checkpoint::StreamRecord));
+    out.write(states.data(), states.size());
+    if(!out) throw ParallelRngManagerError("Unable to write checkpoint.");
+}
+
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::save_checkpoint(const std::string &filename) const
+{
+    std::ofstream out(filename, std::ios::binary);
+    if(!out) throw ParallelRngManagerError("Unable to open checkpoint file: "+filename);
+    save_checkpoint(out);
+}
+
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::load_checkpoint(std::istream &in)
+{
+    std::string buf{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    load_checkpoint(buf.data(), buf.size());
+}
+
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::load_checkpoint(const std::string &filename)
+{
+    checkpoint::MappedFile file(filename);
+    load_checkpoint(file.data(), file.size());
+}
+
+/** @brief Restore the manager from the size byte checkpoint in buf.
+ *
+ * The checkpoint is validated before any state is changed, so on an exception the manager is left unchanged.
+ */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::load_checkpoint(const char *buf, std::size_t size)
+{
+    static_assert(checkpoint::max_depth == max_thread_depth, "Checkpoint thread paths must hold max_thread_depth ids.");
+    checkpoint::Header header;
+    if(size < sizeof(header)) throw ParallelRngManagerError("Checkpoint is truncated.");
+    std::memcpy(&header, buf, sizeof(header));
+    if(std::memcmp(header.magic, checkpoint::magic, sizeof(header.magic)))
+        throw ParallelRngManagerError("Not a ParallelRngManager checkpoint.");
+    if(header.byte_order != checkpoint::byte_order_mark)
+        throw ParallelRngManagerError("Checkpoint byte order does not match this platform.");
+    if(header.version != checkpoint::version)
+        throw ParallelRngManagerError("Unsupported checkpoint version: "+std::to_string(header.version));
+    header.engine_name[checkpoint::engine_name_size-1] = 0;
+    if(std::strncmp(header.engine_name, RngT::name(), checkpoint::engine_name_size-1))
+        throw ParallelRngManagerError(std::string("Checkpoint engine is ")+header.engine_name+" not "+RngT::name());
+    if(header.num_streams > (size - sizeof(header)) / sizeof(checkpoint::StreamRecord))
+        throw ParallelRngManagerError("Checkpoint is truncated.");
+
+    std::vector<std::pair<ThreadPath,RngT>> streams(header.num_streams);
+    for(uint64_t i=0; i<header.num_streams; i++) {
+        checkpoint::StreamRecord rec;
+        std::memcpy(&rec, buf + sizeof(header) + i*sizeof(rec), sizeof(rec));
+        if(rec.depth < 1 || rec.depth > max_thread_depth || rec.state_offset > size || rec.state_size > size - rec.state_offset)
+            throw ParallelRngManagerError("Checkpoint stream record is corrupt.");
+        ThreadPath &path = streams[i].first;
+        path.depth = rec.depth;
+        for(IdxT l=0; l<path.depth; l++) path.ids[l] = rec.ids[l];
+        std::istringstream state(std::string(buf + rec.state_offset, rec.state_size));
+        state >> streams[i].second;
+        if(!state) throw ParallelRngManagerError("Checkpoint engine state is corrupt.");
+    }
+
+    reset(header.init_seed, header.num_threads);
+    for(auto &stream: streams) {
+        ThreadPath &path = stream.first;
+        if(path.depth == 1 && path.ids[0] < num_threads) path.key = path.ids[0];
+        else path.key = path_index.key(path.ids.data(), path.depth);
+        thread_states.get(path.key, [&](IdxT) { return ThreadState{stream.second}; });
+    }
+}
+
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::StreamHandle
+ParallelRngManager<RngT,FloatT,AllocT>::local()
+{
+    ThreadState &state = thread_state(thread_path());
+    return StreamHandle{&state.rng, &state.uni, &state.norm};
+}
+
+/** Stream for logical work item task.  Does not consume values from any thread's stream. */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::TaskStream
+ParallelRngManager<RngT,FloatT,AllocT>::stream_for(uint64_t task) const
+{
+    TaskStream stream{task_root};
+    select_task_stream(stream.task_gen, task);
+    return stream;
+}
+
+template<class RngT, class FloatT, class AllocT>
+RngT& ParallelRngManager<RngT,FloatT,AllocT>::generator()
+{
+    return thread_generator(thread_path());
+}
+
+template<class RngT, class FloatT, class AllocT>
+any_rng::AnyRng<typename ParallelRngManager<RngT,FloatT,AllocT>::result_type>
+ParallelRngManager<RngT,FloatT,AllocT>::generic_generator()
 {
-    auto id = omp_get_thread_num();
-    return any_rng::AnyRng<result_type>{rngs[id]};
+    return any_rng::AnyRng<result_type>{generator()};
 }
 
 /**Random 64-bit integer */
-template<class RngT, class FloatT>
-typename ParallelRngManager<RngT,FloatT>::result_type
-ParallelRngManager<RngT,FloatT>::operator()()
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::result_type
+ParallelRngManager<RngT,FloatT,AllocT>::operator()()
 {
     return generator()();    
 }
 
 /**Random FloatT uniform on [0,1) */
-template<class RngT, class FloatT>
-FloatT ParallelRngManager<RngT,FloatT>::randu()
+template<class RngT, class FloatT, class AllocT>
+FloatT ParallelRngManager<RngT,FloatT,AllocT>::randu()
 {
-    auto id = omp_get_thread_num();
-    return uni_dist[id](rngs[id]);
+    PARALLEL_RNG_PROBE(Randu, 1, sizeof(FloatT));
+    return local().randu();
 }
 
 /**Random standard normal variate */
-template<class RngT, class FloatT>
+template<class RngT, class FloatT, class AllocT>
 inline
-FloatT ParallelRngManager<RngT,FloatT>::randn()
+FloatT ParallelRngManager<RngT,FloatT,AllocT>::randn()
 {
-    auto id = omp_get_thread_num();
-    return norm_dist[id](rngs[id]);
+    PARALLEL_RNG_PROBE(Randn, 1, sizeof(FloatT));
+    return local().randn();
 }
 
 /**Vector of Random FloatT uniform on [0,1) */
-template<class RngT, class FloatT>
-typename ParallelRngManager<RngT,FloatT>::VecT 
-ParallelRngManager<RngT,FloatT>::randu(IdxT N)
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::VecT 
+ParallelRngManager<RngT,FloatT,AllocT>::randu(IdxT N)
 {
     VecT samp(N);
-    auto id = omp_get_thread_num();
-    auto &gen = rngs[id] ;//get per-thread parallel generator
-    auto &uniform = uni_dist[id];  //get per-thread normal distribution
-    for(IdxT n=0;n<N;n++) samp(n) = uniform(gen);
+    fill_randu(samp);
     return samp;
 }
 
 /**Vector of standard normal variate */
-template<class RngT, class FloatT>
-typename ParallelRngManager<RngT,FloatT>::VecT 
-ParallelRngManager<RngT,FloatT>::randn(IdxT N)
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::VecT 
+ParallelRngManager<RngT,FloatT,AllocT>::randn(IdxT N)
 {
     VecT samp(N);
-    auto id = omp_get_thread_num();
-    auto &gen = rngs[id]; //get per-thread parallel generator
-    auto &normal = norm_dist[id]; //get per-thread normal distribution
-    for(IdxT n=0;n<N;n++) samp(n) = normal(gen);
+    fill_randn(samp);
     return samp;
 }
 
 /**Matrix of Random FloatT uniform on [0,1) */
-template<class RngT, class FloatT>
-typename ParallelRngManager<RngT,FloatT>::MatT 
-ParallelRngManager<RngT,FloatT>::randu(IdxT rows, IdxT cols)
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::MatT 
+ParallelRngManager<RngT,FloatT,AllocT>::randu(IdxT rows, IdxT cols)
 {
     MatT samp(rows, cols);
-    auto id = omp_get_thread_num();
-    auto &gen = rngs[id]; //get per-thread parallel generator
-    auto &uniform = uni_dist[id];  //get per-thread normal distribution
-    for(IdxT r=0;r<rows;r++) for(IdxT c=0;c<cols;c++) samp(r,c) = uniform(gen);
+    fill_randu(samp);
     return samp;
 }
 
 /**Matrix of standard normal variate */
-template<class RngT, class FloatT>
-typename ParallelRngManager<RngT,FloatT>::MatT 
-ParallelRngManager<RngT,FloatT>::randn(IdxT rows, IdxT cols)
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::MatT 
+ParallelRngManager<RngT,FloatT,AllocT>::randn(IdxT rows, IdxT cols)
 {
     MatT samp(rows, cols);
-    auto id = omp_get_thread_num();
-    auto &gen = rngs[id]; //get per-thread parallel generator
-    auto &normal = norm_dist[id]; //get per-thread normal distribution
-    for(IdxT r=0;r<rows;r++) for(IdxT c=0;c<cols;c++) samp(r,c) = normal(gen);
+    fill_randn(samp);
     return samp;
 }
 
-template<class RngT, class FloatT>
+/**Random exponential variate with rate lambda */
+template<class RngT, class FloatT, class AllocT>
+FloatT ParallelRngManager<RngT,FloatT,AllocT>::rande(FloatT lambda)
+{
+    return local().rande(lambda);
+}
+
+/**Random gamma variate */
+template<class RngT, class FloatT, class AllocT>
+FloatT ParallelRngManager<RngT,FloatT,AllocT>::randg(FloatT shape, FloatT scale)
+{
+    return local().randg(shape, scale);
+}
+
+/**Random beta variate */
+template<class RngT, class FloatT, class AllocT>
+FloatT ParallelRngManager<RngT,FloatT,AllocT>::randbeta(FloatT a, FloatT b)
+{
+    return local().randbeta(a, b);
+}
+
+/**Vector of exponential variates */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::VecT 
+ParallelRngManager<RngT,FloatT,AllocT>::rande(FloatT lambda, IdxT N)
+{
+    return local().rande(lambda, N);
+}
+
+/**Vector of gamma variates */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::VecT 
+ParallelRngManager<RngT,FloatT,AllocT>::randg(FloatT shape, FloatT scale, IdxT N)
+{
+    return local().randg(shape, scale, N);
+}
+
+/**Vector of beta variates */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::VecT 
+ParallelRngManager<RngT,FloatT,AllocT>::randbeta(FloatT a, FloatT b, IdxT N)
+{
+    return local().randbeta(a, b, N);
+}
+
+/**Matrix of exponential variates */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::MatT 
+ParallelRngManager<RngT,FloatT,AllocT>::rande(FloatT lambda, IdxT rows, IdxT cols)
+{
+    return local().rande(lambda, rows, cols);
+}
+
+/**Matrix of gamma variates */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::MatT 
+ParallelRngManager<RngT,FloatT,AllocT>::randg(FloatT shape, FloatT scale, IdxT rows, IdxT cols)
+{
+    return local().randg(shape, scale, rows, cols);
+}
+
+/**Matrix of beta variates */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::MatT 
+ParallelRngManager<RngT,FloatT,AllocT>::randbeta(FloatT a, FloatT b, IdxT rows, IdxT cols)
+{
+    return local().randbeta(a, b, rows, cols);
+}
+
+/**Vector of gamma variates with element n of shape shapes(n) */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::VecT 
+ParallelRngManager<RngT,FloatT,AllocT>::randg(const VecT &shapes, FloatT scale)
+{
+    return local().randg(shapes, scale);
+}
+
+/**Vector of beta variates with element n from parameters a(n), b(n) */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::VecT 
+ParallelRngManager<RngT,FloatT,AllocT>::randbeta(const VecT &a, const VecT &b)
+{
+    return local().randbeta(a, b);
+}
+
+/**Random Dirichlet vector with concentrations alpha */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::VecT 
+ParallelRngManager<RngT,FloatT,AllocT>::randdirichlet(const VecT &alpha)
+{
+    return local().randdirichlet(alpha);
+}
+
+/**Matrix of N Dirichlet samples as columns */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::MatT 
+ParallelRngManager<RngT,FloatT,AllocT>::randdirichlet(const VecT &alpha, IdxT N)
+{
+    return local().randdirichlet(alpha, N);
+}
+
+template<class RngT, class FloatT, class AllocT>
 template<class Weights,class IdxT>
 IdxT 
-ParallelRngManager<RngT,FloatT>::resample_dist(const Weights &weights)
+ParallelRngManager<RngT,FloatT,AllocT>::resample_dist(const Weights &weights)
 {
-    std::discrete_distribution<IdxT> dist(weights.begin(),weights.end());
-    return dist(generator());
+    PARALLEL_RNG_PROBE(ResampleDist, 1, sizeof(IdxT));
+    return local().template resample_dist<Weights,IdxT>(weights);
 }
 
-template<class RngT, class FloatT>
+template<class RngT, class FloatT, class AllocT>
 template<class Weights,class IdxT>
 arma::Col<IdxT>
-ParallelRngManager<RngT,FloatT>::resample_dist(const Weights &weights, IdxT N)
+ParallelRngManager<RngT,FloatT,AllocT>::resample_dist(const Weights &weights, IdxT N)
 {
-    std::discrete_distribution<IdxT> dist(weights.begin(),weights.end());
     arma::Col<IdxT> samp(N);
-    auto &gen = generator();
-    for(IdxT n=0; n<N; n++) samp(n) = dist(gen);
+    fill_resample(weights, samp);
     return samp;
 }
 
+/**Fill matrix or vector with FloatT uniform on [0,1) */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randu(MatT &samp)
+{
+    PARALLEL_RNG_PROBE(FillRandu, samp.n_elem, samp.n_elem*sizeof(FloatT));
+    local().fill_randu(samp);
+}
+
+/**Fill subview with FloatT uniform on [0,1) in column-major order */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randu(arma::subview<FloatT> &samp)
+{
+    PARALLEL_RNG_PROBE(FillRandu, samp.n_elem, samp.n_elem*sizeof(FloatT));
+    local().fill_randu(samp);
+}
+
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randu(arma::subview<FloatT> &&samp)
+{
+    fill_randu(samp);
+}
+
+/**Fill N strided elements of samp with FloatT uniform on [0,1) */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randu(FloatT *samp, IdxT N, IdxT stride)
+{
+    PARALLEL_RNG_PROBE(FillRandu, N, N*sizeof(FloatT));
+    local().fill_randu(samp, N, stride);
+}
+
+/**Fill matrix or vector with standard normal variates */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randn(MatT &samp)
+{
+    PARALLEL_RNG_PROBE(FillRandn, samp.n_elem, samp.n_elem*sizeof(FloatT));
+    local().fill_randn(samp);
+}
+
+/**Fill subview with standard normal variates in column-major order */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randn(arma::subview<FloatT> &samp)
+{
+    PARALLEL_RNG_PROBE(FillRandn, samp.n_elem, samp.n_elem*sizeof(FloatT));
+    local().fill_randn(samp);
+}
+
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randn(arma::subview<FloatT> &&samp)
+{
+    fill_randn(samp);
+}
+
+/**Fill N strided elements of samp with standard normal variates */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randn(FloatT *samp, IdxT N, IdxT stride)
+{
+    PARALLEL_RNG_PROBE(FillRandn, N, N*sizeof(FloatT));
+    local().fill_randn(samp, N, stride);
+}
+
+/**Fill matrix or vector with exponential variates */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_rande(FloatT lambda, MatT &samp)
+{
+    local().fill_rande(lambda, samp);
+}
+
+/**Fill matrix or vector with gamma variates */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randg(FloatT shape, FloatT scale, MatT &samp)
+{
+    local().fill_randg(shape, scale, samp);
+}
+
+/**Fill matrix or vector with gamma variates, where element n has shape shapes(n) */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randg(const VecT &shapes, FloatT scale, MatT &samp)
+{
+    local().fill_randg(shapes, scale, samp);
+}
+
+/**Fill matrix or vector with beta variates */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randbeta(FloatT a, FloatT b, MatT &samp)
+{
+    local().fill_randbeta(a, b, samp);
+}
+
+/**Fill matrix or vector with beta variates, where element n has parameters a(n), b(n) */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randbeta(const VecT &a, const VecT &b, MatT &samp)
+{
+    local().fill_randbeta(a, b, samp);
+}
+
+/**Fill each column of samp with a Dirichlet sample */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randdirichlet(const VecT &alpha, MatT &samp)
+{
+    local().fill_randdirichlet(alpha, samp);
+}
+
+/**Random Poisson count */
+template<class RngT, class FloatT, class AllocT>
+IdxT ParallelRngManager<RngT,FloatT,AllocT>::randp(FloatT mean)
+{
+    return local().randp(mean);
+}
+
+/**Random binomial count */
+template<class RngT, class FloatT, class AllocT>
+IdxT ParallelRngManager<RngT,FloatT,AllocT>::randbinom(IdxT trials, FloatT p)
+{
+    return local().randbinom(trials, p);
+}
+
+/**Random negative binomial count with given size and mean */
+template<class RngT, class FloatT, class AllocT>
+IdxT ParallelRngManager<RngT,FloatT,AllocT>::randnbinom(FloatT size, FloatT mean)
+{
+    return local().randnbinom(size, mean);
+}
+
+/**Matrix of Poisson counts with element-wise means */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::CountMatT 
+ParallelRngManager<RngT,FloatT,AllocT>::randp(const MatT &means)
+{
+    return local().randp(means);
+}
+
+/**Matrix of binomial counts with element-wise success probabilities */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::CountMatT 
+ParallelRngManager<RngT,FloatT,AllocT>::randbinom(IdxT trials, const MatT &probs)
+{
+    return local().randbinom(trials, probs);
+}
+
+/**Matrix of negative binomial counts with element-wise means */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::CountMatT 
+ParallelRngManager<RngT,FloatT,AllocT>::randnbinom(FloatT size, const MatT &means)
+{
+    return local().randnbinom(size, means);
+}
+
+/**Random permutation of 0, ..., N-1 */
+template<class RngT, class FloatT, class AllocT>
+arma::Col<IdxT> ParallelRngManager<RngT,FloatT,AllocT>::randperm(IdxT N)
+{
+    return local().randperm(N);
+}
+
+/**Shuffle v in place */
+template<class RngT, class FloatT, class AllocT>
+template<class T>
+void ParallelRngManager<RngT,FloatT,AllocT>::shuffle(arma::Col<T> &v)
+{
+    local().shuffle(v);
+}
+
+/**k distinct indices from [0,N) in random order */
+template<class RngT, class FloatT, class AllocT>
+arma::Col<IdxT> ParallelRngManager<RngT,FloatT,AllocT>::sample_without_replacement(IdxT N, IdxT k)
+{
+    return local().sample_without_replacement(N, k);
+}
+
+/**Bootstrap indices for B replicates of N observations, as the columns of an N x B matrix */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::CountMatT 
+ParallelRngManager<RngT,FloatT,AllocT>::bootstrap_indices(IdxT N, IdxT B)
+{
+    return local().bootstrap_indices(N, B);
+}
+
+/**Bootstrap counts for B replicates of N observations, as the columns of an N x B matrix */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::CountMatT 
+ParallelRngManager<RngT,FloatT,AllocT>::bootstrap_counts(BootstrapScheme scheme, IdxT N, IdxT B)
+{
+    return local().bootstrap_counts(scheme, N, B);
+}
+
+/**Fill each column of samp with the indices of one bootstrap replicate of samp.n_rows observations */
+template<class RngT, class FloatT, class AllocT>
+template<class OutT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_bootstrap_indices(arma::Mat<OutT> &samp)
+{
+    local().fill_bootstrap_indices(samp);
+}
+
+/**Fill each column of samp with the counts of one bootstrap replicate of samp.n_rows observations */
+template<class RngT, class FloatT, class AllocT>
+template<class OutT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_bootstrap_counts(BootstrapScheme scheme, arma::Mat<OutT> &samp)
+{
+    local().fill_bootstrap_counts(scheme, samp);
+}
+
+/**Fill samp with Poisson counts with element-wise means */
+template<class RngT, class FloatT, class AllocT>
+template<class OutT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randp(const MatT &means, arma::Mat<OutT> &samp)
+{
+    local().fill_randp(means, samp);
+}
+
+/**Fill samp with binomial counts with element-wise success probabilities */
+template<class RngT, class FloatT, class AllocT>
+template<class OutT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randbinom(IdxT trials, const MatT &probs, arma::Mat<OutT> &samp)
+{
+    local().fill_randbinom(trials, probs, samp);
+}
+
+/**Fill samp with negative binomial counts with element-wise means */
+template<class RngT, class FloatT, class AllocT>
+template<class OutT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randnbinom(FloatT size, const MatT &means, arma::Mat<OutT> &samp)
+{
+    local().fill_randnbinom(size, means, samp);
+}
+
+/**Fill samp with categorical samples from weights */
+template<class RngT, class FloatT, class AllocT>
+template<class Weights,class IdxT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_resample(const Weights &weights, arma::Mat<IdxT> &samp)
+{
+    fill_resample<Weights,IdxT>(weights, samp.memptr(), samp.n_elem);
+}
+
+/**Fill N strided elements of samp with categorical samples from weights */
+template<class RngT, class FloatT, class AllocT>
+template<class Weights,class IdxT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_resample(const Weights &weights, IdxT *samp, IdxT N, IdxT stride)
+{
+    PARALLEL_RNG_PROBE(FillResample, N, N*sizeof(IdxT));
+    local().template fill_resample<Weights,IdxT>(weights, samp, N, stride);
+}
+
+/**Matrix of Random FloatT uniform on [0,1) generated in parallel.  Identical to randu(rows,cols). */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::MatT 
+ParallelRngManager<RngT,FloatT,AllocT>::randu_parallel(IdxT rows, IdxT cols)
+{
+    MatT samp(rows, cols);
+    fill_randu_parallel(samp);
+    return samp;
+}
+
+/**Matrix of standard normal variates generated in parallel.  Independent of the number of threads, but not identical
+ * to randn(rows,cols).  See fill_randn_parallel().
+ */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::MatT 
+ParallelRngManager<RngT,FloatT,AllocT>::randn_parallel(IdxT rows, IdxT cols)
+{
+    MatT samp(rows, cols);
+    fill_randn_parallel(samp);
+    return samp;
+}
+
+/**Fill matrix with FloatT uniform on [0,1) in parallel.  Identical to fill_randu(samp).
+ *
+ * Blocks are made of whole groups of samples sharing an engine value, i.e., pairs for FloatT=float on 64-bit engines.
+ */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randu_parallel(MatT &samp)
+{
+    PARALLEL_RNG_PROBE(FillRanduParallel, samp.n_elem, samp.n_elem*sizeof(FloatT));
+    const UniformDistT uniform = thread_uniform(thread_path());
+    const IdxT S = UniformDistT::template samples_per_draw<RngT>();
+    const IdxT N = samp.n_elem;
+    FloatT *out = samp.memptr();
+    parallel_stream_blocks((N+S-1)/S, S == 1 ? uniform_draws : 1, true,
+                           [&](RngT &block_gen, IdxT begin, IdxT end) {
+        UniformDistT block_uniform = uniform;
+        fill_dist(block_uniform, block_gen, out+begin*S, std::min(end*S,N)-begin*S, 1, 1, 0);
+    });
+}
+
+/**Fill matrix with standard normal variates in parallel.
+ *
+ * Rejection-based normal samplers consume a variable number of engine values per sample, so blocks could not be placed
+ * at exact offsets.  Instead, each consecutive pair of elements is produced by a Box-Muller transform of exactly two
+ * uniform samples.  The output is independent of the number of threads, but differs from fill_randn(samp).
+ */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randn_parallel(MatT &samp)
+{
+    PARALLEL_RNG_PROBE(FillRandnParallel, samp.n_elem, samp.n_elem*sizeof(FloatT));
+    const UniformDistT uniform = thread_uniform(thread_path());
+    const IdxT N = samp.n_elem;
+    FloatT *out = samp.memptr();
+    parallel_stream_blocks((N+1)/2, 2*uniform_draws, true, [&](RngT &block_gen, IdxT begin, IdxT end) {
+        UniformDistT block_uniform = uniform;
+        if(end-begin < bulk_min_size) {
+            fill_normal_pairs(block_uniform, block_gen, out, begin, end, N);
+        } else {
+            BulkRngT lanes(block_gen);
+            fill_normal_pairs(block_uniform, lanes, out, begin, end, N);
+        }
+    });
+}
+
+/**Matrix of Poisson counts with element-wise means generated in parallel.  Identical to randp(means). */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::CountMatT 
+ParallelRngManager<RngT,FloatT,AllocT>::randp_parallel(const MatT &means)
+{
+    CountMatT samp(means.n_rows, means.n_cols);
+    fill_randp_parallel(means, samp);
+    return samp;
+}
+
+/**Matrix of binomial counts generated in parallel.  Identical to randbinom(trials, probs). */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::CountMatT 
+ParallelRngManager<RngT,FloatT,AllocT>::randbinom_parallel(IdxT trials, const MatT &probs)
+{
+    CountMatT samp(probs.n_rows, probs.n_cols);
+    fill_randbinom_parallel(trials, probs, samp);
+    return samp;
+}
+
+/**Matrix of negative binomial counts generated in parallel.  Identical to randnbinom(size, means). */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::CountMatT 
+ParallelRngManager<RngT,FloatT,AllocT>::randnbinom_parallel(FloatT size, const MatT &means)
+{
+    CountMatT samp(means.n_rows, means.n_cols);
+    fill_randnbinom_parallel(size, means, samp);
+    return samp;
+}
+
+/**Fill samp with Poisson counts with element-wise means in parallel.  Identical to fill_randp(means, samp). */
+template<class RngT, class FloatT, class AllocT>
+template<class OutT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randp_parallel(const MatT &means, arma::Mat<OutT> &samp)
+{
+    check_count_shape(means, samp);
+    fill_counts([&](IdxT n) { return PoissonDistT(means(n)); }, generator(), samp.memptr(), samp.n_elem, true);
+}
+
+/**Fill samp with binomial counts in parallel.  Identical to fill_randbinom(trials, probs, samp). */
+template<class RngT, class FloatT, class AllocT>
+template<class OutT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randbinom_parallel(IdxT trials, const MatT &probs,
+                                                                     arma::Mat<OutT> &samp)
+{
+    check_count_shape(probs, samp);
+    fill_counts([&](IdxT n) { return BinomialDistT(trials, probs(n)); }, generator(), samp.memptr(), samp.n_elem, true);
+}
+
+/**Fill samp with negative binomial counts in parallel.  Identical to fill_randnbinom(size, means, samp). */
+template<class RngT, class FloatT, class AllocT>
+template<class OutT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randnbinom_parallel(FloatT size, const MatT &means,
+                                                                      arma::Mat<OutT> &samp)
+{
+    check_count_shape(means, samp);
+    fill_counts([&](IdxT n) { return NegativeBinomialDistT(size, means(n)); }, generator(), samp.memptr(),
+                samp.n_elem, true);
+}
+
+/**Bootstrap indices generated in parallel over replicates.  Identical to bootstrap_indices(N, B). */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::CountMatT 
+ParallelRngManager<RngT,FloatT,AllocT>::bootstrap_indices_parallel(IdxT N, IdxT B)
+{
+    CountMatT samp(N, B);
+    fill_bootstrap_indices_parallel(samp);
+    return samp;
+}
+
+/**Bootstrap counts generated in parallel over replicates.  Identical to bootstrap_counts(scheme, N, B). */
+template<class RngT, class FloatT, class AllocT>
+typename ParallelRngManager<RngT,FloatT,AllocT>::CountMatT 
+ParallelRngManager<RngT,FloatT,AllocT>::bootstrap_counts_parallel(BootstrapScheme scheme, IdxT N, IdxT B)
+{
+    CountMatT samp(N, B);
+    fill_bootstrap_counts_parallel(scheme, samp);
+    return samp;
+}
+
+/**Fill samp with bootstrap indices in parallel.  Identical to fill_bootstrap_indices(samp). */
+template<class RngT, class FloatT, class AllocT>
+template<class OutT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_bootstrap_indices_parallel(arma::Mat<OutT> &samp)
+{
+    fill_replicates([](BulkRngT &lanes, OutT *col, IdxT N) { bootstrap::indices(col, N, lanes); },
+                    generator(), samp, samp.n_rows ? samp.n_rows-1 : 0, true);
+}
+
+/**Fill samp with bootstrap counts in parallel.  Identical to fill_bootstrap_counts(scheme, samp). */
+template<class RngT, class FloatT, class AllocT>
+template<class OutT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_bootstrap_counts_parallel(BootstrapScheme scheme,
+                                                                            arma::Mat<OutT> &samp)
+{
+    fill_replicates([=](BulkRngT &lanes, OutT *col, IdxT N) { bootstrap::counts(scheme, col, N, lanes); },
+                    generator(), samp, samp.n_rows, true);
+}
+
+/** Sorted ancestor indices by resampling scheme */
+template<class RngT, class FloatT, class AllocT>
+template<class Weights,class IdxT>
+arma::Col<IdxT>
+ParallelRngManager<RngT,FloatT,AllocT>::resample(ResampleScheme scheme, const Weights &weights, IdxT N)
+{
+    arma::Col<IdxT> counts;
+    resample_counts_impl(scheme, weights, N, counts, false);
+    arma::Col<IdxT> idx(N);
+    resampling::counts_to_indices(counts.memptr(), IdxT(counts.n_elem), idx.memptr(), false);
+    return idx;
+}
+
+/** Offspring counts by resampling scheme */
+template<class RngT, class FloatT, class AllocT>
+template<class Weights,class IdxT>
+arma::Col<IdxT>
+ParallelRngManager<RngT,FloatT,AllocT>::resample_counts(ResampleScheme scheme, const Weights &weights, IdxT N)
+{
+    arma::Col<IdxT> counts;
+    resample_counts_impl(scheme, weights, N, counts, false);
+    return counts;
+}
+
+/** Sorted ancestor indices by resampling scheme computed in parallel */
+template<class RngT, class FloatT, class AllocT>
+template<class Weights,class IdxT>
+arma::Col<IdxT>
+ParallelRngManager<RngT,FloatT,AllocT>::resample_parallel(ResampleScheme scheme, const Weights &weights, IdxT N)
+{
+    arma::Col<IdxT> counts;
+    resample_counts_impl(scheme, weights, N, counts, true);
+    arma::Col<IdxT> idx(N);
+    resampling::counts_to_indices(counts.memptr(), IdxT(counts.n_elem), idx.memptr(),
+                                  std::max(IdxT(counts.n_elem),N) >= parallel_min_size);
+    return idx;
+}
+
+/** Offspring counts by resampling scheme computed in parallel */
+template<class RngT, class FloatT, class AllocT>
+template<class Weights,class IdxT>
+arma::Col<IdxT>
+ParallelRngManager<RngT,FloatT,AllocT>::resample_counts_parallel(ResampleScheme scheme, const Weights &weights, IdxT N)
+{
+    arma::Col<IdxT> counts;
+    resample_counts_impl(scheme, weights, N, counts, true);
+    return counts;
+}
+
+/** Run block(block_gen, begin, end) over contiguous blocks of [0,N) on a new OpenMP team.
+ *
+ * Each block_gen is a copy of the calling thread's stream jumped to offset begin*draws, so items consuming exactly
+ * draws engine values each are generated identically for any number of threads.  The calling thread's stream is
+ * then advanced past all N*draws values.
+ */
+template<class RngT, class FloatT, class AllocT>
+template<class BlockFunc>
+void ParallelRngManager<RngT,FloatT,AllocT>::parallel_stream_blocks(IdxT N, IdxT draws, bool parallel, BlockFunc block)
+{
+    auto &gen = generator();
+    #pragma omp parallel if(parallel && N >= parallel_min_size)
+    {
+        IdxT nthreads = omp_get_num_threads();
+        IdxT t = omp_get_thread_num();
+        IdxT begin = N*t/nthreads;
+        IdxT end = N*(t+1)/nthreads;
+        if(begin < end) {
+            RngT block_gen = gen;
+            block_gen.jump(begin*draws);
+            block(block_gen, begin, end);
+        }
+    }
+    gen.jump(N*draws);
+}
+
+template<class RngT, class FloatT, class AllocT>
+template<class Weights, class IdxT>
+void ParallelRngManager<RngT,FloatT,AllocT>::resample_counts_impl(ResampleScheme scheme, const Weights &weights, IdxT N,
+                                                                  arma::Col<IdxT> &counts, bool parallel)
+{
+    const IdxT K = std::distance(weights.begin(), weights.end());
+    const bool par = parallel && std::max(N,K) >= parallel_min_size;
+    std::vector<double> p, C;
+    resampling::normalize_weights(weights, p, C, par);
+    counts.set_size(K);
+    switch(scheme) {
+        case ResampleScheme::Systematic: {
+            double u = local().randu();
+            resampling::systematic_counts(C, N, u, counts.memptr(), par);
+            break;
+        }
+        case ResampleScheme::Stratified: {
+            BufferT<IdxT> idx(N, IdxT(0), alloc);
+            const UniformDistT uniform = thread_uniform(thread_path());
+            //Positions in double, as a FloatT=float jitter would round away for N > 2^24
+            parallel_stream_blocks(N, uniform_draws, par, [&](RngT &block_gen, IdxT begin, IdxT end) {
+                UniformDistT block_uniform = uniform;
+                auto position = [&](IdxT n) { return (double(n) + double(block_uniform(block_gen))) / double(N); };
+                IdxT k = resampling::find_category<IdxT>(C, position(begin));
+                idx[begin] = k;
+                for(IdxT n=begin+1; n<end; n++) idx[n] = k = resampling::walk_category(C, position(n), k);
+            });
+            resampling::indices_to_counts(idx.data(), N, counts.memptr(), K, par);
+            break;
+        }
+        case ResampleScheme::Residual: {
+            //Deterministic copies floor(N*p), leaving residual weights N*p-floor(N*p) in p
+            #pragma omp parallel for if(par)
+            for(IdxT k=0; k<K; k++) {
+                counts(k) = IdxT(std::floor(N*p[k]));
+                p[k] = N*p[k] - counts(k);
+            }
+            IdxT Nbase = scan::block_sum(counts.memptr(), K, par);
+            //Rounding of the normalized weights can leave a few too many copies.  Take them from the largest counts.
+            for(; Nbase > N; Nbase--) (*std::max_element(counts.begin(), counts.end()))--;
+            if(Nbase == N) break;
+            IdxT Nresid = N - Nbase;
+            std::vector<double> p_resid;
+            resampling::normalize_weights(p, p_resid, C, par);
+            BufferT<IdxT> idx(Nresid, IdxT(0), alloc), resid_counts(K, IdxT(0), alloc);
+            sorted_uniform_indices(C, Nresid, idx.data(), par);
+            resampling::indices_to_counts(idx.data(), Nresid, resid_counts.data(), K, par);
+            #pragma omp parallel for if(par)
+            for(IdxT k=0; k<K; k++) counts(k) += resid_counts[k];
+            break;
+        }
+    }
+}
+
+/** Multinomial sample of N sorted indices from cumulative weights C.
+ *
+ * Sorted uniforms are generated directly as normalized prefix sums of N+1 exponential spacings, then mapped to
+ * categories with a single merge pass.
+ */
+template<class RngT, class FloatT, class AllocT>
+template<class IdxT>
+void ParallelRngManager<RngT,FloatT,AllocT>::sorted_uniform_indices(const std::vector<double> &C, IdxT N, IdxT *idx,
+                                                                    bool parallel)
+{
+    BufferT<double> S(N+1, 0., alloc);
+    const UniformDistT uniform = thread_uniform(thread_path());
+    parallel_stream_blocks(N+1, uniform_draws, parallel, [&](RngT &block_gen, IdxT begin, IdxT end) {
+        UniformDistT block_uniform = uniform;
+        for(IdxT n=begin; n<end; n++) S[n] = -std::log(1 - double(block_uniform(block_gen)));
+    });
+    const double total = scan::block_prefix_sum(S.data(), N+1, parallel);
+    #pragma omp parallel for if(parallel)
+    for(IdxT b=0; b<scan::num_blocks(N); b++) {
+        IdxT n = b*scan::block_size;
+        IdxT k = resampling::find_category<IdxT>(C, S[n]/total);
+        for(; n<std::min<IdxT>(N,(b+1)*scan::block_size); n++) idx[n] = k = resampling::walk_category(C, S[n]/total, k);
+    }
+}
+
+/** Box-Muller transform writing normal pairs [begin,end) to out[2*begin] ... out[2*end-1], truncated to N elements */
+template<class RngT, class FloatT, class AllocT>
+template<class GenT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_normal_pairs(UniformDistT &uniform, GenT &gen, FloatT *out,
+                                                               IdxT begin, IdxT end, IdxT N)
+{
+    const FloatT two_pi = 6.283185307179586476925286766559;
+    for(IdxT p=begin; p<end; p++) {
+        FloatT u1 = 1 - uniform(gen); //(0,1]
+        FloatT u2 = uniform(gen);
+        FloatT r = std::sqrt(-2*std::log(u1));
+        FloatT theta = two_pi*u2;
+        out[2*p] = r*std::cos(theta);
+        if(2*p+1 < N) out[2*p+1] = r*std::sin(theta);
+    }
+}
+
+/** Core bulk sampler.  Writes outer_n blocks of inner_n strided samples from dist using stream gen.
+ * Element (i,j) is stored at out[i*inner_stride + j*outer_stride].
+ */
+template<class RngT, class FloatT, class AllocT>
+template<class DistT, class OutT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_dist(DistT &dist, RngT &gen, OutT *out, IdxT inner_n, IdxT outer_n,
+                                                       IdxT inner_stride, IdxT outer_stride)
+{
+    if(inner_n*outer_n < bulk_min_size) {
+        fill_strided(dist, gen, out, inner_n, outer_n, inner_stride, outer_stride);
+    } else {
+        BulkRngT lanes(gen);
+        fill_strided(dist, lanes, out, inner_n, outer_n, inner_stride, outer_stride);
+        lanes.commit(gen);
+    }
+}
+
+template<class RngT, class FloatT, class AllocT>
+template<class DistT, class GenT, class OutT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_strided(DistT &dist, GenT &gen, OutT *out, IdxT inner_n, IdxT outer_n,
+                                                          IdxT inner_stride, IdxT outer_stride)
+{
+    for(IdxT j=0; j<outer_n; j++) {
+        auto out_j = out + j*outer_stride;
+        if(inner_stride == 1) {
+            for(IdxT i=0; i<inner_n; i++) out_j[i] = dist(gen);
+        } else {
+            for(IdxT i=0; i<inner_n; i++) out_j[i*inner_stride] = dist(gen);
+        }
+    }
+}
+
+/** Uniform samples are made in blocks by UniformDistT::generate().  Strided output is generated into a buffer and
+ * scattered, so for FloatT=float the pairs of samples sharing an engine value are the same for any layout.
+ */
+template<class RngT, class FloatT, class AllocT>
+template<class GenT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_strided(UniformDistT &dist, GenT &gen, FloatT *out, IdxT inner_n,
+                                                          IdxT outer_n, IdxT inner_stride, IdxT outer_stride)
+{
+    if(inner_stride == 1 && (outer_n == 1 || outer_stride == inner_n)) {
+        dist.generate(out, inner_n*outer_n, gen);
+        return;
+    }
+    alignas(64) std::array<FloatT,256> buf;
+    IdxT i = 0, j = 0;
+    for(IdxT n=0; n<inner_n*outer_n; n+=buf.size()) {
+        IdxT m = std::min<IdxT>(buf.size(), inner_n*outer_n-n);
+        dist.generate(buf.data(), m, gen);
+        for(IdxT k=0; k<m; k++) {
+            out[i*inner_stride + j*outer_stride] = buf[k];
+            if(++i == inner_n) { i = 0; j++; }
+        }
+    }
+}
+
+/** Writes out[n] = make(n)(gen) for n in [0,N), for samples with per-element parameters */
+template<class RngT, class FloatT, class AllocT>
+template<class MakeDistT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_each(MakeDistT make, RngT &gen, FloatT *out, IdxT N)
+{
+    if(N < bulk_min_size) {
+        fill_each_impl(make, gen, out, N);
+    } else {
+        BulkRngT lanes(gen);
+        fill_each_impl(make, lanes, out, N);
+        lanes.commit(gen);
+    }
+}
+
+template<class RngT, class FloatT, class AllocT>
+template<class MakeDistT, class GenT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_each_impl(MakeDistT &make, GenT &gen, FloatT *out, IdxT N)
+{
+    for(IdxT n=0; n<N; n++) {
+        auto dist = make(n);
+        out[n] = dist(gen);
+    }
+}
+
+/** Writes N vector samples of size K from dist as the columns of out */
+template<class RngT, class FloatT, class AllocT>
+template<class DistT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_vectors(DistT &dist, RngT &gen, FloatT *out, IdxT K, IdxT N)
+{
+    if(K*N < bulk_min_size) {
+        for(IdxT n=0; n<N; n++) dist(gen, out + n*K);
+    } else {
+        BulkRngT lanes(gen);
+        for(IdxT n=0; n<N; n++) dist(lanes, out + n*K);
+        lanes.commit(gen);
+    }
+}
+
+/** Writes out[n] = make(n)(gen) for n in [0,N), for samplers that consume a variable number of engine values.
+ *
+ * Blocks of count_block_size elements could not be placed at exact offsets of the stream.  Instead block b of B reads
+ * the leapfrog sub-stream b of B of gen, so blocks never overlap, and the output depends only on gen and N.  gen is
+ * then advanced past the values read by the longest block.  A single block reads gen itself, so small fills match
+ * repeated scalar draws.
+ */
+template<class RngT, class FloatT, class AllocT>
+template<class MakeDistT, class OutT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_counts(MakeDistT make, RngT &gen, OutT *out, IdxT N, bool parallel)
+{
+    const IdxT nblocks = (N + count_block_size - 1) / count_block_size;
+    if(nblocks == 0) return;
+    if(nblocks > std::numeric_limits<unsigned int>::max())
+        throw ParallelRngManagerError("fill_counts: too many elements for sub-stream blocks.");
+    unsigned long long used = 0;
+    #pragma omp parallel for if(parallel && nblocks > 1) schedule(static) reduction(max:used)
+    for(IdxT b=0; b<nblocks; b++) {
+        RngT block_gen = gen;
+        if(nblocks > 1) block_gen.split(nblocks, b);
+        BulkRngT lanes(block_gen);
+        for(IdxT n=b*count_block_size; n<std::min(N, (b+1)*count_block_size); n++) {
+            auto dist = make(n);
+            out[n] = OutT(dist(lanes));
+        }
+        used = std::max(used, lanes.consumed());
+    }
+    gen.jump(used*nblocks);
+}
+
+template<class RngT, class FloatT, class AllocT>
+template<class OutT>
+void ParallelRngManager<RngT,FloatT,AllocT>::check_count_shape(const MatT &params, const arma::Mat<OutT> &samp)
+{
+    if(params.n_rows != samp.n_rows || params.n_cols != samp.n_cols)
+        throw ParallelRngManagerError("Count sample shape does not match parameters.");
+}
+
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_randperm(RngT &gen, arma::Col<IdxT> &perm)
+{
+    const IdxT N = perm.n_elem;
+    #pragma omp parallel for if(N > permutation::chunk_size)
+    for(IdxT n=0; n<N; n++) perm(n) = n;
+    shuffle_array(gen, perm);
+}
+
+/** Fisher-Yates in place for small arrays, otherwise a parallel scatter shuffle into a new array */
+template<class RngT, class FloatT, class AllocT>
+template<class T>
+void ParallelRngManager<RngT,FloatT,AllocT>::shuffle_array(RngT &gen, arma::Col<T> &v)
+{
+    if(v.n_elem <= permutation::chunk_size) {
+        permutation::fisher_yates(v.memptr(), v.n_elem, gen);
+    } else {
+        arma::Col<T> out(v.n_elem);
+        permutation::scatter_shuffle(v.memptr(), out.memptr(), v.n_elem, gen, true);
+        v.swap(out);
+    }
+}
+
+/** k = samp.n_elem distinct indices from [0,N).
+ *
+ * For k > N/4 this is the first k elements of a random permutation.  Otherwise uniform indices are drawn, and repeats
+ * rejected, using a bitmap of [0,N) or, for k much smaller than N, a hash set.  Keeping the first occurrences of
+ * uniform draws gives every ordered k-sample the same probability.
+ */
+template<class RngT, class FloatT, class AllocT>
+void ParallelRngManager<RngT,FloatT,AllocT>::sample_distinct(RngT &gen, IdxT N, arma::Col<IdxT> &samp)
+{
+    const IdxT k = samp.n_elem;
+    if(k > N) throw ParallelRngManagerError("sample_without_replacement: more samples than population.");
+    if(4*k > N) {
+        arma::Col<IdxT> perm(N);
+        fill_randperm(gen, perm);
+        std::copy(perm.memptr(), perm.memptr()+k, samp.memptr());
+    } else if(N/64 <= k) {
+        std::vector<uint64_t> seen((N + 63)/64, 0);
+        for(IdxT n=0; n<k;) {
+            IdxT x = permutation::uniform_index(N, gen);
+            uint64_t bit = uint64_t(1) << (x % 64);
+            if(seen[x/64] & bit) continue;
+            seen[x/64] |= bit;
+            samp(n++) = x;
+        }
+    } else {
+        std::unordered_set<IdxT> seen(2*k);
+        for(IdxT n=0; n<k;) {
+            IdxT x = permutation::uniform_index(N, gen);
+            if(seen.insert(x).second) samp(n++) = x;
+        }
+    }
+}
+
+/** Run replicate(lanes, samp.colptr(b), samp.n_rows) for each column b of samp.
+ *
+ * As in fill_counts(), replicate b of B reads the leapfrog sub-stream b of B of gen, and gen is then advanced past the
+ * values read by the longest replicate.  Values written must not exceed max_value.
+ */
+template<class RngT, class FloatT, class AllocT>
+template<class ReplicateFunc, class OutT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_replicates(ReplicateFunc replicate, RngT &gen, arma::Mat<OutT> &samp,
+                                                             IdxT max_value, bool parallel)
+{
+    const IdxT N = samp.n_rows;
+    const IdxT B = samp.n_cols;
+    if(N == 0 || B == 0) return;
+    if(double(max_value) > double(std::numeric_limits<OutT>::max()))
+        throw ParallelRngManagerError("Bootstrap output type is too small for the number of observations.");
+    if(B > std::numeric_limits<unsigned int>::max())
+        throw ParallelRngManagerError("Bootstrap: too many replicates for sub-streams.");
+    unsigned long long used = 0;
+    #pragma omp parallel for if(parallel && B > 1 && N*B >= parallel_min_size) schedule(dynamic) reduction(max:used)
+    for(IdxT b=0; b<B; b++) {
+        RngT replicate_gen = gen;
+        if(B > 1) replicate_gen.split(B, b);
+        BulkRngT lanes(replicate_gen);
+        replicate(lanes, samp.colptr(b), N);
+        used = std::max(used, lanes.consumed());
+    }
+    gen.jump(used*B);
+}
+
+template<class RngT, class FloatT, class AllocT>
+template<class DistT>
+void ParallelRngManager<RngT,FloatT,AllocT>::fill_subview(DistT &dist, RngT &gen, arma::subview<FloatT> &samp)
+{
+    if(samp.n_elem == 0) return;
+    fill_dist(dist, gen, samp.colptr(0), samp.n_rows, samp.n_cols, 1, samp.m.n_rows);
+}
+
 } /* namespace parallel_rng */
 
 #endif /* _PARALLEL_RNG_PARALLELRNGMANAGER_H */
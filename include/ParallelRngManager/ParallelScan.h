@@ -0,0 +1,75 @@
+/** @file ParallelScan.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Deterministic blocked prefix sums for OpenMP.
+ *
+ * Floating point prefix sums depend on the order of additions.  These scans always split the input into blocks of
+ * a fixed size, independent of the number of threads, so results are bit-identical for any OpenMP team size.
+ */
+#ifndef _PARALLEL_RNG_PARALLELSCAN_H
+#define _PARALLEL_RNG_PARALLELSCAN_H
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+#include <omp.h>
+
+namespace parallel_rng {
+
+namespace scan {
+
+/** Fixed block size for all deterministic scans */
+static const std::size_t block_size = 4096;
+
+inline
+std::size_t num_blocks(std::size_t n)
+{ return (n + block_size - 1) / block_size; }
+
+/** Sum of x[0..n) */
+template<class T, class SizeT>
+T block_sum(const T *x, SizeT n, bool parallel)
+{
+    const SizeT nblocks = num_blocks(n);
+    std::vector<T> block_totals(nblocks);
+    #pragma omp parallel for if(parallel)
+    for(SizeT b=0; b<nblocks; b++) {
+        T s = 0;
+        for(SizeT k=b*block_size; k<std::min<SizeT>(n,(b+1)*block_size); k++) s += x[k];
+        block_totals[b] = s;
+    }
+    T total = 0;
+    for(auto s: block_totals) total += s;
+    return total;
+}
+
+/** In-place inclusive prefix sum over x[0..n).  Returns the total. */
+template<class T, class SizeT>
+T block_prefix_sum(T *x, SizeT n, bool parallel)
+{
+    const SizeT nblocks = num_blocks(n);
+    std::vector<T> block_offset(nblocks);
+    #pragma omp parallel for if(parallel)
+    for(SizeT b=0; b<nblocks; b++) {
+        T s = 0;
+        for(SizeT k=b*block_size; k<std::min<SizeT>(n,(b+1)*block_size); k++) x[k] = (s += x[k]);
+        block_offset[b] = s;
+    }
+    T offset = 0;
+    for(SizeT b=0; b<nblocks; b++) {
+        T t = block_offset[b];
+        block_offset[b] = offset;
+        offset += t;
+    }
+    #pragma omp parallel for if(parallel)
+    for(SizeT b=1; b<nblocks; b++) {
+        for(SizeT k=b*block_size; k<std::min<SizeT>(n,(b+1)*block_size); k++) x[k] += block_offset[b];
+    }
+    return offset;
+}
+
+} /* namespace parallel_rng::scan */
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_PARALLELSCAN_H */
@@ -0,0 +1,140 @@
+/** @file Permutation.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Random permutations: serial Fisher-Yates and a parallel scatter shuffle.
+ *
+ * A Fisher-Yates shuffle of a large array is serial and touches a random cache line on every swap.  For large arrays
+ * scatter_shuffle() instead sends each element to one of K buckets chosen uniformly at random, and then shuffles each
+ * bucket with Fisher-Yates.  The concatenated buckets are a uniformly random permutation.  Buckets are small enough to
+ * shuffle in cache, and both phases run in parallel.
+ *
+ * The input is split into chunks of chunk_size elements, and K depends only on n.  Chunk c and bucket k read their
+ * own leapfrog sub-streams of the generator, as for ParallelRngManager count samplers, so the permutation depends only
+ * on the generator state and n, and not on the number of threads.
+ */
+#ifndef _PARALLEL_RNG_PERMUTATION_H
+#define _PARALLEL_RNG_PERMUTATION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <omp.h>
+
+#include "ParallelRngManager/LeapfrogEngine.h"
+#include "ParallelRngManager/Ziggurat.h"
+
+namespace parallel_rng {
+
+namespace permutation {
+
+/** Elements per scatter chunk.  Arrays of at most this size are shuffled in place with Fisher-Yates. */
+static const std::size_t chunk_size = std::size_t(1)<<18;
+/** Target elements per bucket */
+static const std::size_t bucket_size = std::size_t(1)<<16;
+static const std::size_t max_buckets = 1024;
+
+/** High 64 bits of the 128-bit product a*b */
+inline
+uint64_t mulhi(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+    return uint64_t((unsigned __int128)a * b >> 64);
+#else
+    uint64_t a_lo = uint32_t(a), a_hi = a >> 32, b_lo = uint32_t(b), b_hi = b >> 32;
+    uint64_t lo_lo = a_lo*b_lo, hi_lo = a_hi*b_lo, lo_hi = a_lo*b_hi;
+    uint64_t cross = (lo_lo >> 32) + uint32_t(hi_lo) + lo_hi;
+    return a_hi*b_hi + (hi_lo >> 32) + (cross >> 32);
+#endif
+}
+
+/** Uniform integer in [0,n) for n>0, by Lemire's multiply-shift method with exact rejection */
+template<class RngT>
+uint64_t uniform_index(uint64_t n, RngT &gen)
+{
+    uint64_t x = ziggurat::random_u64(gen);
+    uint64_t lo = x*n;
+    if(lo < n) {
+        const uint64_t threshold = (0 - n) % n;
+        while(lo < threshold) {
+            x = ziggurat::random_u64(gen);
+            lo = x*n;
+        }
+    }
+    return mulhi(x, n);
+}
+
+/** Fisher-Yates shuffle of v[0..n) */
+template<class T, class RngT>
+void fisher_yates(T *v, std::size_t n, RngT &gen)
+{
+    for(std::size_t i=n; i>1; i--) std::swap(v[i-1], v[uniform_index(i, gen)]);
+}
+
+/** Number of buckets used to scatter n elements */
+inline
+std::size_t num_buckets(std::size_t n)
+{ return std::min(max_buckets, std::max<std::size_t>(1, (n + bucket_size - 1) / bucket_size)); }
+
+/** Write a uniformly random permutation of in[0..n) to out[0..n), and advance gen past the values used. */
+template<class T, class RngT>
+void scatter_shuffle(const T *in, T *out, std::size_t n, RngT &gen, bool parallel)
+{
+    const std::size_t C = (n + chunk_size - 1) / chunk_size;
+    const std::size_t K = num_buckets(n);
+    if(C + K > std::numeric_limits<unsigned int>::max()) throw std::length_error("scatter_shuffle: too many elements.");
+    const unsigned int S = C + K;
+    auto substream = [&](std::size_t s) {
+        RngT sub = gen;
+        sub.split(S, s);
+        return sub;
+    };
+    //Bucket of every element, counted by chunk.  The draws are replayed to scatter, rather than stored.
+    std::vector<std::size_t> pos(C*K, 0);
+    #pragma omp parallel for if(parallel) schedule(static)
+    for(std::size_t c=0; c<C; c++) {
+        RngT chunk_gen = substream(c);
+        LeapfrogEngine<RngT> lanes(chunk_gen);
+        std::size_t *count = pos.data() + c*K;
+        for(std::size_t i=c*chunk_size; i<std::min(n, (c+1)*chunk_size); i++) count[uniform_index(K, lanes)]++;
+    }
+    //Bucket-major exclusive scan gives each chunk its output position in each bucket
+    std::vector<std::size_t> bucket_start(K+1);
+    std::size_t offset = 0;
+    for(std::size_t k=0; k<K; k++) {
+        bucket_start[k] = offset;
+        for(std::size_t c=0; c<C; c++) {
+            std::size_t t = pos[c*K+k];
+            pos[c*K+k] = offset;
+            offset += t;
+        }
+    }
+    bucket_start[K] = offset;
+    unsigned long long used = 0;
+    #pragma omp parallel for if(parallel) schedule(static) reduction(max:used)
+    for(std::size_t c=0; c<C; c++) {
+        RngT chunk_gen = substream(c);
+        LeapfrogEngine<RngT> lanes(chunk_gen);
+        std::size_t *next = pos.data() + c*K;
+        for(std::size_t i=c*chunk_size; i<std::min(n, (c+1)*chunk_size); i++) out[next[uniform_index(K, lanes)]++] = in[i];
+        used = std::max(used, lanes.consumed());
+    }
+    #pragma omp parallel for if(parallel) schedule(dynamic) reduction(max:used)
+    for(std::size_t k=0; k<K; k++) {
+        RngT bucket_gen = substream(C+k);
+        LeapfrogEngine<RngT> lanes(bucket_gen);
+        fisher_yates(out + bucket_start[k], bucket_start[k+1] - bucket_start[k], lanes);
+        used = std::max(used, lanes.consumed());
+    }
+    gen.jump(used*S);
+}
+
+} /* namespace parallel_rng::permutation */
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_PERMUTATION_H */
@@ -0,0 +1,273 @@
+/** @file Poisson.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Poisson, binomial, and negative binomial samplers with cheap per-parameter setup.
+ *
+ * Means below counts::rejection_min_mean (10) use sequential-search inversion from k=0, which costs one uniform and
+ * O(mean) multiplies.  For the binomial the mean is n*min(p,1-p), as p>1/2 is sampled as n minus a Binomial(n,1-p).
+ * Larger means use Hormann's transformed rejection with squeeze: PTRS for the Poisson and BTRS for the binomial.  These
+ * take two uniforms per attempt, accept around 90% of proposals by the squeeze alone, and otherwise compare against
+ * the log of the exact probability.  Setup is one sqrt and a few logs, so a distribution can be constructed for every
+ * element of a per-element parameter array.
+ *
+ * The exact test needs log(k!).  counts::log_factorial() reads it from a table for k<16 and uses the Stirling series
+ * beyond, with absolute error below 3e-12.  It avoids std::lgamma, which writes the global signgam on some platforms
+ * and so is not thread safe.
+ *
+ * Negative binomial variates are Poisson variates with a gamma distributed mean, which changes on every draw.  Draws
+ * whose gamma mean is below the inversion cutoff invert directly, needing only one exp.  Larger means pay the PTRS
+ * setup on every draw.
+ *
+ * References:
+ *  - W. Hormann. "The transformed rejection method for generating Poisson random variables".
+ *    Insurance: Mathematics and Economics 12(1), 1993.
+ *  - W. Hormann. "The generation of binomial random variates". J. Stat. Comput. Simul. 46(1-2), 1993.
+ */
+#ifndef _PARALLEL_RNG_POISSON_H
+#define _PARALLEL_RNG_POISSON_H
+
+#include <cstdint>
+#include <cmath>
+#include <array>
+#include <stdexcept>
+
+#include "ParallelRngManager/UnitUniform.h"
+#include "ParallelRngManager/Gamma.h"
+
+namespace parallel_rng {
+
+namespace counts {
+
+/** Means at and above this use transformed rejection instead of inversion */
+static const double rejection_min_mean = 10;
+
+/** log(k!) from a table for small k and the Stirling series otherwise */
+inline
+double log_factorial(double k)
+{
+    struct Table : std::array<double,16>
+    {
+        Table()
+        {
+            (*this)[0] = 0;
+            for(int i=1; i<16; i++) (*this)[i] = (*this)[i-1] + std::log(double(i));
+        }
+    };
+    static const Table table;
+    if(k < 16) return table[int(k)];
+    const double ik = 1/k, ik2 = ik*ik;
+    return (k + 0.5)*std::log(k) - k + 0.91893853320467274178 + ik*(1./12 - ik2*(1./360 - ik2/1260));
+}
+
+/** Poisson variate by sequential-search inversion.  exp_mean is exp(-mean). */
+template<class IntT, class RngT>
+IntT poisson_inversion(double mean, double exp_mean, UnitUniformDistribution<double> &uniform, RngT &gen)
+{
+    for(;;) {
+        double u = uniform(gen);
+        double p = exp_mean;
+        IntT k = 0;
+        while(u > p && p > 0) {
+            u -= p;
+            p *= mean / double(++k);
+        }
+        if(p > 0) return k; //Otherwise rounding left u beyond the total mass, so retry
+    }
+}
+
+} /* namespace parallel_rng::counts */
+
+/** @brief Poisson distribution.  Drop-in replacement for std::poisson_distribution. */
+template<class IntT=uint64_t>
+class PoissonDistribution
+{
+public:
+    using result_type = IntT;
+
+    explicit PoissonDistribution(double mean=1) : _mean{mean}
+    {
+        if(!(mean >= 0)) throw std::invalid_argument("PoissonDistribution: mean must be non-negative.");
+        if(mean < counts::rejection_min_mean) {
+            exp_mean = std::exp(-mean);
+        } else {
+            log_mean = std::log(mean);
+            b = 0.931 + 2.53*std::sqrt(mean);
+            a = -0.059 + 0.02483*b;
+            log_inv_alpha = std::log(1.1239 + 1.1328/(b - 3.4));
+            vr = 0.9277 - 3.6224/(b - 2);
+        }
+    }
+
+    double mean() const { return _mean; }
+    void reset() { } //Stateless
+
+    template<class RngT>
+    IntT operator()(RngT &gen)
+    {
+        if(_mean < counts::rejection_min_mean) return counts::poisson_inversion<IntT>(_mean, exp_mean, uniform, gen);
+        return ptrs(gen);
+    }
+
+    /** Fill [first,last) by calling operator() for each element */
+    template<class OutIt, class RngT>
+    void generate(OutIt first, OutIt last, RngT &gen)
+    { for(; first!=last; ++first) *first = (*this)(gen); }
+
+private:
+    double _mean;
+    double exp_mean = 0;
+    double log_mean = 0, a = 0, b = 0, log_inv_alpha = 0, vr = 0;
+    UnitUniformDistribution<double> uniform;
+
+    template<class RngT>
+    IntT ptrs(RngT &gen)
+    {
+        for(;;) {
+            double u = uniform(gen) - 0.5;
+            double v = uniform(gen);
+            double us = 0.5 - std::abs(u);
+            double k = std::floor((2*a/us + b)*u + _mean + 0.43);
+            if(k < 0) continue;
+            if(us >= 0.07 && v <= vr) return IntT(k);
+            if(us < 0.013 && v > us) continue;
+            if(std::log(v) + log_inv_alpha - std::log(a/(us*us) + b) <=
+               -_mean + k*log_mean - counts::log_factorial(k)) return IntT(k);
+        }
+    }
+};
+
+/** @brief Binomial distribution.  Drop-in replacement for std::binomial_distribution. */
+template<class IntT=uint64_t>
+class BinomialDistribution
+{
+public:
+    using result_type = IntT;
+
+    explicit BinomialDistribution(IntT trials=1, double p=0.5) : _t{trials}, _p{p}, flip{p > 0.5}
+    {
+        if(!(p >= 0 && p <= 1)) throw std::invalid_argument("BinomialDistribution: p must be in [0,1].");
+        const double pp = flip ? 1-p : p;
+        const double q = 1 - pp;
+        const double n = double(trials);
+        if(n*pp < counts::rejection_min_mean) {
+            s = pp / q;
+            a = (n + 1)*s;
+            r0 = std::pow(q, n);
+        } else {
+            const double spq = std::sqrt(n*pp*q);
+            b = 1.15 + 2.53*spq;
+            a = -0.0873 + 0.0248*b + 0.01*pp;
+            c = n*pp + 0.5;
+            vr = 0.92 - 4.2/b;
+            alpha = (2.83 + 5.1/b)*spq;
+            lpq = std::log(pp / q);
+            m = std::floor((n + 1)*pp);
+            h = counts::log_factorial(m) + counts::log_factorial(n - m);
+        }
+        rejection = n*pp >= counts::rejection_min_mean;
+    }
+
+    IntT t() const { return _t; }
+    double p() const { return _p; }
+    void reset() { } //Stateless
+
+    template<class RngT>
+    IntT operator()(RngT &gen)
+    {
+        IntT k = rejection ? btrs(gen) : inversion(gen);
+        return flip ? _t - k : k;
+    }
+
+    /** Fill [first,last) by calling operator() for each element */
+    template<class OutIt, class RngT>
+    void generate(OutIt first, OutIt last, RngT &gen)
+    { for(; first!=last; ++first) *first = (*this)(gen); }
+
+private:
+    IntT _t;
+    double _p;
+    bool flip; //Sample with 1-p so the rate is at most 1/2
+    bool rejection;
+    double s = 0, r0 = 0;
+    double a = 0, b = 0, c = 0, vr = 0, alpha = 0, lpq = 0, m = 0, h = 0;
+    UnitUniformDistribution<double> uniform;
+
+    template<class RngT>
+    IntT inversion(RngT &gen)
+    {
+        for(;;) {
+            double u = uniform(gen);
+            double r = r0;
+            IntT k = 0;
+            while(u > r && k < _t) {
+                u -= r;
+                k++;
+                r *= a/double(k) - s;
+            }
+            if(u <= r) return k; //Otherwise rounding left u beyond the total mass, so retry
+        }
+    }
+
+    template<class RngT>
+    IntT btrs(RngT &gen)
+    {
+        const double n = double(_t);
+        for(;;) {
+            double u = uniform(gen) - 0.5;
+            double v = uniform(gen);
+            double us = 0.5 - std::abs(u);
+            double k = std::floor((2*a/us + b)*u + c);
+            if(k < 0 || k > n) continue;
+            if(us >= 0.07 && v <= vr) return IntT(k);
+            v = std::log(v*alpha/(a/(us*us) + b));
+            if(v <= h - counts::log_factorial(k) - counts::log_factorial(n - k) + (k - m)*lpq) return IntT(k);
+        }
+    }
+};
+
+/** @brief Negative binomial distribution with the given mean and size (dispersion) parameter.
+ *
+ * Sampled as Poisson(G) with G ~ Gamma(size, mean/size).  Equivalent to std::negative_binomial_distribution(k,p)
+ * with k=size and p=size/(size+mean), but size need not be an integer.  G < counts::rejection_min_mean is inverted
+ * directly.  Larger G constructs a PoissonDistribution per draw, costing a sqrt and two logs over the PTRS draw itself.
+ */
+template<class IntT=uint64_t>
+class NegativeBinomialDistribution
+{
+public:
+    using result_type = IntT;
+
+    explicit NegativeBinomialDistribution(double size=1, double mean=1)
+        : _size{size}, _mean{mean}, gamma{size, mean > 0 ? mean/size : 1}
+    {
+        if(!(mean >= 0)) throw std::invalid_argument("NegativeBinomialDistribution: mean must be non-negative.");
+    }
+
+    double size() const { return _size; }
+    double mean() const { return _mean; }
+    void reset() { } //Stateless
+
+    template<class RngT>
+    IntT operator()(RngT &gen)
+    {
+        if(_mean == 0) return 0;
+        double g = gamma(gen);
+        if(g < counts::rejection_min_mean) return counts::poisson_inversion<IntT>(g, std::exp(-g), uniform, gen);
+        return PoissonDistribution<IntT>(g)(gen);
+    }
+
+    /** Fill [first,last) by calling operator() for each element */
+    template<class OutIt, class RngT>
+    void generate(OutIt first, OutIt last, RngT &gen)
+    { for(; first!=last; ++first) *first = (*this)(gen); }
+
+private:
+    double _size;
+    double _mean;
+    GammaDistribution<double> gamma;
+    UnitUniformDistribution<double> uniform;
+};
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_POISSON_H */
@@ -0,0 +1,162 @@
+/** @file QuasiRng.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Sobol and Halton low-discrepancy sequences with random scrambling.
+ *
+ * Both sequences compute point n directly in O(dim log n), so any block of points can be generated by any thread
+ * without generating the points before it.  Within a block the Sobol sequence is generated in Gray code order,
+ * i.e., by the Antonov-Saleev method, with one XOR per dimension per point.  Points are written as the columns of a
+ * dim x n column-major array.
+ *
+ * Scrambling randomizes the points while keeping their stratification, so independent scrambles give unbiased
+ * estimates with an error estimate.  QuasiScramble::Owen uses the usual cheap substitutes for Owen's nested
+ * scrambling: Matousek's linear matrix scramble plus a digital shift for Sobol, and an independent random permutation
+ * of the digits at each position for Halton.
+ *
+ * References:
+ *  - S. Joe and F. Y. Kuo. "Constructing Sobol sequences with better two-dimensional projections".
+ *    SIAM J. Sci. Comput. 30(5), 2008.  Direction numbers new-joe-kuo-6.21201.
+ *  - I. A. Antonov and V. M. Saleev. "An economic method of computing LP-tau sequences".
+ *    USSR Comput. Math. Math. Phys. 19(1), 1979.
+ *  - J. Matousek. "On the L2-discrepancy for anchored boxes". J. Complexity 14(4), 1998.
+ */
+#ifndef _PARALLEL_RNG_QUASIRNG_H
+#define _PARALLEL_RNG_QUASIRNG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "ParallelRngManager/ParallelRngManager.h"
+
+namespace parallel_rng {
+
+/** Randomization applied to a quasi-random sequence */
+enum class QuasiScramble {
+    None,         ///< Unrandomized sequence.  The first point is the origin.
+    DigitalShift, ///< Random digit-wise shift of each dimension
+    Owen          ///< Random digit scrambling.  See QuasiRng.h.
+};
+
+namespace quasi {
+
+/** Index of the lowest set bit of n>0 */
+inline
+unsigned lowest_bit(uint64_t n)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(n);
+#else
+    unsigned k = 0;
+    while(!(n & 1)) { n >>= 1; k++; }
+    return k;
+#endif
+}
+
+/** Largest FloatT less than 1 */
+template<class FloatT>
+FloatT max_below_one()
+{ return 1 - std::numeric_limits<FloatT>::epsilon()/2; }
+
+} /* namespace parallel_rng::quasi */
+
+/** @brief Sobol sequence with Joe-Kuo direction numbers and 64-bit precision */
+class SobolSequence
+{
+public:
+    /** Number of bits in each coordinate.  The sequence has 2^bits points. */
+    static constexpr IdxT bits = 64;
+
+    explicit SobolSequence(IdxT dim, QuasiScramble scramble=QuasiScramble::None, SeedT seed=0);
+
+    static IdxT max_dim();
+    IdxT dim() const { return _dim; }
+    QuasiScramble scramble() const { return _scramble; }
+
+    /** Write points begin, ..., begin+n-1 as the columns of out, a dim x n column-major array */
+    template<class FloatT>
+    void generate(uint64_t begin, IdxT n, FloatT *out) const;
+
+private:
+    IdxT _dim;
+    QuasiScramble _scramble;
+    std::vector<uint64_t> V; //V[k*dim+j] is direction number k of dimension j, with the most significant bit first
+    std::vector<uint64_t> shift;
+};
+
+/** @brief Halton sequence.  Dimension j is the radical inverse in the j-th prime base. */
+class HaltonSequence
+{
+public:
+    explicit HaltonSequence(IdxT dim, QuasiScramble scramble=QuasiScramble::None, SeedT seed=0);
+
+    static IdxT max_dim();
+    IdxT dim() const { return _dim; }
+    QuasiScramble scramble() const { return _scramble; }
+
+    /** Write points begin, ..., begin+n-1 as the columns of out, a dim x n column-major array */
+    template<class FloatT>
+    void generate(uint64_t begin, IdxT n, FloatT *out) const;
+
+private:
+    IdxT _dim;
+    QuasiScramble _scramble;
+    std::vector<uint64_t> base;
+    std::vector<IdxT> digits; //Digits computed in dimension j, the most with base^digits <= 2^53
+    std::vector<double> scale; //base^digits
+    std::vector<IdxT> perm_offset;
+    std::vector<uint32_t> perm; //perm[perm_offset[j] + k*base[j] + d] is the value of digit d at position k
+
+    double radical_inverse(IdxT j, uint64_t n) const;
+};
+
+template<class FloatT>
+void SobolSequence::generate(uint64_t begin, IdxT n, FloatT *out) const
+{
+    if(n == 0) return;
+    std::vector<uint64_t> x(shift);
+    uint64_t gray = begin ^ (begin >> 1);
+    for(IdxT k=0; gray; k++, gray >>= 1) {
+        if(gray & 1) for(IdxT j=0; j<_dim; j++) x[j] ^= V[k*_dim+j];
+    }
+    for(IdxT i=0;; i++) {
+        FloatT *point = out + i*_dim;
+        for(IdxT j=0; j<_dim; j++) point[j] = unit_uniform::unit_value<FloatT>(x[j]);
+        if(i+1 == n) break;
+        const uint64_t *v = V.data() + quasi::lowest_bit(begin+i+1)*_dim;
+        for(IdxT j=0; j<_dim; j++) x[j] ^= v[j];
+    }
+}
+
+template<class FloatT>
+void HaltonSequence::generate(uint64_t begin, IdxT n, FloatT *out) const
+{
+    for(IdxT i=0; i<n; i++) {
+        FloatT *point = out + i*_dim;
+        for(IdxT j=0; j<_dim; j++) point[j] = std::min(FloatT(radical_inverse(j, begin+i)), quasi::max_below_one<FloatT>());
+    }
+}
+
+/** Digits of n in base b, reversed after the radix point and permuted.  Exact, as the result is R/b^D for R < b^D <= 2^53. */
+inline
+double HaltonSequence::radical_inverse(IdxT j, uint64_t n) const
+{
+    const uint64_t b = base[j];
+    const IdxT D = digits[j];
+    uint64_t R = 0;
+    if(perm.empty()) {
+        IdxT k = 0;
+        for(; n && k<D; k++, n /= b) R = R*b + n%b;
+        for(; k<D; k++) R *= b;
+    } else {
+        const uint32_t *p = perm.data() + perm_offset[j];
+        for(IdxT k=0; k<D; k++, n /= b) R = R*b + p[k*b + n%b];
+    }
+    return double(R) / scale[j];
+}
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_QUASIRNG_H */
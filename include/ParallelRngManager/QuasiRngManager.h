@@ -0,0 +1,248 @@
+/** @file QuasiRngManager.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Per-thread quasi-random sampling for OpenMP, with the randu interface of ParallelRngManager.
+ *
+ * Each thread reads its own independently scrambled copy of the Sobol or Halton sequence from its start.  Thread 0
+ * uses the manager's seed and thread t>0 a seed derived from (seed, t), so the first 2^m points of any thread are a net
+ * in their own right, and the points of all threads together are independent randomized replicates.  Two threads'
+ * first 2^m points form a (1,m+1,2)-net in the first two Sobol dimensions, for example.
+ *
+ * Offsetting the threads within one unscrambled sequence does not work: point indices that differ only in high bits
+ * give points that differ only in low digits, so each thread would repeat the first thread's points almost exactly.
+ * Without scrambling there is only one sequence, so only thread 0 may draw from it.  The dim-only constructor therefore
+ * uses a digital shift with the fixed seed default_seed, so default-constructed managers work from any thread and are
+ * reproducible.
+ *
+ * randu_parallel() splits the next points of the calling thread's sequence into contiguous blocks over a new OpenMP
+ * team, each thread skipping directly to the start of its block.  That gives the same points as randu() for any
+ * number of threads.
+ */
+#ifndef _PARALLEL_RNG_QUASIRNGMANAGER_H
+#define _PARALLEL_RNG_QUASIRNGMANAGER_H
+
+#include <cstdint>
+
+#include <omp.h>
+#include <armadillo>
+
+#include "ParallelRngManager/ParallelRngManager.h"
+#include "ParallelRngManager/QuasiRng.h"
+
+namespace parallel_rng {
+
+template<class SequenceT=SobolSequence, class FloatT=double>
+class QuasiRngManager
+{
+public:
+    using VecT = arma::Col<FloatT>;
+    using MatT = arma::Mat<FloatT>;
+    /** Parallel fills with fewer than this many values run on the calling thread.  Output is identical either way. */
+    static constexpr IdxT parallel_min_size = 1<<14;
+    /** Scramble seed of the dim-only constructor */
+    static constexpr SeedT default_seed = 0;
+
+    /** Digitally shifted sequence with seed default_seed, usable from every thread.  Pass QuasiScramble::None to
+     * the other constructors for the unscrambled sequence, which only thread 0 may draw from.
+     */
+    explicit QuasiRngManager(IdxT dim);
+    QuasiRngManager(IdxT dim, QuasiScramble scramble, SeedT seed);
+    QuasiRngManager(IdxT dim, QuasiScramble scramble, SeedT seed, IdxT max_threads);
+
+    IdxT dim() const { return seq.dim(); }
+    QuasiScramble scramble() const { return seq.scramble(); }
+    SeedT seed() const { return _seed; }
+    const SequenceT& sequence() const { return seq; } // Sequence of thread 0
+    SequenceT thread_sequence(IdxT t) const; // Sequence of thread t
+
+    /* Position of the calling thread's next point in its sequence.  seek() skips directly to any position. */
+    uint64_t position();
+    void seek(uint64_t pos);
+    void reset(); // Return all threads to the start of their sequences
+
+    /* Points are columns */
+    VecT randu();
+    MatT randu(IdxT N);
+    void fill_randu(MatT &samp);
+
+    /* Parallel fills.  Identical to randu(N) and fill_randu(samp) for any number of threads.  Call from serial code. */
+    MatT randu_parallel(IdxT N);
+    void fill_randu_parallel(MatT &samp);
+
+private:
+    /** Scrambled sequence of one thread and the position of its next point */
+    struct ThreadSequence
+    {
+        SequenceT seq;
+        uint64_t pos;
+    };
+
+    SeedT _seed;
+    SequenceT seq;
+    IdxT num_threads;
+    std::size_t cache_alignment;
+    StreamTable<ThreadSequence> threads;
+
+    static SeedT thread_seed(SeedT seed, IdxT t);
+    IdxT thread_id();
+    ThreadSequence& thread_state(IdxT t);
+    void fill_points(ThreadSequence &state, FloatT *out, IdxT N, bool parallel);
+};
+
+template<class SequenceT, class FloatT>
+constexpr IdxT QuasiRngManager<SequenceT,FloatT>::parallel_min_size;
+
+template<class SequenceT, class FloatT>
+constexpr SeedT QuasiRngManager<SequenceT,FloatT>::default_seed;
+
+template<class SequenceT, class FloatT>
+QuasiRngManager<SequenceT,FloatT>::QuasiRngManager(IdxT dim) :
+    QuasiRngManager(dim, QuasiScramble::DigitalShift, default_seed, openmp_estimate_max_threads())
+{}
+
+template<class SequenceT, class FloatT>
+QuasiRngManager<SequenceT,FloatT>::QuasiRngManager(IdxT dim, QuasiScramble scramble, SeedT seed) :
+    QuasiRngManager(dim, scramble, seed, openmp_estimate_max_threads())
+{}
+
+template<class SequenceT, class FloatT>
+QuasiRngManager<SequenceT,FloatT>::QuasiRngManager(IdxT dim, QuasiScramble scramble, SeedT seed, IdxT max_threads) :
+    _seed(seed),
+    seq(dim, scramble, seed),
+    num_threads(max_threads),
+    cache_alignment{aligned_array::alignment::estimate_cache_alignment()},
+    threads{num_threads, cache_alignment}
+{ }
+
+template<class SequenceT, class FloatT>
+SequenceT QuasiRngManager<SequenceT,FloatT>::thread_sequence(IdxT t) const
+{
+    if(t == 0) return seq;
+    if(scramble() == QuasiScramble::None)
+        throw ParallelRngManagerError("QuasiRngManager: an unscrambled sequence cannot be shared by multiple threads.");
+    return SequenceT(dim(), scramble(), thread_seed(_seed, t));
+}
+
+template<class SequenceT, class FloatT>
+uint64_t QuasiRngManager<SequenceT,FloatT>::position()
+{
+    return thread_state(thread_id()).pos;
+}
+
+template<class SequenceT, class FloatT>
+void QuasiRngManager<SequenceT,FloatT>::seek(uint64_t pos)
+{
+    thread_state(thread_id()).pos = pos;
+}
+
+template<class SequenceT, class FloatT>
+void QuasiRngManager<SequenceT,FloatT>::reset()
+{
+    threads.for_each([](std::size_t, ThreadSequence &state) { state.pos = 0; });
+}
+
+/**Next point of the calling thread */
+template<class SequenceT, class FloatT>
+typename QuasiRngManager<SequenceT,FloatT>::VecT
+QuasiRngManager<SequenceT,FloatT>::randu()
+{
+    VecT samp(dim());
+    fill_points(thread_state(thread_id()), samp.memptr(), 1, false);
+    return samp;
+}
+
+/**Next N points of the calling thread as the columns of a dim x N matrix */
+template<class SequenceT, class FloatT>
+typename QuasiRngManager<SequenceT,FloatT>::MatT
+QuasiRngManager<SequenceT,FloatT>::randu(IdxT N)
+{
+    MatT samp(dim(), N);
+    fill_randu(samp);
+    return samp;
+}
+
+/**Fill the columns of samp with the next points of the calling thread.  samp must have dim() rows. */
+template<class SequenceT, class FloatT>
+void QuasiRngManager<SequenceT,FloatT>::fill_randu(MatT &samp)
+{
+    if(samp.n_rows != dim()) throw ParallelRngManagerError("QuasiRngManager: samp rows do not match dimension.");
+    fill_points(thread_state(thread_id()), samp.memptr(), samp.n_cols, false);
+}
+
+/**Next N points of the calling thread generated in parallel */
+template<class SequenceT, class FloatT>
+typename QuasiRngManager<SequenceT,FloatT>::MatT
+QuasiRngManager<SequenceT,FloatT>::randu_parallel(IdxT N)
+{
+    MatT samp(dim(), N);
+    fill_randu_parallel(samp);
+    return samp;
+}
+
+/**Fill the columns of samp with the next points of the calling thread in parallel.  Identical to fill_randu(samp). */
+template<class SequenceT, class FloatT>
+void QuasiRngManager<SequenceT,FloatT>::fill_randu_parallel(MatT &samp)
+{
+    if(samp.n_rows != dim()) throw ParallelRngManagerError("QuasiRngManager: samp rows do not match dimension.");
+    fill_points(thread_state(thread_id()), samp.memptr(), samp.n_cols, true);
+}
+
+/** Thread number in the innermost team with more than one thread.  Nested teams would share sequences, so only one
+ * enclosing team may have more than one thread.
+ */
+template<class SequenceT, class FloatT>
+IdxT QuasiRngManager<SequenceT,FloatT>::thread_id()
+{
+    IdxT t = 0;
+    bool found = false;
+    for(int l=1; l<=omp_get_level(); l++) {
+        if(omp_get_team_size(l) == 1) continue;
+        if(found) throw ParallelRngManagerError("QuasiRngManager: nested parallel teams are not supported.");
+        t = omp_get_ancestor_thread_num(l);
+        found = true;
+    }
+    return t;
+}
+
+/** Scramble seed of thread t>0, from a SplitMix64 finalizer of seed and t */
+template<class SequenceT, class FloatT>
+SeedT QuasiRngManager<SequenceT,FloatT>::thread_seed(SeedT seed, IdxT t)
+{
+    uint64_t z = seed + uint64_t(t)*0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+template<class SequenceT, class FloatT>
+typename QuasiRngManager<SequenceT,FloatT>::ThreadSequence&
+QuasiRngManager<SequenceT,FloatT>::thread_state(IdxT t)
+{
+    return threads.get(t, [this](IdxT n) { return ThreadSequence{thread_sequence(n), 0}; });
+}
+
+/** Write the next N points of a thread's sequence to out, and advance its position.
+ *
+ * In parallel, each thread of a new team skips directly to its own contiguous block of the N points.
+ */
+template<class SequenceT, class FloatT>
+void QuasiRngManager<SequenceT,FloatT>::fill_points(ThreadSequence &state, FloatT *out, IdxT N, bool parallel)
+{
+    if(N > ~uint64_t(0) - state.pos) throw ParallelRngManagerError("QuasiRngManager: thread sequence exhausted.");
+    const uint64_t start = state.pos;
+    const SequenceT &thread_seq = state.seq;
+    const IdxT d = dim();
+    #pragma omp parallel if(parallel && N*d >= parallel_min_size)
+    {
+        IdxT nthreads = omp_get_num_threads();
+        IdxT b = omp_get_thread_num();
+        IdxT begin = N*b/nthreads;
+        IdxT end = N*(b+1)/nthreads;
+        thread_seq.generate(start + begin, end - begin, out + begin*d);
+    }
+    state.pos += N;
+}
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_QUASIRNGMANAGER_H */
@@ -0,0 +1,149 @@
+/** @file Resampling.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Deterministic kernels for low-variance particle filter resampling.
+ *
+ * The random parts of each scheme are drawn by ParallelRngManager::resample().  These kernels map sorted points
+ * in [0,1) onto cumulative weights and convert between offspring counts and sorted ancestor indices.  All are
+ * O(N+K) and split over the OpenMP team using fixed-size blocks, so results do not depend on the number of threads.
+ */
+#ifndef _PARALLEL_RNG_RESAMPLING_H
+#define _PARALLEL_RNG_RESAMPLING_H
+
+#include <cmath>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+
+#include <omp.h>
+#include <armadillo>
+
+#include "ParallelRngManager/ParallelScan.h"
+
+namespace parallel_rng {
+
+/** Resampling schemes for ParallelRngManager::resample() and resample_counts() */
+enum class ResampleScheme {
+    Systematic, ///< Single uniform offset u, points (u+n)/N
+    Stratified, ///< Independent uniform in each stratum, points (u_n+n)/N
+    Residual    ///< floor(N*p_k) deterministic copies, remainder by multinomial sampling of the residual weights
+};
+
+namespace resampling {
+
+/** Normalized weights p[0..K) and their cumulative sums C[0..K], with C[0]=0 and C[K]=1 */
+template<class Weights>
+void normalize_weights(const Weights &weights, std::vector<double> &p, std::vector<double> &C, bool parallel)
+{
+    auto w = weights.begin();
+    const std::size_t K = std::distance(weights.begin(), weights.end());
+    if(K == 0) throw std::invalid_argument("resampling: weights are empty.");
+    p.resize(K);
+    bool valid = true;
+    #pragma omp parallel for if(parallel) reduction(&&:valid)
+    for(std::size_t k=0; k<K; k++) {
+        p[k] = w[k];
+        valid = valid && std::isfinite(p[k]) && p[k] >= 0;
+    }
+    double W = scan::block_sum(p.data(), K, parallel);
+    if(!valid || !(W > 0) || !std::isfinite(W)) throw std::invalid_argument("resampling: weights must be finite, non-negative, and not all zero.");
+    C.resize(K+1);
+    C[0] = 0;
+    #pragma omp parallel for if(parallel)
+    for(std::size_t k=0; k<K; k++) C[k+1] = p[k] = p[k] / W;
+    scan::block_prefix_sum(C.data()+1, K, parallel);
+    //Trailing zero-weight categories get empty intervals at 1, so rounding can never select them
+    for(std::size_t k=K; k>0 && p[k-1]==0; k--) C[k-1] = 1;
+    C[K] = 1;
+}
+
+/** Largest point strictly less than 1 */
+inline
+double max_point()
+{ return std::nextafter(1.0, 0.0); }
+
+/** Offspring counts for systematic points (u+n)/N, n=0..N-1.  O(K) with no search. */
+template<class IdxT>
+void systematic_counts(const std::vector<double> &C, IdxT N, double u, IdxT *counts, bool parallel)
+{
+    const std::size_t K = C.size()-1;
+    //Number of points strictly below c
+    auto below = [N,u](double c) -> IdxT {
+        double n = std::ceil(N*c - u);
+        return n <= 0 ? 0 : (n >= N ? N : IdxT(n));
+    };
+    #pragma omp parallel for if(parallel)
+    for(std::size_t k=0; k<K; k++) counts[k] = below(C[k+1]) - below(C[k]);
+}
+
+/** Category k of x with C[k] <= x < C[k+1], searching up from hint */
+template<class IdxT>
+IdxT walk_category(const std::vector<double> &C, double x, IdxT hint)
+{
+    const IdxT last = C.size()-2;
+    x = std::min(x, max_point());
+    while(hint < last && C[hint+1] <= x) hint++;
+    return hint;
+}
+
+/** Category of x by binary search */
+template<class IdxT>
+IdxT find_category(const std::vector<double> &C, double x)
+{
+    IdxT k = std::upper_bound(C.begin()+1, C.end(), std::min(x, max_point())) - C.begin() - 1;
+    return std::min(k, IdxT(C.size()-2));
+}
+
+/** Offspring counts[0..K) from sorted ancestor indices idx[0..N) by run-length counting.
+ *
+ * Runs that lie inside a block of idx belong to no other block and are stored directly.  The first and last run of
+ * each block may continue into its neighbours, so they are added afterwards in block order.
+ */
+template<class IdxT>
+void indices_to_counts(const IdxT *idx, IdxT N, IdxT *counts, IdxT K, bool parallel)
+{
+    #pragma omp parallel for if(parallel)
+    for(IdxT k=0; k<K; k++) counts[k] = 0;
+    const IdxT nblocks = scan::num_blocks(N);
+    std::vector<IdxT> first(nblocks), first_len(nblocks), last(nblocks), last_len(nblocks);
+    #pragma omp parallel for if(parallel)
+    for(IdxT b=0; b<nblocks; b++) {
+        const IdxT begin = b*scan::block_size;
+        const IdxT end = std::min<IdxT>(N, (b+1)*scan::block_size);
+        IdxT n = begin;
+        while(n < end && idx[n] == idx[begin]) n++;
+        first[b] = last[b] = idx[begin];
+        first_len[b] = n - begin;
+        last_len[b] = 0;
+        while(n < end) {
+            const IdxT run = n;
+            while(n < end && idx[n] == idx[run]) n++;
+            if(n < end) counts[idx[run]] = n - run;
+            else {
+                last[b] = idx[run];
+                last_len[b] = n - run;
+            }
+        }
+    }
+    for(IdxT b=0; b<nblocks; b++) {
+        counts[first[b]] += first_len[b];
+        counts[last[b]] += last_len[b];
+    }
+}
+
+/** Sorted ancestor indices from offspring counts[0..K).  idx must have space for sum(counts). */
+template<class IdxT>
+void counts_to_indices(const IdxT *counts, IdxT K, IdxT *idx, bool parallel)
+{
+    std::vector<IdxT> offset(counts, counts+K);
+    scan::block_prefix_sum(offset.data(), K, parallel);
+    #pragma omp parallel for if(parallel)
+    for(IdxT k=0; k<K; k++) std::fill(idx+offset[k]-counts[k], idx+offset[k], k);
+}
+
+} /* namespace parallel_rng::resampling */
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_RESAMPLING_H */
@@ -0,0 +1,110 @@
+/** @file StreamPathIndex.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Lock-free map from hierarchical thread paths to dense StreamTable keys.
+ *
+ * A path (a_1, ..., a_d) gives a thread's number in each enclosing team, outermost first.  The index is a tree with
+ * one StreamTable of child nodes per node, so each level is addressed by the small thread numbers of that level.  Keys
+ * are handed out in order of first use starting at first_key, which keeps the StreamTables they index densely packed
+ * no matter how deep or wide the hierarchy is.  Keys identify storage only, so they need not be reproducible.
+ */
+#ifndef _PARALLEL_RNG_STREAMPATHINDEX_H
+#define _PARALLEL_RNG_STREAMPATHINDEX_H
+
+#include <cstddef>
+#include <atomic>
+#include <limits>
+#include <vector>
+
+#include "ParallelRngManager/StreamTable.h"
+
+namespace parallel_rng {
+
+class StreamPathIndex
+{
+public:
+    using size_type = std::size_t;
+
+    StreamPathIndex(size_type first_key, size_type align = aligned_array::alignment::default_cache_alignment())
+        : roots{first_key, align}, next_key{first_key}
+    { }
+
+    StreamPathIndex(const StreamPathIndex &o) : roots{o.roots}, next_key{o.next_key.load()} { }
+
+    StreamPathIndex& operator=(const StreamPathIndex &o)
+    {
+        if(&o == this) return *this; //self assignment guard
+        roots = o.roots;
+        next_key = o.next_key.load();
+        return *this;
+    }
+
+    /** Key of the path ids[0], ..., ids[depth-1], assigned on first use.  Safe to call concurrently. */
+    template<class IdT>
+    size_type key(const IdT *ids, size_type depth)
+    {
+        auto make = [](size_type) { return Node{}; };
+        Node *node = &roots.get(ids[0], make);
+        for(size_type l=1; l<depth; l++) node = &node->child_table(roots.base_size(), roots.align()).get(ids[l], make);
+        size_type k = node->key.load(std::memory_order_acquire);
+        if(k != no_key) return k;
+        size_type new_key = next_key.fetch_add(1, std::memory_order_relaxed);
+        //If another thread won the race its key is kept, and new_key is never used
+        return node->key.compare_exchange_strong(k, new_key, std::memory_order_acq_rel) ? new_key : k;
+    }
+
+    /** Call f(ids, depth, key) for each path that has been assigned a key.  Must not run concurrently with key(). */
+    template<class FuncT>
+    void for_each(FuncT &&f) const
+    {
+        std::vector<size_type> ids;
+        roots.for_each([&](size_type id, const Node &node) { visit(node, id, ids, f); });
+    }
+
+private:
+    static constexpr size_type no_key = std::numeric_limits<size_type>::max();
+
+    struct Node
+    {
+        std::atomic<size_type> key;
+        std::atomic<StreamTable<Node>*> children;
+
+        Node() : key{no_key}, children{nullptr} { }
+        Node(const Node &o) : key{o.key.load()}, children{nullptr}
+        {
+            auto c = o.children.load();
+            if(c) children.store(new StreamTable<Node>(*c));
+        }
+        ~Node() { delete children.load(); }
+
+        /** Table of child nodes, installed on first use */
+        StreamTable<Node>& child_table(size_type base, size_type align)
+        {
+            StreamTable<Node> *c = children.load(std::memory_order_acquire);
+            if(c) return *c;
+            auto table = new StreamTable<Node>(base, align);
+            if(children.compare_exchange_strong(c, table, std::memory_order_acq_rel, std::memory_order_acquire))
+                return *table;
+            delete table;
+            return *c;
+        }
+    };
+
+    template<class FuncT>
+    static void visit(const Node &node, size_type id, std::vector<size_type> &ids, FuncT &f)
+    {
+        ids.push_back(id);
+        size_type k = node.key.load(std::memory_order_acquire);
+        if(k != no_key) f(ids.data(), ids.size(), k);
+        const StreamTable<Node> *c = node.children.load(std::memory_order_acquire);
+        if(c) c->for_each([&](size_type child_id, const Node &child) { visit(child, child_id, ids, f); });
+        ids.pop_back();
+    }
+
+    StreamTable<Node> roots;
+    std::atomic<size_type> next_key;
+};
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_STREAMPATHINDEX_H */
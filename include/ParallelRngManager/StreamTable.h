@@ -0,0 +1,299 @@
+/** @file StreamTable.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Lock-free, growable table of per-thread state that is materialized on first use.
+ *
+ * Slots are stored in segments of geometrically increasing size.  Segment k holds base*2^k slots in a cache-aligned
+ * AArray, so no two slots share a cache line and existing elements never move as the table grows.  Segments are
+ * installed with a compare-and-swap, and each slot is constructed exactly once by the first thread to touch it, so any
+ * number of threads may make their first access concurrently without locks.
+ *
+ * With StreamPlacement::NumaLocal, slots are page aligned and each slot's pages are bound to the NUMA node of the
+ * thread that materializes it, just before construction.
+ *
+ * Segment buffers come from AllocT, an AArray allocation policy, e.g., HugePageAllocator for large tables, or an
+ * ArenaAllocator to keep all stream state in a preallocated arena.
+ */
+#ifndef _PARALLEL_RNG_STREAMTABLE_H
+#define _PARALLEL_RNG_STREAMTABLE_H
+
+#include <cstddef>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+#include "ParallelRngManager/AlignedArray/AArray.h"
+#include "ParallelRngManager/Numa.h"
+
+namespace parallel_rng {
+
+template<class T, class AllocT=aligned_array::AlignedAllocator>
+class StreamTable
+{
+public:
+    using value_type = T;
+    using allocator_type = AllocT;
+    using size_type = std::size_t;
+    /** Maximum number of segments.  The table holds at most (2^max_segments - 1)*base_size() elements. */
+    static constexpr size_type max_segments = 32;
+
+    explicit StreamTable(size_type base_size, size_type align = aligned_array::alignment::default_cache_alignment(),
+                         StreamPlacement placement = StreamPlacement::Cache, const AllocT &alloc = AllocT())
+        : base{base_size ? base_size : 1},
+          _align{placement == StreamPlacement::NumaLocal ? std::max(align, numa::page_size()) : align},
+          _placement{placement},
+          alloc(alloc)
+    {
+        for(auto &seg: segments) seg.store(nullptr, std::memory_order_relaxed);
+    }
+
+    StreamTable(const StreamTable &o) : StreamTable(o.base, o._align, o._placement, o.alloc) { copy_from(o); }
+
+    StreamTable(StreamTable &&o) noexcept : base{o.base}, _align{o._align}, _placement{o._placement}, alloc(o.alloc)
+    { steal(o); }
+
+    StreamTable& operator=(const StreamTable &o)
+    {
+        if(&o == this) return *this; //self assignment guard
+        free_segments();
+        base = o.base;
+        _align = o._align;
+        _placement = o._placement;
+        alloc = o.alloc;
+        copy_from(o);
+        return *this;
+    }
+
+    StreamTable& operator=(StreamTable &&o) noexcept
+    {
+        if(&o == this) return *this; //self assignment guard
+        free_segments();
+        base = o.base;
+        _align = o._align;
+        _placement = o._placement;
+        alloc = o.alloc;
+        steal(o);
+        return *this;
+    }
+
+    ~StreamTable() { free_segments(); }
+
+    size_type base_size() const noexcept { return base; }
+    size_type align() const noexcept { return _align; }
+    StreamPlacement placement() const noexcept { return _placement; }
+    allocator_type get_allocator() const { return alloc; }
+
+    /** Element n, constructed from make(n) if this is its first use.
+     *
+     * Concurrent first calls for the same n construct it once, and the others wait for that construction to finish.
+     */
+    template<class MakeT>
+    T& get(size_type n, MakeT &&make)
+    {
+        Slot &s = slot(n);
+        if(s.state.load(std::memory_order_acquire) != ready) materialize(s, n, make, _placement);
+        return s.value();
+    }
+
+    /** Element n if it has been materialized, otherwise nullptr */
+    const T* find(size_type n) const noexcept
+    {
+        size_type k = segment_of(n);
+        if(k >= max_segments) return nullptr;
+        const SegmentT *seg = segments[k].load(std::memory_order_acquire);
+        if(!seg) return nullptr;
+        const Slot &s = (*seg)[n - segment_offset(k)];
+        return s.state.load(std::memory_order_acquire) == ready ? &s.value() : nullptr;
+    }
+
+    T* find(size_type n) noexcept
+    { return const_cast<T*>(static_cast<const StreamTable&>(*this).find(n)); }
+
+    /** Number of materialized elements */
+    size_type size() const noexcept
+    {
+        size_type count = 0;
+        for(auto &seg: segments) {
+            SegmentT *p = seg.load(std::memory_order_acquire);
+            if(p) for(auto &s: *p) count += s.state.load(std::memory_order_acquire) == ready;
+        }
+        return count;
+    }
+
+    /** Call f(n, element) for each materialized element in order of n.  Must not run concurrently with get(). */
+    template<class FuncT>
+    void for_each(FuncT &&f) const
+    {
+        for(size_type k=0; k<max_segments; k++) {
+            const SegmentT *p = segments[k].load(std::memory_order_acquire);
+            if(!p) continue;
+            for(size_type i=0; i<p->size(); i++)
+                if((*p)[i].state.load(std::memory_order_acquire) == ready) f(segment_offset(k)+i, (*p)[i].value());
+        }
+    }
+
+    template<class FuncT>
+    void for_each(FuncT &&f)
+    {
+        for(size_type k=0; k<max_segments; k++) {
+            SegmentT *p = segments[k].load(std::memory_order_acquire);
+            if(!p) continue;
+            for(size_type i=0; i<p->size(); i++)
+                if((*p)[i].state.load(std::memory_order_acquire) == ready) f(segment_offset(k)+i, (*p)[i].value());
+        }
+    }
+
+    /** Destroy all materialized elements, keeping the allocated segments.  Must not run concurrently with get(). */
+    void clear() noexcept
+    {
+        for(auto &seg: segments) {
+            SegmentT *p = seg.load(std::memory_order_relaxed);
+            if(p) for(auto &s: *p) s.reset();
+        }
+    }
+
+private:
+    static constexpr int empty = 0;
+    static constexpr int constructing = 1;
+    static constexpr int ready = 2;
+
+    struct Slot
+    {
+        typename std::aligned_storage<sizeof(T),alignof(T)>::type storage;
+        std::atomic<int> state;
+
+        Slot() : state{empty} {}
+        T& value() noexcept { return *reinterpret_cast<T*>(&storage); }
+        const T& value() const noexcept { return *reinterpret_cast<const T*>(&storage); }
+        void reset() noexcept
+        {
+            if(state.load(std::memory_order_relaxed) != ready) return;
+            value().~T();
+            state.store(empty, std::memory_order_relaxed);
+        }
+    };
+    using SegmentT = aligned_array::AArray<Slot,AllocT>;
+
+    size_type base;
+    size_type _align;
+    StreamPlacement _placement;
+    AllocT alloc;
+    std::array<std::atomic<SegmentT*>,max_segments> segments;
+
+    /** Segment k holds indices [base*(2^k-1), base*(2^(k+1)-1)) */
+    size_type segment_of(size_type n) const noexcept
+    {
+        size_type q = n/base + 1;
+        if(!q) return max_segments; //Overflow
+        size_type k = 0;
+        while(q >>= 1) k++;
+        return k;
+    }
+
+    size_type segment_offset(size_type k) const noexcept { return base*((size_type(1)<<k) - 1); }
+
+    Slot& slot(size_type n)
+    {
+        if(n < base) { //Fast path for the first segment
+            SegmentT *seg = segments[0].load(std::memory_order_acquire);
+            return (*(seg ? seg : grow(0)))[n];
+        }
+        size_type k = segment_of(n);
+        if(k >= max_segments) throw std::out_of_range("StreamTable: index too large.");
+        SegmentT *seg = segments[k].load(std::memory_order_acquire);
+        return (*(seg ? seg : grow(k)))[n - segment_offset(k)];
+    }
+
+    /** Install segment k.  If another thread wins the race, use its segment instead. */
+    SegmentT* grow(size_type k)
+    {
+        SegmentT *seg = new SegmentT(base<<k, _align, alloc);
+        seg->fill();
+        SegmentT *expected = nullptr;
+        if(segments[k].compare_exchange_strong(expected, seg, std::memory_order_acq_rel, std::memory_order_acquire))
+            return seg;
+        delete seg;
+        return expected;
+    }
+
+    template<class MakeT>
+    static void materialize(Slot &s, size_type n, MakeT &make, StreamPlacement placement)
+    {
+        for(;;) {
+            int st = s.state.load(std::memory_order_acquire);
+            if(st == ready) return;
+            if(st == empty && s.state.compare_exchange_weak(st, constructing, std::memory_order_acquire)) {
+                if(placement == StreamPlacement::NumaLocal && numa::num_nodes() > 1) {
+                    //Slot pages are not shared with other slots, so move them to this thread's node
+                    const size_type page = numa::page_size();
+                    numa::bind_local(&s, (sizeof(Slot) + page - 1)/page*page);
+                }
+                try {
+                    new(&s.storage) T(make(n));
+                } catch(...) {
+                    s.state.store(empty, std::memory_order_release); //Let another caller retry
+                    throw;
+                }
+                s.state.store(ready, std::memory_order_release);
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    void copy_from(const StreamTable &o)
+    {
+        for(size_type k=0; k<max_segments; k++) {
+            const SegmentT *p = o.segments[k].load(std::memory_order_acquire);
+            if(!p) {
+                segments[k].store(nullptr, std::memory_order_relaxed);
+                continue;
+            }
+            SegmentT *seg = new SegmentT(base<<k, _align, alloc);
+            seg->fill();
+            for(size_type i=0; i<p->size(); i++) {
+                if((*p)[i].state.load(std::memory_order_acquire) != ready) continue;
+                new(&(*seg)[i].storage) T((*p)[i].value());
+                (*seg)[i].state.store(ready, std::memory_order_relaxed);
+            }
+            segments[k].store(seg, std::memory_order_release);
+        }
+    }
+
+    void steal(StreamTable &o) noexcept
+    {
+        for(size_type k=0; k<max_segments; k++) {
+            segments[k].store(o.segments[k].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            o.segments[k].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    void free_segments() noexcept
+    {
+        clear();
+        for(auto &seg: segments) {
+            delete seg.load(std::memory_order_relaxed);
+            seg.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+};
+
+template<class T, class AllocT>
+constexpr typename StreamTable<T,AllocT>::size_type StreamTable<T,AllocT>::max_segments;
+
+template<class T, class AllocT>
+constexpr int StreamTable<T,AllocT>::empty;
+
+template<class T, class AllocT>
+constexpr int StreamTable<T,AllocT>::constructing;
+
+template<class T, class AllocT>
+constexpr int StreamTable<T,AllocT>::ready;
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_STREAMTABLE_H */
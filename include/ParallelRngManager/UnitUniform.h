@@ -0,0 +1,222 @@
+/** @file UnitUniform.h
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Uniform samplers on [0,1) and (0,1] built directly from the bits of each engine value.
+ *
+ * std::uniform_real_distribution uses generate_canonical, which takes several engine values per double, divides in
+ * long double, and clamps.  Here a double is made from the high 53 bits and a float from the high 24 bits of a single
+ * word.  The high bits are placed in the mantissa of a number in [1,2), 1 is subtracted, and the last bit is added
+ * back, giving exactly m*2^-p for the p-bit integer m.  This needs only integer ops and float adds, so the bulk
+ * conversion loops vectorize without a packed 64-bit integer to float conversion.  (0,1] is computed exactly as 1-u.
+ *
+ * Full-range 64-bit engines use one value per sample, and generate() harvests two floats from each value.  Full-range
+ * 32-bit engines use one value per float and two per double.  Other engines fall back to std::generate_canonical.
+ */
+#ifndef _PARALLEL_RNG_UNITUNIFORM_H
+#define _PARALLEL_RNG_UNITUNIFORM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <type_traits>
+
+namespace parallel_rng {
+
+enum class UnitInterval { ClosedOpen, OpenClosed };
+
+namespace unit_uniform {
+
+/** Number of random bits in each value of RngT: 64 or 32 for full-range engines, otherwise 0 */
+template<class RngT>
+constexpr int word_bits()
+{
+    return uint64_t(RngT::max()) - uint64_t(RngT::min()) == std::numeric_limits<uint64_t>::max() ? 64 :
+           uint64_t(RngT::max()) - uint64_t(RngT::min()) == std::numeric_limits<uint32_t>::max() ? 32 : 0;
+}
+
+/** Smallest k>=k0 with R^k >= 2^bits, given Rk = R^k0.  This is the number of values std::generate_canonical takes from
+ *  an engine with R distinct values to make a number with bits bits.
+ */
+constexpr std::size_t canonical_draws(long double R, long double Rk, long double two_bits, std::size_t k0=1)
+{
+    return Rk >= two_bits ? k0 : canonical_draws(R, Rk*R, two_bits, k0+1);
+}
+
+/** Uniform on [0,1) from the high 53 bits of a 64-bit word */
+inline
+double unit_double(uint64_t bits)
+{
+    uint64_t m = (bits >> 12) | UINT64_C(0x3FF0000000000000);
+    double x;
+    std::memcpy(&x, &m, sizeof(x));
+    return (x - 1) + double((bits >> 11) & 1) * (1.0 / 9007199254740992.0);
+}
+
+/** Uniform on [0,1) from the high 24 bits of a 32-bit word */
+inline
+float unit_float(uint32_t bits)
+{
+    uint32_t m = (bits >> 9) | UINT32_C(0x3F800000);
+    float x;
+    std::memcpy(&x, &m, sizeof(x));
+    return (x - 1) + float((bits >> 8) & 1) * (1.0f / 16777216.0f);
+}
+
+/** Uniform on [0,1) from the high mantissa bits of a 64-bit word */
+template<class FloatT>
+FloatT unit_value(uint64_t bits);
+
+template<>
+inline
+double unit_value<double>(uint64_t bits) { return unit_double(bits); }
+
+template<>
+inline
+float unit_value<float>(uint64_t bits) { return unit_float(uint32_t(bits >> 32)); }
+
+/** True if RngT has a bulk generate(out,n) writing its next n values, as CounterEngine and LeapfrogEngine do */
+template<class RngT, class=void>
+struct has_bulk_generate : std::false_type {};
+
+template<class RngT>
+struct has_bulk_generate<RngT, decltype(std::declval<RngT&>().generate(std::declval<typename RngT::result_type*>(),
+                                                                         std::size_t()))> : std::true_type {};
+
+/** Write the next n values of gen to words */
+template<class RngT>
+void draw_words(RngT &gen, typename RngT::result_type *words, std::size_t n, std::true_type)
+{ gen.generate(words, n); }
+
+template<class RngT>
+void draw_words(RngT &gen, typename RngT::result_type *words, std::size_t n, std::false_type)
+{
+    for(std::size_t i=0; i<n; i++) words[i] = gen();
+}
+
+} /* namespace parallel_rng::unit_uniform */
+
+/** @brief Uniform distribution on [0,1) or (0,1] for float or double, following the std random distribution interface.
+ *
+ * Stateless, so it can be freely copied between threads.  generate() writes a block of samples identical to repeated
+ * calls of operator(), except for FloatT=float on a 64-bit engine, where each engine value gives two samples.
+ */
+template<class FloatT=double, UnitInterval Interval=UnitInterval::ClosedOpen>
+class UnitUniformDistribution
+{
+    static_assert(std::is_same<FloatT,float>::value || std::is_same<FloatT,double>::value,
+                  "UnitUniformDistribution: FloatT must be float or double.");
+public:
+    using result_type = FloatT;
+
+    /** Samples generate() makes from each engine value.  2 for float on a full-range 64-bit engine, otherwise 1. */
+    template<class RngT>
+    static constexpr std::size_t samples_per_draw()
+    { return std::is_same<FloatT,float>::value && unit_uniform::word_bits<RngT>() == 64 ? 2 : 1; }
+
+    /** Engine values each operator() sample consumes.  1, except 2 for double on a full-range 32-bit engine, and as
+     *  many as generate_canonical needs on other engines.
+     */
+    template<class RngT>
+    static constexpr std::size_t draws_per_sample()
+    {
+        return unit_uniform::word_bits<RngT>() == 64 ? 1 :
+               unit_uniform::word_bits<RngT>() == 32 ? (std::numeric_limits<FloatT>::digits <= 32 ? 1 : 2) :
+               unit_uniform::canonical_draws(static_cast<long double>(RngT::max() - RngT::min()) + 1,
+                                             static_cast<long double>(RngT::max() - RngT::min()) + 1,
+                                             static_cast<long double>(uint64_t(1) << std::numeric_limits<FloatT>::digits));
+    }
+
+    void reset() { }
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return 1; }
+
+    template<class RngT>
+    result_type operator()(RngT &gen)
+    { return interval(draw(gen, WordTag<RngT>{})); }
+
+    /** Write n samples to out.  Consumes n engine values, or ceil(n/2) when samples_per_draw() is 2. */
+    template<class RngT>
+    void generate(result_type *out, std::size_t n, RngT &gen)
+    { generate(out, n, gen, WordTag<RngT>{}); }
+
+private:
+    template<class RngT>
+    using WordTag = std::integral_constant<int, unit_uniform::word_bits<RngT>()>;
+    using Word64 = std::integral_constant<int, 64>;
+    using Word32 = std::integral_constant<int, 32>;
+
+    static constexpr std::size_t block_words = 128;
+
+    static result_type interval(result_type u) { return Interval == UnitInterval::ClosedOpen ? u : 1 - u; }
+
+    template<class RngT>
+    static result_type draw(RngT &gen, Word64)
+    { return unit_uniform::unit_value<FloatT>(uint64_t(gen()) - uint64_t(RngT::min())); }
+
+    template<class RngT>
+    static result_type draw(RngT &gen, Word32)
+    {
+        uint64_t hi = uint32_t(gen() - RngT::min());
+        if(std::numeric_limits<FloatT>::digits <= 32) return unit_uniform::unit_value<FloatT>(hi << 32);
+        return unit_uniform::unit_value<FloatT>((hi << 32) | uint32_t(gen() - RngT::min()));
+    }
+
+    template<class RngT, int Bits>
+    static result_type draw(RngT &gen, std::integral_constant<int,Bits>)
+    { return std::generate_canonical<FloatT, std::numeric_limits<FloatT>::digits>(gen); }
+
+    /** Draw words into a block buffer, then convert the block in a vectorizable loop.  Engines with a bulk
+     * generate() fill the buffer directly.
+     */
+    template<class RngT>
+    void generate(result_type *out, std::size_t n, RngT &gen, Word64)
+    {
+        constexpr std::size_t S = samples_per_draw<RngT>();
+        alignas(64) typename RngT::result_type words[block_words];
+        while(n) {
+            std::size_t m = std::min(n, S*block_words);
+            std::size_t nwords = (m + S - 1) / S;
+            unit_uniform::draw_words(gen, words, nwords, unit_uniform::has_bulk_generate<RngT>{});
+            convert(words, uint64_t(RngT::min()), out, m, std::integral_constant<bool, S == 2>{});
+            out += m;
+            n -= m;
+        }
+    }
+
+    template<class RngT, int Bits>
+    void generate(result_type *out, std::size_t n, RngT &gen, std::integral_constant<int,Bits>)
+    {
+        for(std::size_t i=0; i<n; i++) out[i] = (*this)(gen);
+    }
+
+    /** Convert engine values, less the engine minimum min_word */
+    template<class WordT>
+    static void convert(const WordT *words, uint64_t min_word, result_type *out, std::size_t m, std::false_type)
+    {
+        #pragma omp simd
+        for(std::size_t i=0; i<m; i++) out[i] = interval(unit_uniform::unit_value<FloatT>(uint64_t(words[i]) - min_word));
+    }
+
+    /** Two floats per word, high half first */
+    template<class WordT>
+    static void convert(const WordT *words, uint64_t min_word, result_type *out, std::size_t m, std::true_type)
+    {
+        #pragma omp simd
+        for(std::size_t i=0; i<m/2; i++) {
+            uint64_t w = uint64_t(words[i]) - min_word;
+            out[2*i] = interval(unit_uniform::unit_float(uint32_t(w >> 32)));
+            out[2*i+1] = interval(unit_uniform::unit_float(uint32_t(w)));
+        }
+        if(m % 2) out[m-1] = interval(unit_uniform::unit_float(uint32_t((uint64_t(words[m/2]) - min_word) >> 32)));
+    }
+};
+
+template<class FloatT, UnitInterval Interval>
+constexpr std::size_t UnitUniformDistribution<FloatT,Interval>::block_words;
+
+} /* namespace parallel_rng */
+
+#endif /* _PARALLEL_RNG_UNITUNIFORM_H */
@@ -0,0 +1,60 @@
+/** @file Checkpoint.cpp
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Memory mapped checkpoint files
+ */
+
+#include <fstream>
+#include <iterator>
+#include "ParallelRngManager/ParallelRngManager.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #define PARALLEL_RNG_USE_MMAP
+#endif
+
+namespace parallel_rng {
+namespace checkpoint {
+
+MappedFile::MappedFile(const std::string &filename)
+    : _data{nullptr}, _size{0}, mapped{false}
+{
+#ifdef PARALLEL_RNG_USE_MMAP
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0) throw ParallelRngManagerError("Unable to open checkpoint file: "+filename);
+    struct stat st;
+    if(::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw ParallelRngManagerError("Unable to stat checkpoint file: "+filename);
+    }
+    _size = st.st_size;
+    if(_size > 0) {
+        void *p = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED) {
+            _data = static_cast<const char*>(p);
+            mapped = true;
+        }
+    }
+    ::close(fd);
+    if(mapped || _size == 0) return;
+#endif
+    //Fallback: read the whole file
+    std::ifstream in(filename, std::ios::binary);
+    if(!in) throw ParallelRngManagerError("Unable to open checkpoint file: "+filename);
+    buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    _data = buffer.data();
+    _size = buffer.size();
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef PARALLEL_RNG_USE_MMAP
+    if(mapped) ::munmap(const_cast<char*>(_data), _size);
+#endif
+}
+
+} /* namespace parallel_rng::checkpoint */
+} /* namespace parallel_rng */
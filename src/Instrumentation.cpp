@@ -0,0 +1,185 @@
+/** @file Instrumentation.cpp
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Instrumentation snapshots, JSON output, and the Linux perf_event_open backend
+ */
+
+#include <sstream>
+#include "ParallelRngManager/Instrumentation.h"
+
+#if defined(PARALLEL_RNG_INSTRUMENT_PERF) && defined(__linux__)
+    #include <cstring>
+    #include <linux/perf_event.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #define PARALLEL_RNG_USE_PERF_EVENTS
+#endif
+
+namespace parallel_rng {
+namespace instrument {
+
+const char* api_name(Api api)
+{
+    switch(api) {
+        case Api::Randu: return "randu";
+        case Api::Randn: return "randn";
+        case Api::FillRandu: return "fill_randu";
+        case Api::FillRandn: return "fill_randn";
+        case Api::ResampleDist: return "resample_dist";
+        case Api::FillResample: return "fill_resample";
+        case Api::FillRanduParallel: return "fill_randu_parallel";
+        case Api::FillRandnParallel: return "fill_randn_parallel";
+    }
+    return "unknown";
+}
+
+ApiCounters& ApiCounters::operator+=(const ApiCounters &o)
+{
+    calls += o.calls;
+    draws += o.draws;
+    bytes += o.bytes;
+    cycles += o.cycles;
+    cache_misses += o.cache_misses;
+    instructions += o.instructions;
+    return *this;
+}
+
+ApiCounters Snapshot::total(Api a) const
+{
+    ApiCounters sum;
+    for(auto &t: threads) sum += t[a];
+    return sum;
+}
+
+ThreadCounters Snapshot::total() const
+{
+    ThreadCounters sum;
+    for(auto &t: threads) for(std::size_t a=0; a<num_apis; a++) sum.api[a] += t.api[a];
+    return sum;
+}
+
+namespace {
+
+#if defined(__x86_64__) || defined(__i386__)
+const char *cycle_unit = "tsc";
+#else
+const char *cycle_unit = "ns";
+#endif
+
+void write_counters(std::ostream &out, const ApiCounters &c, bool ratios)
+{
+    out<<"{\"calls\":"<<c.calls<<",\"draws\":"<<c.draws<<",\"bytes\":"<<c.bytes<<",\"cycles\":"<<c.cycles
+       <<",\"cache_misses\":"<<c.cache_misses<<",\"instructions\":"<<c.instructions;
+    if(ratios && c.draws > 0) {
+        double d = static_cast<double>(c.draws);
+        out<<",\"cycles_per_draw\":"<<c.cycles/d<<",\"cache_misses_per_draw\":"<<c.cache_misses/d
+           <<",\"instructions_per_draw\":"<<c.instructions/d;
+    }
+    out<<"}";
+}
+
+/** Object of the APIs with at least one call */
+void write_apis(std::ostream &out, const ThreadCounters &t, bool ratios)
+{
+    out<<"{";
+    bool first = true;
+    for(std::size_t a=0; a<num_apis; a++) {
+        if(!t.api[a].calls) continue;
+        if(!first) out<<",";
+        first = false;
+        out<<"\""<<api_name(static_cast<Api>(a))<<"\":";
+        write_counters(out, t.api[a], ratios);
+    }
+    out<<"}";
+}
+
+} /* namespace */
+
+void Snapshot::write_json(std::ostream &out) const
+{
+    out<<"{\"cycle_unit\":\""<<cycle_unit<<"\",\"perf\":"<<(perf_enabled ? "true" : "false")<<",\"threads\":[";
+    for(std::size_t n=0; n<threads.size(); n++) {
+        if(n) out<<",";
+        out<<"{\"key\":"<<keys[n]<<",\"apis\":";
+        write_apis(out, threads[n], false);
+        out<<"}";
+    }
+    out<<"],\"total\":";
+    write_apis(out, total(), true);
+    out<<"}";
+}
+
+std::string Snapshot::json() const
+{
+    std::ostringstream out;
+    write_json(out);
+    return out.str();
+}
+
+#ifdef PARALLEL_RNG_USE_PERF_EVENTS
+namespace {
+
+/** Cache miss and instruction counters of one OS thread, read together as a group */
+struct PerfGroup
+{
+    int leader = -1;
+    int member = -1;
+    bool opened = false;
+
+    ~PerfGroup()
+    {
+        if(member >= 0) ::close(member);
+        if(leader >= 0) ::close(leader);
+    }
+
+    static int open_event(uint64_t config, int group_fd)
+    {
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return static_cast<int>(::syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+    }
+
+    bool open()
+    {
+        if(opened) return leader >= 0;
+        opened = true;
+        leader = open_event(PERF_COUNT_HW_CACHE_MISSES, -1);
+        if(leader < 0) return false;
+        member = open_event(PERF_COUNT_HW_INSTRUCTIONS, leader);
+        if(member < 0) {
+            ::close(leader);
+            leader = -1;
+            return false;
+        }
+        return true;
+    }
+};
+
+thread_local PerfGroup perf_group;
+
+} /* namespace */
+
+bool read_perf_counters(uint64_t &cache_misses, uint64_t &instructions)
+{
+    if(!perf_group.open()) return false;
+    uint64_t buf[3]; //Number of events, then their values in the order they joined the group
+    if(::read(perf_group.leader, buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf)) || buf[0] != 2) return false;
+    cache_misses = buf[1];
+    instructions = buf[2];
+    return true;
+}
+#else
+bool read_perf_counters(uint64_t &, uint64_t &)
+{
+    return false;
+}
+#endif
+
+} /* namespace parallel_rng::instrument */
+} /* namespace parallel_rng */
@@ -0,0 +1,119 @@
+/** @file Numa.cpp
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Linux NUMA page binding and OpenMP thread pinning
+ */
+
+#include <vector>
+#include <omp.h>
+#include "ParallelRngManager/Numa.h"
+
+#if defined(__linux__)
+    #include <dirent.h>
+    #include <sched.h>
+    #include <unistd.h>
+    #include <sys/syscall.h>
+    #define PARALLEL_RNG_USE_NUMA
+#endif
+
+namespace parallel_rng {
+namespace numa {
+
+#ifdef PARALLEL_RNG_USE_NUMA
+namespace {
+
+//From linux/mempolicy.h, which not all toolchains install
+const int mpol_preferred = 1;
+const unsigned mpol_mf_move = 1<<1;
+
+std::size_t count_nodes()
+{
+    DIR *dir = ::opendir("/sys/devices/system/node");
+    if(!dir) return 1;
+    std::size_t count = 0;
+    while(struct dirent *e = ::readdir(dir)) {
+        const char *name = e->d_name;
+        if(name[0]=='n' && name[1]=='o' && name[2]=='d' && name[3]=='e' && name[4]>='0' && name[4]<='9') count++;
+    }
+    ::closedir(dir);
+    return count ? count : 1;
+}
+
+} /* namespace */
+
+std::size_t page_size()
+{
+    static const std::size_t size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+std::size_t num_nodes()
+{
+    static const std::size_t nodes = count_nodes();
+    return nodes;
+}
+
+int current_node()
+{
+    unsigned cpu, node;
+    if(::syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) return -1;
+    return static_cast<int>(node);
+}
+
+bool bind_local(void *addr, std::size_t len)
+{
+    int node = current_node();
+    if(node < 0) return false;
+    const std::size_t bits = 8*sizeof(unsigned long);
+    std::vector<unsigned long> mask(node/bits + 1, 0);
+    mask[node/bits] = 1UL << (node%bits);
+    return ::syscall(SYS_mbind, addr, len, mpol_preferred, mask.data(), mask.size()*bits + 1, mpol_mf_move) == 0;
+}
+
+int pin_openmp_threads()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(::sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return 0;
+    std::vector<int> cpus;
+    for(int c=0; c<CPU_SETSIZE; c++) if(CPU_ISSET(c, &allowed)) cpus.push_back(c);
+    if(cpus.empty()) return 0;
+    int pinned = 0;
+    #pragma omp parallel reduction(+:pinned)
+    {
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpus[omp_get_thread_num() % cpus.size()], &one);
+        pinned += ::sched_setaffinity(0, sizeof(one), &one) == 0;
+    }
+    return pinned;
+}
+#else
+std::size_t page_size()
+{
+    return 4096;
+}
+
+std::size_t num_nodes()
+{
+    return 1;
+}
+
+int current_node()
+{
+    return -1;
+}
+
+bool bind_local(void *, std::size_t)
+{
+    return false;
+}
+
+int pin_openmp_threads()
+{
+    return 0;
+}
+#endif
+
+} /* namespace parallel_rng::numa */
+} /* namespace parallel_rng */
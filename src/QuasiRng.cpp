@@ -0,0 +1,145 @@
+/** @file QuasiRng.cpp
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Direction numbers, primes, and scrambles for the quasi-random sequences
+ */
+
+#include <cmath>
+#include "ParallelRngManager/QuasiRng.h"
+
+namespace parallel_rng {
+
+namespace {
+
+//Joe-Kuo new-joe-kuo-6.21201 for dimensions 2-21: degree s and coefficients a of the primitive polynomial, and the
+//initial direction numbers m_1..m_s.  Dimension 1 uses m_k = 1 for all k.
+struct SobolPolynomial
+{
+    unsigned s;
+    unsigned a;
+    unsigned m[7];
+};
+
+const SobolPolynomial joe_kuo[] = {
+    {1,  0, {1}},
+    {2,  1, {1, 3}},
+    {3,  1, {1, 3, 1}},
+    {3,  2, {1, 1, 1}},
+    {4,  1, {1, 1, 3, 3}},
+    {4,  4, {1, 3, 5, 13}},
+    {5,  2, {1, 1, 5, 5, 17}},
+    {5,  4, {1, 1, 5, 5, 5}},
+    {5,  7, {1, 1, 7, 11, 19}},
+    {5, 11, {1, 1, 5, 1, 1}},
+    {5, 13, {1, 1, 1, 3, 11}},
+    {5, 14, {1, 3, 5, 5, 31}},
+    {6,  1, {1, 3, 3, 9, 7, 49}},
+    {6, 13, {1, 1, 1, 15, 21, 21}},
+    {6, 16, {1, 3, 1, 13, 27, 49}},
+    {6, 19, {1, 1, 1, 15, 7, 5}},
+    {6, 22, {1, 3, 1, 15, 13, 25}},
+    {6, 25, {1, 1, 5, 5, 19, 61}},
+    {7,  1, {1, 3, 7, 11, 23, 15, 103}},
+    {7,  4, {1, 3, 7, 13, 13, 15, 69}},
+};
+
+const IdxT max_halton_dim = 256;
+
+uint64_t parity(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_parityll(x);
+#else
+    x ^= x >> 32; x ^= x >> 16; x ^= x >> 8; x ^= x >> 4; x ^= x >> 2; x ^= x >> 1;
+    return x & 1;
+#endif
+}
+
+} /* namespace */
+
+constexpr IdxT SobolSequence::bits;
+
+IdxT SobolSequence::max_dim()
+{
+    return 1 + sizeof(joe_kuo)/sizeof(joe_kuo[0]);
+}
+
+SobolSequence::SobolSequence(IdxT dim, QuasiScramble scramble, SeedT seed)
+    : _dim{dim}, _scramble{scramble}, V(bits*dim), shift(dim, 0)
+{
+    if(dim == 0 || dim > max_dim()) throw ParallelRngManagerError("SobolSequence: dimension must be in [1,max_dim()].");
+    for(IdxT k=0; k<bits; k++) V[k*dim] = uint64_t(1) << (bits-1-k);
+    for(IdxT j=1; j<dim; j++) {
+        const SobolPolynomial &poly = joe_kuo[j-1];
+        const IdxT s = poly.s;
+        for(IdxT k=0; k<s; k++) V[k*dim+j] = uint64_t(poly.m[k]) << (bits-1-k);
+        for(IdxT k=s; k<bits; k++) {
+            uint64_t v = V[(k-s)*dim+j] ^ (V[(k-s)*dim+j] >> s);
+            for(IdxT i=1; i<s; i++) if((poly.a >> (s-1-i)) & 1) v ^= V[(k-i)*dim+j];
+            V[k*dim+j] = v;
+        }
+    }
+    if(scramble == QuasiScramble::None) return;
+    DefaultParallelRngT rng(static_cast<unsigned long>(seed));
+    if(scramble == QuasiScramble::Owen) {
+        //Lower triangular binary matrix with unit diagonal.  Output bit i (from the top) mixes input bits 0..i.
+        std::vector<uint64_t> rows(bits);
+        for(IdxT j=0; j<dim; j++) {
+            for(IdxT i=0; i<bits; i++) {
+                uint64_t diag = uint64_t(1) << (bits-1-i);
+                rows[i] = (ziggurat::random_u64(rng) & ~(diag - 1) & ~diag) | diag;
+            }
+            for(IdxT k=0; k<bits; k++) {
+                uint64_t v = V[k*dim+j], w = 0;
+                for(IdxT i=0; i<bits; i++) w |= parity(rows[i] & v) << (bits-1-i);
+                V[k*dim+j] = w;
+            }
+        }
+    }
+    for(IdxT j=0; j<dim; j++) shift[j] = ziggurat::random_u64(rng);
+}
+
+IdxT HaltonSequence::max_dim()
+{
+    return max_halton_dim;
+}
+
+HaltonSequence::HaltonSequence(IdxT dim, QuasiScramble scramble, SeedT seed)
+    : _dim{dim}, _scramble{scramble}
+{
+    if(dim == 0 || dim > max_dim()) throw ParallelRngManagerError("HaltonSequence: dimension must be in [1,max_dim()].");
+    for(uint64_t p=2; base.size()<dim; p++) {
+        bool prime = true;
+        for(uint64_t q: base) {
+            if(q*q > p) break;
+            if(p % q == 0) { prime = false; break; }
+        }
+        if(prime) base.push_back(p);
+    }
+    const uint64_t max_scale = uint64_t(1) << 53;
+    for(uint64_t b: base) {
+        IdxT D = 0;
+        uint64_t bD = 1;
+        while(bD <= max_scale / b) { bD *= b; D++; }
+        digits.push_back(D);
+        scale.push_back(double(bD));
+    }
+    if(scramble == QuasiScramble::None) return;
+    DefaultParallelRngT rng(static_cast<unsigned long>(seed));
+    for(IdxT j=0; j<dim; j++) {
+        const uint64_t b = base[j];
+        perm_offset.push_back(perm.size());
+        for(IdxT k=0; k<digits[j]; k++) {
+            uint32_t *p = &*perm.insert(perm.end(), b, 0);
+            if(scramble == QuasiScramble::DigitalShift) {
+                uint32_t s = permutation::uniform_index(b, rng);
+                for(uint64_t d=0; d<b; d++) p[d] = (d + s) % b;
+            } else {
+                for(uint64_t d=0; d<b; d++) p[d] = d;
+                permutation::fisher_yates(p, b, rng);
+            }
+        }
+    }
+}
+
+} /* namespace parallel_rng */
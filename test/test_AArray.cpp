@@ -5,6 +5,8 @@
  */
 
 #include <cstring>
+#include <new>
+#include <vector>
 #include "ParallelRngManager/AlignedArray/AArray.h"
 #include "gtest/gtest.h"
 namespace {
@@ -348,4 +350,70 @@ TYPED_TEST(AArrayTest, test_iterator_arithmetic)
         
         
 
+template<class AllocT>
+void check_allocator(AllocT alloc, size_t capacity, size_t align)
+{
+    AArray<double,AllocT> aa(capacity, align, alloc);
+    for(size_t n=0; n<capacity; n++) aa.emplace_back(double(n));
+    for(size_t n=0; n<capacity; n++) {
+        EXPECT_EQ(double(n), aa[n]);
+        EXPECT_EQ(0, uintptr_t(&aa[n]) % align);
+    }
+    AArray<double,AllocT> copy(aa);
+    EXPECT_NE(&aa.front(), &copy.front());
+    EXPECT_EQ(aa.back(), copy.back());
+}
+
+TEST(AArrayAllocatorTest, Policies)
+{
+    for(size_t align: {8, 64, 4096}) {
+        check_allocator(AlignedAllocator{}, 1000, align);
+        check_allocator(HugePageAllocator{}, 1000, align);
+        try {
+            check_allocator(HugeTlbAllocator{}, 1000, align);
+        } catch(std::bad_alloc &) { } //No huge pages reserved
+    }
+}
+
+TEST(AArrayAllocatorTest, Arena)
+{
+    std::vector<unsigned char> buf(1<<16);
+    Arena arena(buf.data(), buf.size());
+    check_allocator(ArenaAllocator{arena}, 100, 64);
+    EXPECT_EQ(0, arena.used()) << "Freed allocations at the top of the arena are reclaimed.";
+    AArray<double,ArenaAllocator> aa(10, 64, ArenaAllocator{arena});
+    EXPECT_GE(uintptr_t(&aa.front()), uintptr_t(buf.data()));
+    EXPECT_LE(uintptr_t(&aa.front()) + aa.max_size()*aa.align(), uintptr_t(buf.data() + buf.size()));
+    EXPECT_THROW((AArray<double,ArenaAllocator>(buf.size(), 64, ArenaAllocator{arena})), std::bad_alloc);
+}
+
+TEST(AArrayAllocatorTest, ReserveInPlace)
+{
+    std::vector<unsigned char> buf(1<<16);
+    Arena arena(buf.data(), buf.size());
+    AArray<double,ArenaAllocator> aa(10, 64, ArenaAllocator{arena});
+    aa.fill(1.0);
+    double *front = &aa.front();
+    EXPECT_TRUE(aa.reserve(100));
+    EXPECT_EQ(100, aa.capacity());
+    EXPECT_EQ(front, &aa.front()) << "reserve() moved the elements.";
+    aa.emplace_back(2.0);
+    EXPECT_EQ(2.0, aa.back());
+    AArray<double,ArenaAllocator> other(10, 64, ArenaAllocator{arena});
+    EXPECT_FALSE(aa.reserve(200)) << "Only the top allocation of an arena can grow.";
+    EXPECT_EQ(100, aa.capacity());
+
+    AArray<double> heap(10, 64);
+    EXPECT_TRUE(heap.reserve(5));
+    EXPECT_FALSE(heap.reserve(20));
+    AArray<double> empty(0, 64);
+    EXPECT_TRUE(empty.reserve(20));
+    EXPECT_EQ(20, empty.capacity());
+
+    AArray<double,HugePageAllocator> huge(10, 64);
+    huge.fill(3.0);
+    EXPECT_TRUE(huge.reserve(1000)) << "Growth within the last huge page never needs to remap.";
+    EXPECT_EQ(3.0, huge[9]);
+}
+
 } /* annonymous namespace */
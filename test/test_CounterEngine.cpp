@@ -0,0 +1,138 @@
+/** @file test_CounterEngine.cpp
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Use googletest to test the counter-based engines
+ */
+
+#include <sstream>
+#include <vector>
+#include "ParallelRngManager/CounterEngine.h"
+#include "gtest/gtest.h"
+namespace {
+
+using namespace parallel_rng;
+
+/* Known-answer vectors from the Random123 distribution (kat_vectors) */
+TEST(CounterEngineTest, Philox4x32KnownAnswer)
+{
+    using B = counter::Philox4<uint32_t>;
+    B::ctr_type x{{0,0,0,0}};
+    B::encrypt(x, B::key_type{{0,0}});
+    EXPECT_EQ((B::ctr_type{{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}}), x);
+    x = B::ctr_type{{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}};
+    B::encrypt(x, B::key_type{{0xffffffff, 0xffffffff}});
+    EXPECT_EQ((B::ctr_type{{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}}), x);
+}
+
+TEST(CounterEngineTest, Philox4x64KnownAnswer)
+{
+    using B = counter::Philox4<uint64_t>;
+    B::ctr_type x{{0,0,0,0}};
+    B::encrypt(x, B::key_type{{0,0}});
+    EXPECT_EQ((B::ctr_type{{0x16554d9eca36314cULL, 0xdb20fe9d672d0fdcULL, 0xd7e772cee186176bULL, 0x7e68b68aec7ba23bULL}}), x);
+    const uint64_t ones = ~uint64_t(0);
+    x = B::ctr_type{{ones, ones, ones, ones}};
+    B::encrypt(x, B::key_type{{ones, ones}});
+    EXPECT_EQ((B::ctr_type{{0x87b092c3013fe90bULL, 0x438c3c67be8d0224ULL, 0x9cc7d7c69cd777b6ULL, 0xa09caebf594f0ba0ULL}}), x);
+}
+
+TEST(CounterEngineTest, Threefry4x64KnownAnswer)
+{
+    using B = counter::Threefry4x64;
+    B::ctr_type x{{0,0,0,0}};
+    B::encrypt(x, B::key_type{{0,0,0,0}});
+    EXPECT_EQ((B::ctr_type{{0x09218ebde6c85537ULL, 0x55941f5266d86105ULL, 0x4bd25e16282434dcULL, 0xee29ec846bd2e40bULL}}), x);
+    const uint64_t ones = ~uint64_t(0);
+    x = B::ctr_type{{ones, ones, ones, ones}};
+    B::encrypt(x, B::key_type{{ones, ones, ones, ones}});
+    EXPECT_EQ((B::ctr_type{{0x29c24097942bba1bULL, 0x0371bbfb0f6f4e11ULL, 0x3c231ffa33f83a1cULL, 0xcd29113fde32d168ULL}}), x);
+}
+
+template <typename T>
+class CounterEngineTypedTest : public ::testing::Test { };
+
+using CounterEngineTypes = ::testing::Types<Philox4x32, Philox4x64, Threefry4x64>;
+TYPED_TEST_CASE(CounterEngineTypedTest, CounterEngineTypes);
+
+TYPED_TEST(CounterEngineTypedTest, RandomAccess)
+{
+    TypeParam gen(42, 7);
+    std::vector<typename TypeParam::result_type> seq(1000);
+    for(auto &v: seq) v = gen();
+    for(uint64_t k: {0, 1, 3, 4, 517, 999}) {
+        TypeParam r(42, 7);
+        r.seek(k);
+        TypeParam j(42, 7);
+        j.jump(k);
+        EXPECT_EQ(r, j);
+        EXPECT_EQ(seq[k], r()) << "Position: "<<k;
+    }
+}
+
+TYPED_TEST(CounterEngineTypedTest, StreamsDiffer)
+{
+    TypeParam a(42, 0), b(42, 1), c(43, 0);
+    int same_b = 0, same_c = 0;
+    for(int i=0; i<100; i++) {
+        auto v = a();
+        same_b += v == b();
+        same_c += v == c();
+    }
+    EXPECT_LT(same_b, 3);
+    EXPECT_LT(same_c, 3);
+}
+
+TYPED_TEST(CounterEngineTypedTest, LeapfrogSplit)
+{
+    TypeParam gen(5);
+    std::vector<typename TypeParam::result_type> seq(300);
+    for(auto &v: seq) v = gen();
+    for(unsigned n=0; n<3; n++) {
+        TypeParam lane(5);
+        lane.split(3,n);
+        for(unsigned i=n; i<seq.size(); i+=3) ASSERT_EQ(seq[i], lane());
+    }
+}
+
+TYPED_TEST(CounterEngineTypedTest, BulkGenerateMatchesScalar)
+{
+    for(std::size_t offset: {0, 1, 3}) {
+        TypeParam gen(9, 2), bulk(9, 2);
+        gen.jump(offset);
+        bulk.jump(offset);
+        std::vector<typename TypeParam::result_type> out(1001);
+        bulk.generate(out.data(), out.size());
+        for(std::size_t i=0; i<out.size(); i++) ASSERT_EQ(gen(), out[i]) << "Offset: "<<offset<<" Index: "<<i;
+        EXPECT_EQ(gen, bulk);
+    }
+}
+
+TYPED_TEST(CounterEngineTypedTest, CopyFromNonConst)
+{
+    TypeParam a(13, 5);
+    a.jump(7);
+    TypeParam ref = static_cast<const TypeParam&>(a);
+    TypeParam b(a);
+    TypeParam c{a};
+    EXPECT_EQ(ref, a) << "Copying must not draw from the source";
+    EXPECT_EQ(a, b);
+    EXPECT_EQ(a, c);
+    auto v = a();
+    EXPECT_EQ(v, b());
+    EXPECT_EQ(v, c());
+}
+
+TYPED_TEST(CounterEngineTypedTest, StreamIO)
+{
+    TypeParam gen(11, 4);
+    gen.split(2,1);
+    gen.jump(33);
+    std::stringstream ss;
+    ss << gen;
+    TypeParam gen2;
+    ss >> gen2;
+    EXPECT_EQ(gen, gen2);
+    EXPECT_EQ(gen(), gen2());
+}
+
+}  // namespace
@@ -0,0 +1,81 @@
+/** @file test_Instrumentation.cpp
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Use googletest to test the instrumentation counters and snapshots
+ */
+
+#include <string>
+#include "ParallelRngManager/ParallelRngManager.h"
+#include "gtest/gtest.h"
+namespace {
+
+using namespace parallel_rng;
+using instrument::Api;
+
+TEST(InstrumentTest, SnapshotTotals)
+{
+    instrument::Snapshot snapshot;
+    snapshot.keys = {0, 1};
+    snapshot.threads.resize(2);
+    snapshot.threads[0][Api::Randu].calls = 3;
+    snapshot.threads[0][Api::Randu].draws = 3;
+    snapshot.threads[0][Api::Randu].cycles = 60;
+    snapshot.threads[1][Api::Randu].calls = 1;
+    snapshot.threads[1][Api::Randu].draws = 1;
+    snapshot.threads[1][Api::Randu].cycles = 20;
+    snapshot.threads[1][Api::FillRandn].calls = 1;
+    snapshot.threads[1][Api::FillRandn].draws = 100;
+    auto randu = snapshot.total(Api::Randu);
+    EXPECT_EQ(4, randu.calls);
+    EXPECT_EQ(4, randu.draws);
+    EXPECT_EQ(80, randu.cycles);
+    EXPECT_EQ(100, snapshot.total()[Api::FillRandn].draws);
+    EXPECT_EQ(0, snapshot.total(Api::Randn).calls);
+    std::string json = snapshot.json();
+    EXPECT_NE(std::string::npos, json.find("\"key\":1"));
+    EXPECT_NE(std::string::npos, json.find("\"fill_randn\":{\"calls\":1,\"draws\":100"));
+    EXPECT_NE(std::string::npos, json.find("\"cycles_per_draw\":20"));
+    EXPECT_EQ(std::string::npos, json.find("\"randn\"")) << "APIs without calls are omitted.";
+}
+
+TEST(InstrumentTest, ManagerCounters)
+{
+    auto M = make_parallel_rng_manager(42);
+    if(!instrument::enabled) {
+        EXPECT_TRUE(M.instrument_snapshot().threads.empty());
+        return;
+    }
+    IdxT nthreads = 0;
+    #pragma omp parallel
+    {
+        #pragma omp single
+        nthreads = omp_get_num_threads();
+        for(int n=0; n<10; n++) M.randu();
+        M.randn(100);
+        arma::vec w = {1, 2, 3};
+        M.resample_dist(w);
+    }
+    M.randu_parallel(10, 10);
+    auto snapshot = M.instrument_snapshot();
+    ASSERT_EQ(nthreads, snapshot.threads.size());
+    for(IdxT t=0; t<nthreads; t++) {
+        EXPECT_EQ(t, snapshot.keys[t]);
+        auto &c = snapshot.threads[t];
+        EXPECT_EQ(10, c[Api::Randu].calls);
+        EXPECT_EQ(10*sizeof(double), c[Api::Randu].bytes);
+        EXPECT_EQ(1, c[Api::FillRandn].calls);
+        EXPECT_EQ(100, c[Api::FillRandn].draws);
+        EXPECT_EQ(1, c[Api::ResampleDist].calls);
+        EXPECT_EQ(0, c[Api::Randn].calls);
+        EXPECT_EQ(t == 0 ? 100 : 0, c[Api::FillRanduParallel].draws);
+    }
+    EXPECT_GT(snapshot.total(Api::FillRandn).cycles, 0);
+    M.instrument_reset();
+    EXPECT_TRUE(M.instrument_snapshot().threads.empty());
+    M.randu();
+    EXPECT_EQ(1, M.instrument_snapshot().total(Api::Randu).calls);
+    M.reset(7);
+    EXPECT_TRUE(M.instrument_snapshot().threads.empty()) << "Counters are cleared with the streams by reset()";
+}
+
+} /* namespace */
@@ -0,0 +1,213 @@
+/** @file test_QuasiRng.cpp
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Use googletest to test the quasi-random sequences and QuasiRngManager
+ */
+
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include "ParallelRngManager/QuasiRngManager.h"
+#include "gtest/gtest.h"
+namespace {
+
+using namespace parallel_rng;
+
+const QuasiScramble all_scrambles[] = {QuasiScramble::None, QuasiScramble::DigitalShift, QuasiScramble::Owen};
+
+/* Count of points in each of the K intervals [k/K,(k+1)/K) of dimension j.  Halton points on an interval boundary
+ * k/K may be rounded just below it, so boundaries are given a small tolerance.
+ */
+std::vector<IdxT> interval_counts(const std::vector<double> &x, IdxT dim, IdxT j, IdxT K)
+{
+    std::vector<IdxT> count(K, 0);
+    for(IdxT n=0; n<x.size()/dim; n++) count[std::min(K-1, IdxT(x[n*dim+j]*K + 1e-9))]++;
+    return count;
+}
+
+TEST(SobolTest, KnownPoints)
+{
+    SobolSequence sobol(3);
+    const double expected[8][3] = {{0,0,0}, {0.5,0.5,0.5}, {0.75,0.25,0.25}, {0.25,0.75,0.75},
+                                   {0.375,0.375,0.625}, {0.875,0.875,0.125}, {0.625,0.125,0.875}, {0.125,0.625,0.375}};
+    std::vector<double> x(3*8);
+    sobol.generate(0, 8, x.data());
+    for(IdxT n=0; n<8; n++) for(IdxT j=0; j<3; j++) EXPECT_EQ(expected[n][j], x[n*3+j]) << "Point: "<<n<<" Dim: "<<j;
+    //Skip-ahead matches sequential generation
+    std::vector<double> y(3*3);
+    sobol.generate(5, 3, y.data());
+    for(IdxT n=0; n<3; n++) for(IdxT j=0; j<3; j++) EXPECT_EQ(expected[5+n][j], y[n*3+j]);
+    EXPECT_THROW(SobolSequence(SobolSequence::max_dim()+1), ParallelRngManagerError);
+}
+
+TEST(SobolTest, Stratification)
+{
+    const IdxT d = SobolSequence::max_dim(), m = 10, K = IdxT(1)<<m;
+    for(auto scramble: all_scrambles) {
+        SobolSequence sobol(d, scramble, 42);
+        std::vector<double> x(d*K);
+        sobol.generate(3*K, K, x.data()); //Any aligned block of 2^m points
+        for(IdxT j=0; j<d; j++) {
+            auto count = interval_counts(x, d, j, K);
+            for(IdxT k=0; k<K; k++) ASSERT_EQ(1, count[k]) << "Scramble: "<<int(scramble)<<" Dim: "<<j<<" Interval: "<<k;
+        }
+        //The first two dimensions are a (0,m,2)-net: every elementary box of area 2^-m holds one point
+        for(IdxT a=0; a<=m; a++) {
+            std::vector<IdxT> box(K, 0);
+            for(IdxT n=0; n<K; n++) box[(IdxT(x[n*d]*(1<<a)) << (m-a)) + IdxT(x[n*d+1]*(1<<(m-a)))]++;
+            for(IdxT b=0; b<K; b++) ASSERT_EQ(1, box[b]) << "Scramble: "<<int(scramble)<<" Shape: "<<a;
+        }
+    }
+    SobolSequence a(4, QuasiScramble::Owen, 1), b(4, QuasiScramble::Owen, 2);
+    std::vector<float> xa(4*16), xb(4*16);
+    a.generate(0, 16, xa.data());
+    b.generate(0, 16, xb.data());
+    EXPECT_NE(xa, xb);
+    for(auto v: xa) {
+        EXPECT_GE(v, 0);
+        EXPECT_LT(v, 1);
+    }
+}
+
+TEST(HaltonTest, KnownPoints)
+{
+    HaltonSequence halton(3);
+    const double expected[4][3] = {{0,0,0}, {1./2,1./3,1./5}, {1./4,2./3,2./5}, {3./4,1./9,3./5}};
+    std::vector<double> x(3*4);
+    halton.generate(0, 4, x.data());
+    for(IdxT n=0; n<4; n++) for(IdxT j=0; j<3; j++) EXPECT_DOUBLE_EQ(expected[n][j], x[n*3+j]) << "Point: "<<n<<" Dim: "<<j;
+}
+
+TEST(HaltonTest, Stratification)
+{
+    const IdxT d = 4;
+    const IdxT base[d] = {2, 3, 5, 7};
+    for(auto scramble: all_scrambles) {
+        HaltonSequence halton(d, scramble, 42);
+        for(IdxT j=0; j<d; j++) {
+            const IdxT K = base[j]*base[j]*base[j];
+            std::vector<double> x(d*K);
+            halton.generate(0, K, x.data());
+            auto count = interval_counts(x, d, j, K);
+            for(IdxT k=0; k<K; k++) ASSERT_EQ(1, count[k]) << "Scramble: "<<int(scramble)<<" Dim: "<<j<<" Interval: "<<k;
+        }
+    }
+}
+
+TEST(QuasiRngManagerTest, ParallelMatchesSerial)
+{
+    QuasiRngManager<> M(5, QuasiScramble::Owen, 42), M2 = M;
+    IdxT N = 20011;
+    auto samp = M.randu(N);
+    ASSERT_EQ(5, samp.n_rows);
+    ASSERT_EQ(N, samp.n_cols);
+    EXPECT_EQ(N, M.position());
+    auto next = M.randu();
+    int max_threads = omp_get_max_threads();
+    for(int nthreads: {1,2,3,5}) {
+        auto M3 = M2;
+        omp_set_num_threads(nthreads);
+        auto samp3 = M3.randu_parallel(N);
+        for(IdxT n=0; n<samp.n_elem; n++) ASSERT_EQ(samp(n), samp3(n)) << "Threads: "<<nthreads<<" Index: "<<n;
+        auto next3 = M3.randu();
+        for(IdxT j=0; j<5; j++) EXPECT_EQ(next(j), next3(j));
+    }
+    omp_set_num_threads(max_threads);
+    M2.seek(N);
+    auto next2 = M2.randu();
+    for(IdxT j=0; j<5; j++) EXPECT_EQ(next(j), next2(j)) << "Skip-ahead does not match sequential points.";
+    arma::mat wrong(4, 10);
+    EXPECT_THROW(M.fill_randu(wrong), ParallelRngManagerError);
+}
+
+TEST(QuasiRngManagerTest, ThreadSequences)
+{
+    QuasiRngManager<HaltonSequence> M(2, QuasiScramble::Owen, 3);
+    IdxT nthreads = 0;
+    std::vector<double> first(2*omp_get_max_threads());
+    #pragma omp parallel
+    {
+        #pragma omp single
+        nthreads = omp_get_num_threads();
+        auto x = M.randu();
+        IdxT t = omp_get_thread_num();
+        first[2*t] = x(0);
+        first[2*t+1] = x(1);
+    }
+    for(IdxT t=0; t<nthreads; t++) {
+        std::vector<double> expected(2);
+        M.thread_sequence(t).generate(0, 1, expected.data());
+        EXPECT_EQ(expected[0], first[2*t]) << "Thread: "<<t;
+        EXPECT_EQ(expected[1], first[2*t+1]) << "Thread: "<<t;
+    }
+    //Without scrambling only thread 0 has a sequence
+    QuasiRngManager<> U(2, QuasiScramble::None, 0);
+    EXPECT_NO_THROW(U.thread_sequence(0));
+    EXPECT_THROW(U.thread_sequence(1), ParallelRngManagerError);
+}
+
+TEST(QuasiRngManagerTest, DefaultConstructedParallel)
+{
+    //The dim-only constructor is digitally shifted, so every thread of a parallel region can draw
+    QuasiRngManager<> M(3);
+    EXPECT_EQ(QuasiScramble::DigitalShift, M.scramble());
+    const IdxT nthreads = 4;
+    std::vector<arma::vec> first(nthreads);
+    #pragma omp parallel num_threads(nthreads)
+    first[omp_get_thread_num()] = M.randu();
+    for(IdxT t=0; t<nthreads; t++) {
+        if(first[t].is_empty()) continue; //Fewer threads were provided
+        arma::vec expected(3);
+        M.thread_sequence(t).generate(0, 1, expected.memptr());
+        for(IdxT j=0; j<3; j++) EXPECT_EQ(expected(j), first[t](j)) << "Thread: "<<t;
+    }
+    //Fixed seed, so reproducible
+    QuasiRngManager<> M2(3);
+    auto x = M2.randu();
+    for(IdxT j=0; j<3; j++) EXPECT_EQ(first[0](j), x(j));
+}
+
+TEST(QuasiRngManagerTest, ThreadsFormNet)
+{
+    //The first 2^m points of each of two threads are distinct (0,m,2)-nets, and together a (1,m+1,2)-net
+    const IdxT m = 8, K = IdxT(1)<<m;
+    for(auto scramble: {QuasiScramble::DigitalShift, QuasiScramble::Owen}) {
+        QuasiRngManager<> M(2, scramble, 11, 2);
+        arma::mat x[2];
+        #pragma omp parallel num_threads(2)
+        x[omp_get_thread_num()] = M.randu(K);
+        ASSERT_EQ(K, x[1].n_cols) << "Two threads are required.";
+        for(IdxT n=0; n<K; n++) EXPECT_NE(x[0](0,n), x[1](0,n)) << "Scramble: "<<int(scramble)<<" Point: "<<n;
+        for(IdxT a=0; a<=m; a++) {
+            std::vector<IdxT> box0(K, 0), box(K, 0);
+            for(IdxT t=0; t<2; t++) for(IdxT n=0; n<K; n++) {
+                IdxT b = (IdxT(x[t](0,n)*(1<<a)) << (m-a)) + IdxT(x[t](1,n)*(1<<(m-a)));
+                if(t == 0) box0[b]++;
+                box[b]++;
+            }
+            for(IdxT b=0; b<K; b++) {
+                ASSERT_EQ(1, box0[b]) << "Scramble: "<<int(scramble)<<" Shape: "<<a;
+                ASSERT_EQ(2, box[b]) << "Scramble: "<<int(scramble)<<" Shape: "<<a;
+            }
+        }
+    }
+}
+
+TEST(QuasiRngManagerTest, IntegrationError)
+{
+    //Integral of prod_j (1 + (x_j - 1/2)) over the unit cube is 1
+    const IdxT d = 6, N = IdxT(1)<<14;
+    for(auto scramble: all_scrambles) {
+        QuasiRngManager<> M(d, scramble, 7);
+        auto x = M.randu_parallel(N);
+        double sum = 0;
+        for(IdxT n=0; n<N; n++) {
+            double f = 1;
+            for(IdxT j=0; j<d; j++) f *= 0.5 + x(j,n);
+            sum += f;
+        }
+        EXPECT_NEAR(1, sum/N, 1e-3) << "Scramble: "<<int(scramble); //Monte Carlo error would be about 6e-3
+    }
+}
+
+} /* namespace */
@@ -0,0 +1,143 @@
+/** @file test_StreamTable.cpp
+ * @author Mark J. Olah (mjo\@cs.unm DOT edu)
+ * @date 2019
+ * @brief Use googletest to test the StreamTable class
+ */
+
+#include <atomic>
+#include <vector>
+#include <omp.h>
+#include "ParallelRngManager/StreamTable.h"
+#include "ParallelRngManager/StreamPathIndex.h"
+#include "gtest/gtest.h"
+namespace {
+
+using parallel_rng::StreamTable;
+using parallel_rng::StreamPathIndex;
+
+TEST(StreamTableTest, MaterializeOnFirstUse)
+{
+    StreamTable<double> table(4);
+    EXPECT_EQ(0, table.size());
+    EXPECT_EQ(nullptr, table.find(2));
+    int calls = 0;
+    auto make = [&](std::size_t n) { calls++; return 10.0*n; };
+    EXPECT_EQ(20.0, table.get(2, make));
+    EXPECT_EQ(20.0, table.get(2, make));
+    EXPECT_EQ(1, calls);
+    EXPECT_EQ(1, table.size());
+    ASSERT_NE(nullptr, table.find(2));
+    EXPECT_EQ(20.0, *table.find(2));
+}
+
+TEST(StreamTableTest, GrowWithoutMoving)
+{
+    StreamTable<double> table(2, 64);
+    auto make = [](std::size_t n) { return double(n); };
+    double *first = &table.get(1, make);
+    for(std::size_t n: {2, 7, 100, 12345}) EXPECT_EQ(double(n), table.get(n, make));
+    EXPECT_EQ(first, &table.get(1, make));
+    EXPECT_EQ(5, table.size());
+    for(std::size_t n: {1, 2}) {
+        auto addr = reinterpret_cast<uintptr_t>(&table.get(n, make));
+        EXPECT_EQ(0, addr % 64) << "Element "<<n<<" is not cache aligned";
+    }
+    EXPECT_NE(&table.get(1, make)+1, &table.get(2, make)) << "Adjacent elements share a cache line";
+}
+
+TEST(StreamTableTest, ConcurrentFirstTouch)
+{
+    const std::size_t nslots = 37;
+    StreamTable<std::size_t> table(3);
+    std::vector<std::atomic<int>> calls(nslots);
+    for(auto &c: calls) c = 0;
+    std::vector<std::size_t> out(1000);
+    #pragma omp parallel for num_threads(8) schedule(dynamic,1)
+    for(std::size_t i=0; i<out.size(); i++) {
+        std::size_t n = (i*7) % nslots;
+        out[i] = table.get(n, [&](std::size_t m) { calls[m]++; return 3*m; });
+    }
+    for(std::size_t i=0; i<out.size(); i++) ASSERT_EQ(3*((i*7) % nslots), out[i]);
+    for(std::size_t n=0; n<nslots; n++) EXPECT_EQ(1, calls[n]) << "Slot "<<n<<" constructed more than once";
+    EXPECT_EQ(nslots, table.size());
+}
+
+TEST(StreamTableTest, CopyMoveClear)
+{
+    StreamTable<std::vector<int>> table(2);
+    auto make = [](std::size_t n) { return std::vector<int>(n, int(n)); };
+    table.get(1, make);
+    table.get(9, make);
+    StreamTable<std::vector<int>> copy(table);
+    EXPECT_EQ(2, copy.size());
+    EXPECT_NE(&table.get(9, make), &copy.get(9, make));
+    EXPECT_EQ(table.get(9, make), copy.get(9, make));
+    StreamTable<std::vector<int>> moved(std::move(copy));
+    EXPECT_EQ(2, moved.size());
+    EXPECT_EQ(0, copy.size());
+    table.clear();
+    EXPECT_EQ(0, table.size());
+    EXPECT_EQ(nullptr, table.find(9));
+    EXPECT_EQ(std::vector<int>(9, 9), table.get(9, make));
+    EXPECT_THROW(table.get(~std::size_t(0), make), std::out_of_range);
+}
+
+TEST(StreamTableTest, NumaLocalPages)
+{
+    const std::size_t page = parallel_rng::numa::page_size();
+    StreamTable<double> table(4, 64, parallel_rng::StreamPlacement::NumaLocal);
+    EXPECT_EQ(page, table.align());
+    std::vector<double*> slots(8);
+    #pragma omp parallel for
+    for(std::size_t n=0; n<slots.size(); n++) slots[n] = &table.get(n, [](std::size_t n) { return 2.0*n; });
+    for(std::size_t n=0; n<slots.size(); n++) {
+        EXPECT_EQ(2.0*n, *slots[n]);
+        EXPECT_EQ(0, reinterpret_cast<uintptr_t>(slots[n]) % page) << "Slot "<<n<<" shares a page";
+    }
+    StreamTable<double> copy(table);
+    EXPECT_EQ(parallel_rng::StreamPlacement::NumaLocal, copy.placement());
+    EXPECT_EQ(6.0, copy.get(3, [](std::size_t) { return 0.0; }));
+}
+
+TEST(StreamTableTest, ArenaSegments)
+{
+    std::vector<unsigned char> buf(1<<16);
+    aligned_array::Arena arena(buf.data(), buf.size());
+    StreamTable<double,aligned_array::ArenaAllocator> table(4, 64, parallel_rng::StreamPlacement::Cache,
+                                                            aligned_array::ArenaAllocator{arena});
+    #pragma omp parallel for
+    for(std::size_t n=0; n<40; n++) table.get(n, [](std::size_t n) { return 3.0*n; });
+    for(std::size_t n=0; n<40; n++) {
+        const double *p = table.find(n);
+        ASSERT_NE(nullptr, p);
+        EXPECT_EQ(3.0*n, *p);
+        EXPECT_GE(reinterpret_cast<const unsigned char*>(p), buf.data());
+        EXPECT_LT(reinterpret_cast<const unsigned char*>(p), buf.data() + buf.size());
+    }
+    EXPECT_GT(arena.used(), 0);
+}
+
+TEST(StreamPathIndexTest, DenseUniqueKeys)
+{
+    const std::size_t first = 4, nouter = 5, ninner = 6;
+    StreamPathIndex index(first);
+    std::vector<std::size_t> keys(nouter*ninner);
+    #pragma omp parallel for num_threads(8) schedule(dynamic,1)
+    for(std::size_t i=0; i<keys.size(); i++) {
+        std::size_t path[3] = {i/ninner, i%ninner, 0};
+        keys[i] = index.key(path, 2 + (i%2));
+    }
+    std::vector<int> seen(keys.size(), 0);
+    for(auto k: keys) {
+        ASSERT_GE(k, first);
+        ASSERT_LT(k, first+keys.size()) << "Keys are not dense";
+        EXPECT_EQ(0, seen[k-first]++) << "Duplicate key: "<<k;
+    }
+    std::size_t path[3] = {1, 2, 0};
+    StreamPathIndex copy(index);
+    EXPECT_EQ(keys[ninner+2], index.key(path, 2));
+    EXPECT_EQ(keys[ninner+2], copy.key(path, 2));
+    EXPECT_EQ(first+keys.size(), copy.key(path, 1)) << "New paths do not get the next key";
+}
+
+}  // namespace
@@ -5,7 +5,10 @@
  */
 
 
+#include <cstdio>
+#include <sstream>
 #include "ParallelRngManager/ParallelRngManager.h"
+#include "ParallelRngManager/MultivariateNormal.h"
 #include "gtest/gtest.h"
 #include <trng/yarn5s.hpp>
 #include <trng/yarn5.hpp>
@@ -33,7 +36,10 @@ public:
 using ParallelRngTypes = ::testing::Types<trng::lcg64_shift, 
                                           trng::yarn5s,
                                           trng::yarn3,trng::yarn3s,
-                                          trng::yarn2>;
+                                          trng::yarn2,
+                                          parallel_rng::Philox4x32,
+                                          parallel_rng::Philox4x64,
+                                          parallel_rng::Threefry4x64>;
 
 TYPED_TEST_CASE(ParallelRngManagerTest, ParallelRngTypes);
 
@@ -180,6 +186,28 @@ TYPED_TEST( ParallelRngManagerTest, generic_generator)
         EXPECT_EQ(M_gen(),M2_ggen());
 }
 
+TYPED_TEST( ParallelRngManagerTest, GenericGeneratorFill)
+{
+    auto &M = this->M;
+    parallel_rng::ParallelRngManager<TypeParam> M2 = M;
+    using ResultT = typename TypeParam::result_type;
+    auto ggen = M.generic_generator();
+    auto ggen2 = M2.local().generic_generator();
+    std::vector<ResultT> block(this->Nsample);
+    ggen.fill(block.data(), block.size());
+    for(IdxT i=0; i < this->Nsample; i++)
+        ASSERT_EQ(ggen2(), block[i]) << "fill() must match repeated operator() calls.  Index: "<<i;
+    std::vector<double> u(this->Nsample), u2(this->Nsample);
+    ggen.fill_uniform(u.data(), u.size());
+    for(IdxT i=0; i < this->Nsample; i++) {
+        ASSERT_LE(0, u[i]);
+        ASSERT_GT(1, u[i]);
+        ggen2.fill_uniform(&u2[i], 1);
+    }
+    EXPECT_EQ(u, u2);
+    EXPECT_EQ(ggen(), ggen2()) << "fill_uniform() uses one value per sample.";
+}
+
 TYPED_TEST( ParallelRngManagerTest, RandUScalarBounds)
 {
     arma::vec sample(this->Nsample);
@@ -238,6 +266,1020 @@ TYPED_TEST( ParallelRngManagerTest, ResampleDistVectorTest)
     check_sample_category(sample,weights);        
 }
 
+
+TYPED_TEST( ParallelRngManagerTest, LeapfrogEngineMatchesParent)
+{
+    TypeParam gen = this->M.generator();
+    TypeParam gen2 = gen;
+    parallel_rng::LeapfrogEngine<TypeParam> lanes(gen);
+    IdxT N = 3*lanes.block_size+5;
+    for(IdxT i=0; i < N; i++) EXPECT_EQ(gen2(), lanes()) << "Sample: "<<i;
+    EXPECT_EQ(N, lanes.consumed());
+    lanes.commit(gen);
+    for(IdxT i=0; i < this->Nsample; i++) EXPECT_EQ(gen2(), gen()) << "Parent not advanced correctly after commit.";
+}
+
+TYPED_TEST( ParallelRngManagerTest, LeapfrogEngineGenerateMatchesParent)
+{
+    TypeParam gen = this->M.generator();
+    TypeParam gen2 = gen;
+    parallel_rng::LeapfrogEngine<TypeParam> lanes(gen);
+    //Partial buffers, whole blocks, and single values in every combination
+    std::vector<IdxT> sizes = {3, lanes.block_size-3, 2*lanes.block_size, 1, lanes.block_size+7, 0, 5};
+    std::vector<typename TypeParam::result_type> out;
+    IdxT N = 0;
+    for(auto n: sizes) {
+        out.resize(n);
+        lanes.generate(out.data(), n);
+        for(IdxT i=0; i < n; i++) ASSERT_EQ(gen2(), out[i]) << "Sample: "<<N+i;
+        N += n;
+        ASSERT_EQ(N, lanes.consumed());
+        EXPECT_EQ(gen2(), lanes());
+        N++;
+    }
+    lanes.commit(gen);
+    for(IdxT i=0; i < this->Nsample; i++) EXPECT_EQ(gen2(), gen()) << "Parent not advanced correctly after commit.";
+}
+
+TYPED_TEST( ParallelRngManagerTest, RandUVectorMatchesScalar)
+{
+    auto M2 = this->M;
+    IdxT N = this->M.bulk_min_size+17;
+    auto sample = this->M.randu(N);
+    for(IdxT i=0; i < N; i++) ASSERT_EQ(M2.randu(), sample(i)) << "Sample: "<<i;
+    EXPECT_EQ(M2.randu(), this->M.randu()) << "Stream not advanced correctly after bulk sample.";
+}
+
+TYPED_TEST( ParallelRngManagerTest, RandNVectorMatchesScalar)
+{
+    auto M2 = this->M;
+    IdxT N = this->M.bulk_min_size+17;
+    auto sample = this->M.randn(N);
+    for(IdxT i=0; i < N; i++) ASSERT_EQ(M2.randn(), sample(i)) << "Sample: "<<i;
+    EXPECT_EQ(M2.randn(), this->M.randn()) << "Stream not advanced correctly after bulk sample.";
+}
+
+
+TYPED_TEST( ParallelRngManagerTest, FillRandUMatchesScalar)
+{
+    auto M2 = this->M;
+    arma::mat samp(this->Nsample, this->Nsample);
+    this->M.fill_randu(samp);
+    for(IdxT i=0; i < samp.n_elem; i++) ASSERT_EQ(M2.randu(), samp(i)) << "Sample: "<<i;
+}
+
+TYPED_TEST( ParallelRngManagerTest, FillRandNSubview)
+{
+    auto M2 = this->M;
+    arma::mat samp(this->Nsample, this->Nsample);
+    samp.zeros();
+    IdxT r0=3, c0=5, r1=this->Nsample-7, c1=this->Nsample-2;
+    this->M.fill_randn(samp.submat(r0,c0,r1,c1));
+    for(IdxT c=0; c < samp.n_cols; c++) for(IdxT r=0; r < samp.n_rows; r++) {
+        if(r<r0 || r>r1 || c<c0 || c>c1) EXPECT_EQ(0, samp(r,c)) << "Wrote outside subview";
+        else ASSERT_EQ(M2.randn(), samp(r,c)) << "Sample: ("<<r<<","<<c<<")";
+    }
+}
+
+TYPED_TEST( ParallelRngManagerTest, FillRandUStrided)
+{
+    auto M2 = this->M;
+    IdxT stride = 3;
+    arma::vec samp(this->Nsample*stride);
+    samp.zeros();
+    this->M.fill_randu(samp.memptr(), this->Nsample, stride);
+    for(IdxT i=0; i < samp.n_elem; i++) {
+        if(i%stride) EXPECT_EQ(0, samp(i)) << "Wrote outside stride";
+        else ASSERT_EQ(M2.randu(), samp(i)) << "Sample: "<<i;
+    }
+}
+
+TYPED_TEST( ParallelRngManagerTest, FillResampleMatchesResampleDist)
+{
+    auto weights = this->M.randu(10);
+    auto M2 = this->M;
+    arma::uvec samp(this->Nsample);
+    this->M.fill_resample(weights, samp);
+    auto sample2 = M2.resample_dist(weights, this->Nsample);
+    for(IdxT i=0; i < samp.n_elem; i++) EXPECT_EQ(sample2(i), samp(i)) << "Sample: "<<i;
+    check_sample_category(samp,weights);
+}
+
+
+TYPED_TEST( ParallelRngManagerTest, RandUParallelMatchesSerial)
+{
+    auto M2 = this->M;
+    IdxT rows = 301, cols = 257;
+    auto sample = this->M.randu_parallel(rows,cols);
+    auto sample2 = M2.randu(rows,cols);
+    for(IdxT i=0; i < sample.n_elem; i++) ASSERT_EQ(sample2(i), sample(i)) << "Sample: "<<i;
+    EXPECT_EQ(M2.randu(), this->M.randu()) << "Stream not advanced correctly after parallel sample.";
+}
+
+TYPED_TEST( ParallelRngManagerTest, RandNParallelThreadCountInvariant)
+{
+    IdxT rows = 301, cols = 257;
+    auto M2 = this->M;
+    auto sample = this->M.randn_parallel(rows,cols);
+    auto next = this->M.randn();
+    check_sample_normal(sample.col(0));
+    int max_threads = omp_get_max_threads();
+    for(int nthreads: {1,2,3,5}) {
+        auto M3 = M2;
+        omp_set_num_threads(nthreads);
+        auto sample3 = M3.randn_parallel(rows,cols);
+        for(IdxT i=0; i < sample.n_elem; i++) ASSERT_EQ(sample(i), sample3(i)) << "Threads: "<<nthreads<<" Sample: "<<i;
+        EXPECT_EQ(next, M3.randn()) << "Stream not advanced correctly after parallel sample.";
+    }
+    omp_set_num_threads(max_threads);
+}
+
+
+TYPED_TEST( ParallelRngManagerTest, RandNMoments)
+{
+    IdxT N = 200000;
+    auto sample = this->M.randn(N);
+    EXPECT_NEAR(0, arma::mean(sample), 6/std::sqrt(N));
+    EXPECT_NEAR(1, arma::var(sample), 6*std::sqrt(2./N));
+    IdxT ntail = 0;
+    for(auto v: sample) if(std::abs(v) > 3.442619855899) ntail++; //Beyond ziggurat base layer
+    EXPECT_NEAR(5.7605e-4*N, ntail, 6*std::sqrt(5.7605e-4*N));
+}
+
+TEST( ZigguratTest, NormalFloatMoments)
+{
+    auto M = parallel_rng::make_parallel_rng_manager<parallel_rng::DefaultParallelRngT,float>(42);
+    IdxT N = 200000;
+    auto sample = M.randn(N);
+    for(auto v: sample) ASSERT_TRUE(std::isfinite(v));
+    EXPECT_NEAR(0, arma::mean(sample), 6/std::sqrt(N));
+    EXPECT_NEAR(1, arma::var(sample), 6*std::sqrt(2./N));
+}
+
+TEST( ZigguratTest, ExponentialMoments)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    parallel_rng::ZigguratExponentialDistribution<double> dist(2);
+    IdxT N = 200000;
+    arma::vec sample(N);
+    dist.generate(sample.begin(), sample.end(), M.generator());
+    for(auto v: sample) ASSERT_LE(0, v);
+    EXPECT_NEAR(0.5, arma::mean(sample), 6*0.5/std::sqrt(N));
+    EXPECT_NEAR(0.25, arma::var(sample), 0.02);
+}
+
+
+TEST( UnitUniformTest, ExactKernels)
+{
+    using namespace parallel_rng::unit_uniform;
+    const double eps53 = 1.0/9007199254740992.0;
+    const float eps24 = 1.0f/16777216.0f;
+    EXPECT_EQ(0, unit_double(0));
+    EXPECT_EQ(1-eps53, unit_double(~uint64_t(0)));
+    EXPECT_EQ(0, unit_float(0));
+    EXPECT_EQ(1-eps24, unit_float(~uint32_t(0)));
+    trng::lcg64_shift gen(42);
+    for(IdxT i=0; i<10000; i++) {
+        uint64_t bits = gen();
+        ASSERT_EQ(double(bits >> 11)*eps53, unit_double(bits));
+        ASSERT_EQ(float(bits >> 40)*eps24, unit_value<float>(bits));
+    }
+    parallel_rng::UnitUniformDistribution<double> closed;
+    parallel_rng::UnitUniformDistribution<double,parallel_rng::UnitInterval::OpenClosed> open;
+    trng::lcg64_shift gen2 = gen;
+    for(IdxT i=0; i<10000; i++) {
+        double u = open(gen);
+        ASSERT_LT(0, u);
+        ASSERT_LE(u, 1);
+        ASSERT_EQ(1-closed(gen2), u);
+    }
+}
+
+TEST( UnitUniformTest, FloatPairsPerDraw)
+{
+    auto M = parallel_rng::make_parallel_rng_manager<parallel_rng::DefaultParallelRngT,float>(42);
+    auto M2 = M;
+    IdxT N = 2*M.bulk_min_size+17;
+    auto sample = M.randu(N);
+    auto &gen = M2.generator();
+    for(IdxT i=0; i<N; i+=2) {
+        uint64_t bits = gen();
+        ASSERT_EQ(parallel_rng::unit_uniform::unit_float(uint32_t(bits >> 32)), sample(i)) << "Sample: "<<i;
+        if(i+1 < N) {
+            ASSERT_EQ(parallel_rng::unit_uniform::unit_float(uint32_t(bits)), sample(i+1)) << "Sample: "<<i+1;
+        }
+    }
+    EXPECT_EQ(gen(), M.generator()()) << "Stream not advanced by one value per pair.";
+}
+
+TEST( UnitUniformTest, FloatLayoutsMatch)
+{
+    auto M = parallel_rng::make_parallel_rng_manager<parallel_rng::DefaultParallelRngT,float>(42);
+    auto M2 = M, M3 = M;
+    IdxT rows = 301, cols = 257, stride = 3;
+    auto sample = M.randu_parallel(rows,cols);
+    auto sample2 = M2.randu(rows,cols);
+    for(IdxT i=0; i < sample.n_elem; i++) ASSERT_EQ(sample2(i), sample(i)) << "Sample: "<<i;
+    EXPECT_EQ(M2.randu(), M.randu()) << "Stream not advanced correctly after parallel sample.";
+    arma::Col<float> strided(rows*stride);
+    M3.fill_randu(strided.memptr(), rows, stride);
+    for(IdxT i=0; i < rows; i++) ASSERT_EQ(sample2(i), strided(i*stride)) << "Sample: "<<i;
+}
+
+TEST( UnitUniformTest, GenericEngine)
+{
+    std::minstd_rand gen(42), gen2(42);
+    parallel_rng::UnitUniformDistribution<double> dist;
+    IdxT N = 100000;
+    arma::vec sample(N);
+    EXPECT_EQ(2u, dist.draws_per_sample<std::minstd_rand>());
+    dist.generate(sample.memptr(), N, gen);
+    for(IdxT i=0; i<N; i++) {
+        ASSERT_EQ(dist(gen2), sample(i)) << "Sample: "<<i;
+        ASSERT_LE(0, sample(i));
+        ASSERT_LT(sample(i), 1);
+    }
+    EXPECT_NEAR(0.5, arma::mean(sample), 6*std::sqrt(1./12/N));
+}
+
+TEST( GammaTest, Moments)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    IdxT N = 200000;
+    for(double shape: {0.3, 1.0, 4.5}) {
+        auto sample = M.randg(shape, 2.0, N);
+        for(auto v: sample) ASSERT_LE(0, v);
+        EXPECT_NEAR(2*shape, arma::mean(sample), 6*2*std::sqrt(shape/N)) << "Shape: "<<shape;
+        EXPECT_NEAR(4*shape, arma::var(sample), 0.05*4*shape) << "Shape: "<<shape;
+    }
+    auto expo = M.rande(4.0, N);
+    EXPECT_NEAR(0.25, arma::mean(expo), 6*0.25/std::sqrt(N));
+    double a = 2, b = 5;
+    auto beta = M.randbeta(a, b, N);
+    for(auto v: beta) ASSERT_TRUE(0 <= v && v <= 1);
+    EXPECT_NEAR(a/(a+b), arma::mean(beta), 6*std::sqrt(a*b/((a+b)*(a+b)*(a+b+1)*N)));
+    EXPECT_THROW(M.randg(0, 1), std::invalid_argument);
+    EXPECT_THROW(M.randbeta(1, -1), std::invalid_argument);
+}
+
+TEST( GammaTest, PerElementMatchesScalar)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    auto M2 = M;
+    IdxT N = M.bulk_min_size+17;
+    arma::vec shapes(N), a(N), b(N);
+    for(IdxT n=0; n<N; n++) {
+        shapes(n) = 0.25 + (n%13);
+        a(n) = 0.5 + (n%5);
+        b(n) = 1.5 + (n%7);
+    }
+    auto sample = M.randg(shapes, 3.0);
+    for(IdxT n=0; n<N; n++) ASSERT_EQ(M2.randg(shapes(n), 3.0), sample(n)) << "Sample: "<<n;
+    auto beta = M.randbeta(a, b);
+    for(IdxT n=0; n<N; n++) ASSERT_EQ(M2.randbeta(a(n), b(n)), beta(n)) << "Sample: "<<n;
+    auto bulk = M.randg(2.5, 1.0, N);
+    for(IdxT n=0; n<N; n++) ASSERT_EQ(M2.randg(2.5, 1.0), bulk(n)) << "Sample: "<<n;
+    EXPECT_EQ(M2.randu(), M.randu()) << "Stream not advanced correctly after bulk sample.";
+    arma::vec short_b(3);
+    short_b.fill(1);
+    EXPECT_THROW(M.fill_randbeta(a, short_b, sample), parallel_rng::ParallelRngManagerError);
+}
+
+TEST( GammaTest, Dirichlet)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    arma::vec alpha = {0.5, 1.0, 2.0, 4.5};
+    IdxT N = 50000;
+    auto sample = M.randdirichlet(alpha, N);
+    ASSERT_EQ(alpha.n_elem, sample.n_rows);
+    ASSERT_EQ(N, sample.n_cols);
+    arma::vec mean(alpha.n_elem);
+    mean.zeros();
+    for(IdxT n=0; n<N; n++) {
+        double total = 0;
+        for(IdxT k=0; k<alpha.n_elem; k++) {
+            ASSERT_LE(0, sample(k,n));
+            total += sample(k,n);
+            mean(k) += sample(k,n)/N;
+        }
+        ASSERT_NEAR(1, total, 1e-12);
+    }
+    double A = arma::accu(alpha);
+    for(IdxT k=0; k<alpha.n_elem; k++) EXPECT_NEAR(alpha(k)/A, mean(k), 0.01) << "Component: "<<k;
+    auto single = M.randdirichlet(alpha);
+    EXPECT_NEAR(1, arma::accu(single), 1e-12);
+}
+
+TEST( PoissonTest, Moments)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    IdxT N = 100000;
+    for(double mean: {0.0, 0.7, 4.0, 9.99, 10.0, 37.5, 2500.0}) {
+        arma::mat means(N,1);
+        means.fill(mean);
+        auto sample = M.randp(means);
+        arma::vec x(N);
+        for(IdxT n=0; n<N; n++) x(n) = sample(n);
+        EXPECT_NEAR(mean, arma::mean(x), 6*std::sqrt(mean/N)+1e-12) << "Mean: "<<mean;
+        EXPECT_NEAR(mean, arma::var(x), 0.05*mean+1e-12) << "Mean: "<<mean;
+    }
+    EXPECT_THROW(M.randp(-1.0), std::invalid_argument);
+}
+
+TEST( PoissonTest, BinomialMoments)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    IdxT N = 100000;
+    for(IdxT trials: {0, 1, 20, 1000}) for(double p: {0.0, 0.05, 0.5, 0.93, 1.0}) {
+        arma::mat probs(N,1);
+        probs.fill(p);
+        auto sample = M.randbinom(trials, probs);
+        arma::vec x(N);
+        for(IdxT n=0; n<N; n++) {
+            ASSERT_LE(sample(n), trials);
+            x(n) = sample(n);
+        }
+        double mean = trials*p, var = trials*p*(1-p);
+        EXPECT_NEAR(mean, arma::mean(x), 6*std::sqrt(var/N)+1e-12) << "Trials: "<<trials<<" p: "<<p;
+        EXPECT_NEAR(var, arma::var(x), 0.05*var+1e-12) << "Trials: "<<trials<<" p: "<<p;
+    }
+    //Gamma means fall on both sides of the inversion cutoff for mean 30, and almost all below it for mean 3
+    for(double mean: {30.0, 3.0}) {
+        double size = 2.5, var = mean + mean*mean/size;
+        arma::mat means(N,1);
+        means.fill(mean);
+        arma::mat nb(N,1);
+        M.fill_randnbinom(size, means, nb);
+        EXPECT_NEAR(mean, arma::mean(nb), 6*std::sqrt(var/N)) << "Mean: "<<mean;
+        EXPECT_NEAR(var, arma::var(nb), 0.05*var) << "Mean: "<<mean;
+    }
+}
+
+TEST( PoissonTest, ParallelMatchesSerial)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    auto M2 = M, M3 = M;
+    IdxT rows = 301, cols = 257;
+    arma::mat means(rows, cols);
+    for(IdxT n=0; n<means.n_elem; n++) means(n) = 0.1*(n%400);
+    auto sample = M.randp_parallel(means);
+    auto sample2 = M2.randp(means);
+    for(IdxT n=0; n<sample.n_elem; n++) ASSERT_EQ(sample2(n), sample(n)) << "Sample: "<<n;
+    EXPECT_EQ(M2.randu(), M.randu()) << "Stream not advanced correctly after parallel sample.";
+    arma::mat fsample(rows, cols);
+    M3.fill_randp_parallel(means, fsample);
+    for(IdxT n=0; n<sample.n_elem; n++) ASSERT_EQ(double(sample(n)), fsample(n)) << "Sample: "<<n;
+    arma::mat small(10,10);
+    for(IdxT n=0; n<small.n_elem; n++) small(n) = 0.5*n;
+    auto M4 = M;
+    auto counts = M.randp(small);
+    for(IdxT n=0; n<counts.n_elem; n++) ASSERT_EQ(M4.randp(small(n)), counts(n)) << "Sample: "<<n;
+    arma::Mat<IdxT> wrong(3,3);
+    EXPECT_THROW(M.fill_randp(means, wrong), parallel_rng::ParallelRngManagerError);
+}
+
+TEST( MultivariateNormalTest, Moments)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    arma::vec mean = {1.0, -2.0, 0.5};
+    arma::mat cov(3,3);
+    double c[9] = {2.0, 0.6, -0.3,  0.6, 1.0, 0.2,  -0.3, 0.2, 0.5};
+    for(IdxT n=0; n<9; n++) cov(n) = c[n];
+    parallel_rng::MultivariateNormalSampler<> mvn(mean, cov);
+    EXPECT_FALSE(mvn.semidefinite());
+    IdxT N = 3000;
+    for(bool parallel: {false, true}) {
+        auto samp = parallel ? mvn.sample_parallel(M, N) : mvn.sample(M, N);
+        ASSERT_EQ(3, samp.n_rows);
+        ASSERT_EQ(N, samp.n_cols);
+        for(IdxT i=0; i<3; i++) {
+            double m = 0;
+            for(IdxT n=0; n<N; n++) m += samp(i,n)/N;
+            EXPECT_NEAR(mean(i), m, 6*std::sqrt(cov(i,i)/N)) << "Component: "<<i;
+            for(IdxT j=0; j<3; j++) {
+                double cij = 0;
+                for(IdxT n=0; n<N; n++) cij += (samp(i,n)-mean(i))*(samp(j,n)-mean(j))/N;
+                EXPECT_NEAR(cov(i,j), cij, 0.15) << "Covariance: ("<<i<<","<<j<<")";
+            }
+        }
+    }
+    auto M2 = M;
+    auto z = M2.randn(3);
+    auto x = mvn.sample(M);
+    for(IdxT i=0; i<3; i++) {
+        double expected = mean(i);
+        for(IdxT j=0; j<=i; j++) expected += mvn.factor()(i,j)*z(j);
+        EXPECT_NEAR(expected, x(i), 1e-12);
+    }
+}
+
+TEST( MultivariateNormalTest, SemidefiniteAndErrors)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    arma::vec mean = {0.0, 0.0};
+    arma::mat cov(2,2);
+    cov.fill(1.0); //Rank one, so x(0) == x(1)
+    parallel_rng::MultivariateNormalSampler<> mvn(mean, cov);
+    EXPECT_TRUE(mvn.semidefinite());
+    auto samp = mvn.sample(M, 1000);
+    for(IdxT n=0; n<samp.n_cols; n++) ASSERT_NEAR(samp(0,n), samp(1,n), 1e-12);
+    cov(0,1) = 2;
+    EXPECT_THROW(parallel_rng::MultivariateNormalSampler<>(mean, cov), parallel_rng::ParallelRngManagerError);
+    cov(1,0) = 2; //Indefinite
+    EXPECT_THROW(parallel_rng::MultivariateNormalSampler<>(mean, cov), parallel_rng::ParallelRngManagerError);
+    arma::mat wrong(3,5);
+    EXPECT_THROW(mvn.fill(M, wrong), parallel_rng::ParallelRngManagerError);
+}
+
+TYPED_TEST( ParallelRngManagerTest, RandpermIsPermutation)
+{
+    for(IdxT N: {IdxT(0), IdxT(1), IdxT(1000), IdxT(3*parallel_rng::permutation::chunk_size+17)}) {
+        auto perm = this->M.randperm(N);
+        ASSERT_EQ(N, perm.n_elem);
+        std::vector<char> seen(N, 0);
+        for(IdxT n=0; n<N; n++) {
+            ASSERT_LT(perm(n), N);
+            ASSERT_EQ(0, seen[perm(n)]++) << "Repeated index: "<<perm(n);
+        }
+    }
+}
+
+TEST( PermutationTest, ThreadCountInvariant)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    IdxT N = 5*parallel_rng::permutation::chunk_size+3;
+    auto M2 = M;
+    auto perm = M.randperm(N);
+    auto next = M.randu();
+    IdxT fixed = 0; //Expect about one fixed point
+    for(IdxT n=0; n<N; n++) fixed += perm(n) == n;
+    EXPECT_LT(fixed, 10);
+    int max_threads = omp_get_max_threads();
+    for(int nthreads: {1,2,3,5}) {
+        auto M3 = M2;
+        omp_set_num_threads(nthreads);
+        auto perm3 = M3.randperm(N);
+        for(IdxT n=0; n<N; n++) ASSERT_EQ(perm(n), perm3(n)) << "Threads: "<<nthreads<<" Index: "<<n;
+        EXPECT_EQ(next, M3.randu()) << "Stream not advanced correctly after parallel shuffle.";
+    }
+    omp_set_num_threads(max_threads);
+    arma::vec v(N);
+    for(IdxT n=0; n<N; n++) v(n) = perm(n);
+    auto M4 = M;
+    M.shuffle(v);
+    auto perm4 = M4.randperm(N);
+    for(IdxT n=0; n<N; n++) ASSERT_EQ(double(perm(perm4(n))), v(n)) << "Index: "<<n;
+}
+
+TEST( PermutationTest, Uniformity)
+{
+    //Position of element 0 over many shuffles of a small array should be uniform
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    IdxT N = 5, trials = 50000;
+    std::vector<double> freq(N*N, 0);
+    for(IdxT t=0; t<trials; t++) {
+        auto perm = M.randperm(N);
+        for(IdxT n=0; n<N; n++) freq[n*N + perm(n)] += 1./trials;
+    }
+    for(auto f: freq) EXPECT_NEAR(1./N, f, 6*std::sqrt(1./N/trials));
+}
+
+TEST( PermutationTest, SampleWithoutReplacement)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    for(IdxT N: {IdxT(10), IdxT(1000), IdxT(1000000)}) for(IdxT k: {IdxT(0), IdxT(1), N/100, N/10, N/2, N}) {
+        auto samp = M.sample_without_replacement(N, k);
+        ASSERT_EQ(k, samp.n_elem);
+        std::vector<char> seen(N, 0);
+        for(IdxT n=0; n<k; n++) {
+            ASSERT_LT(samp(n), N);
+            ASSERT_EQ(0, seen[samp(n)]++) << "N: "<<N<<" k: "<<k<<" Repeated index: "<<samp(n);
+        }
+    }
+    IdxT N = 20, k = 3, trials = 50000;
+    std::vector<double> freq(N, 0);
+    for(IdxT t=0; t<trials; t++) freq[M.sample_without_replacement(N, k)(1)] += 1./trials;
+    for(auto f: freq) EXPECT_NEAR(1./N, f, 6*std::sqrt(1./N/trials));
+    EXPECT_THROW(M.sample_without_replacement(3, 4), parallel_rng::ParallelRngManagerError);
+}
+
+TEST( BootstrapTest, ParallelMatchesSerial)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    auto M2 = M;
+    IdxT N = 1001, B = 37;
+    auto idx = M.bootstrap_indices(N, B);
+    ASSERT_EQ(N, idx.n_rows);
+    ASSERT_EQ(B, idx.n_cols);
+    auto next = M.randu();
+    for(IdxT n=0; n<idx.n_elem; n++) ASSERT_LT(idx(n), N);
+    int max_threads = omp_get_max_threads();
+    for(int nthreads: {1,2,3,5}) {
+        auto M3 = M2;
+        omp_set_num_threads(nthreads);
+        auto idx3 = M3.bootstrap_indices_parallel(N, B);
+        for(IdxT n=0; n<idx.n_elem; n++) ASSERT_EQ(idx(n), idx3(n)) << "Threads: "<<nthreads<<" Index: "<<n;
+        EXPECT_EQ(next, M3.randu()) << "Stream not advanced correctly after parallel bootstrap.";
+    }
+    omp_set_num_threads(max_threads);
+    //Multinomial counts are the histogram of the indices drawn from the same stream
+    auto M4 = M2;
+    auto counts = M4.bootstrap_counts_parallel(parallel_rng::BootstrapScheme::Multinomial, N, B);
+    for(IdxT b=0; b<B; b++) {
+        std::vector<IdxT> hist(N, 0);
+        for(IdxT n=0; n<N; n++) hist[idx(n,b)]++;
+        for(IdxT n=0; n<N; n++) ASSERT_EQ(hist[n], counts(n,b)) << "Replicate: "<<b<<" Observation: "<<n;
+    }
+    arma::Mat<uint8_t> narrow(300, 2);
+    EXPECT_THROW(M.fill_bootstrap_indices(narrow), parallel_rng::ParallelRngManagerError);
+}
+
+TEST( BootstrapTest, PoissonCounts)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    auto M2 = M;
+    IdxT N = 5000, B = 40;
+    auto counts = M.bootstrap_counts(parallel_rng::BootstrapScheme::Poisson, N, B);
+    arma::mat fcounts(N, B);
+    M2.fill_bootstrap_counts_parallel(parallel_rng::BootstrapScheme::Poisson, fcounts);
+    double mean = 0, var = 0;
+    for(IdxT n=0; n<counts.n_elem; n++) {
+        ASSERT_EQ(double(counts(n)), fcounts(n)) << "Count: "<<n;
+        mean += counts(n);
+        var += double(counts(n))*counts(n);
+    }
+    mean /= counts.n_elem;
+    var = var/counts.n_elem - mean*mean;
+    EXPECT_NEAR(1, mean, 0.01);
+    EXPECT_NEAR(1, var, 0.02);
+}
+
+TYPED_TEST( ParallelRngManagerTest, DiscreteSamplerResample)
+{
+    auto weights = this->M.randu(10);
+    weights(3) = 0;
+    parallel_rng::DiscreteSampler<> sampler(weights);
+    EXPECT_EQ(weights.n_elem, sampler.size());
+    arma::uvec sample(this->Nsample);
+    for(IdxT j=0; j<this->Nsample; j++) sample[j] = this->M.resample_dist(sampler);
+    check_sample_category(sample,weights);
+    check_sample_category(this->M.resample_dist(sampler, this->Nsample), weights);
+}
+
+TEST( DiscreteSamplerTest, Frequencies)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    IdxT K = 50, N = 1000000;
+    arma::vec weights = M.randu(K);
+    weights(0) = 0;
+    weights(7) = 40; //One very heavy category
+    parallel_rng::DiscreteSampler<> sampler(weights);
+    auto sample = M.resample_dist(sampler, N);
+    arma::vec counts(K);
+    counts.zeros();
+    for(auto k: sample) counts(k)++;
+    double W = arma::accu(weights);
+    for(IdxT k=0; k<K; k++) {
+        EXPECT_DOUBLE_EQ(weights(k)/W, sampler.probability(k));
+        double expected = N*weights(k)/W;
+        EXPECT_NEAR(expected, counts(k), 6*std::sqrt(expected)+1e-9) << "Category: "<<k;
+    }
+}
+
+TEST( DiscreteSamplerTest, ParallelBuildThreadCountInvariant)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(42);
+    IdxT K = 3*parallel_rng::DiscreteSampler<>::parallel_min_size+11, N = 10000;
+    arma::vec weights = M.randu(K);
+    int max_threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    parallel_rng::DiscreteSampler<> sampler(weights);
+    auto M2 = M;
+    auto sample = M2.resample_dist(sampler, N);
+    for(int nthreads: {2,3,5}) {
+        omp_set_num_threads(nthreads);
+        parallel_rng::DiscreteSampler<> sampler2(weights);
+        auto M3 = M;
+        auto sample3 = M3.resample_dist(sampler2, N);
+        for(IdxT i=0; i < N; i++) ASSERT_EQ(sample(i), sample3(i)) << "Threads: "<<nthreads<<" Sample: "<<i;
+    }
+    omp_set_num_threads(max_threads);
+}
+
+TEST( DiscreteSamplerTest, InvalidWeights)
+{
+    EXPECT_THROW(parallel_rng::DiscreteSampler<>(arma::vec()), std::invalid_argument);
+    arma::vec zero(5);
+    zero.zeros();
+    EXPECT_THROW(parallel_rng::DiscreteSampler<>{zero}, std::invalid_argument);
+    arma::vec negative(5);
+    negative.fill(1);
+    negative(2) = -1;
+    EXPECT_THROW(parallel_rng::DiscreteSampler<>{negative}, std::invalid_argument);
+}
+
+TYPED_TEST( ParallelRngManagerTest, ResampleSchemes)
+{
+    using parallel_rng::ResampleScheme;
+    auto weights = this->M.randu(37);
+    weights(4) = 0;
+    weights(36) = 0;
+    IdxT N = 1000;
+    double W = arma::accu(weights);
+    for(auto scheme: {ResampleScheme::Systematic, ResampleScheme::Stratified, ResampleScheme::Residual}) {
+        auto M2 = this->M;
+        auto counts = this->M.resample_counts(scheme, weights, N);
+        auto idx = M2.resample(scheme, weights, N);
+        ASSERT_EQ(weights.n_elem, counts.n_elem);
+        ASSERT_EQ(N, idx.n_elem);
+        EXPECT_EQ(N, arma::accu(counts));
+        EXPECT_EQ(0, counts(4));
+        EXPECT_EQ(0, counts(36));
+        for(IdxT n=1; n<N; n++) ASSERT_LE(idx(n-1), idx(n));
+        for(IdxT k=0; k<weights.n_elem; k++) {
+            EXPECT_EQ(counts(k), IdxT(std::count(idx.begin(), idx.end(), k)));
+            double expected = N*weights(k)/W;
+            if(scheme == ResampleScheme::Stratified) {
+                EXPECT_LE(std::abs(counts(k) - expected), 2);
+            } else {
+                EXPECT_GE(counts(k), std::floor(expected));
+                if(scheme == ResampleScheme::Systematic) {
+                    EXPECT_LE(counts(k), std::ceil(expected));
+                }
+            }
+        }
+    }
+}
+
+TEST( ResampleTest, ParallelThreadCountInvariant)
+{
+    using parallel_rng::ResampleScheme;
+    auto M = parallel_rng::make_parallel_rng_manager(11);
+    IdxT K = 100000, N = 150000;
+    arma::vec weights = M.randu(K);
+    int max_threads = omp_get_max_threads();
+    for(auto scheme: {ResampleScheme::Systematic, ResampleScheme::Stratified, ResampleScheme::Residual}) {
+        auto M2 = M;
+        auto idx = M.resample(scheme, weights, N);
+        auto next = M.randu();
+        for(int nthreads: {1,2,3,5}) {
+            auto M3 = M2;
+            omp_set_num_threads(nthreads);
+            auto idx3 = M3.resample_parallel(scheme, weights, N);
+            for(IdxT i=0; i < N; i++) ASSERT_EQ(idx(i), idx3(i)) << "Threads: "<<nthreads<<" Sample: "<<i;
+            EXPECT_EQ(next, M3.randu()) << "Stream not advanced correctly after parallel resample.";
+        }
+        omp_set_num_threads(max_threads);
+    }
+}
+
+TEST( ResampleTest, IndicesToCountsAcrossBlocks)
+{
+    //Runs that span whole blocks, end exactly at block boundaries, and skip categories
+    const IdxT block = parallel_rng::scan::block_size;
+    const IdxT K = 20;
+    std::vector<IdxT> lengths = {1, 3*block+5, 0, block-6, block, 0, 0, 2, block+1, 7};
+    std::vector<IdxT> idx;
+    for(IdxT k=0; k<lengths.size(); k++) idx.insert(idx.end(), lengths[k], 2*k);
+    const IdxT N = idx.size();
+    for(bool parallel: {false, true}) {
+        std::vector<IdxT> counts(K, 1);
+        parallel_rng::resampling::indices_to_counts(idx.data(), N, counts.data(), K, parallel);
+        for(IdxT k=0; k<K; k++) {
+            IdxT expected = (k%2 == 0) ? lengths[k/2] : 0;
+            EXPECT_EQ(expected, counts[k]) << "Category: "<<k<<" Parallel: "<<parallel;
+        }
+    }
+}
+
+TEST( ResampleTest, StratifiedFloatStaysInStrata)
+{
+    //With equal weights and N=K each stratum is one category.  Float positions n+u would round into stratum n+1.
+    using parallel_rng::ResampleScheme;
+    parallel_rng::ParallelRngManager<parallel_rng::DefaultParallelRngT, float> M(5);
+    IdxT N = IdxT(1)<<20;
+    arma::vec weights(N);
+    weights.fill(1);
+    auto counts = M.resample_counts_parallel(ResampleScheme::Stratified, weights, N);
+    for(IdxT k=0; k<N; k++) ASSERT_EQ(1, counts(k)) << "Category: "<<k;
+}
+
+TYPED_TEST( ParallelRngManagerTest, UniformDrawsPerSample)
+{
+    //draws_per_sample() is the number of engine values each uniform sample actually consumes
+    auto gen = this->M.generator(), gen2 = gen;
+    parallel_rng::UnitUniformDistribution<double> dist;
+    parallel_rng::UnitUniformDistribution<float> fdist;
+    dist(gen);
+    for(IdxT k=0; k<dist.draws_per_sample<TypeParam>(); k++) gen2();
+    EXPECT_EQ(gen2, gen);
+    fdist(gen);
+    for(IdxT k=0; k<fdist.draws_per_sample<TypeParam>(); k++) gen2();
+    EXPECT_EQ(gen2, gen);
+}
+
+TYPED_TEST( ParallelRngManagerTest, StreamHandleMatchesManager)
+{
+    auto M2 = this->M;
+    auto weights = this->M.randu(10);
+    M2.randu(10);
+    auto stream = M2.local();
+    EXPECT_EQ(this->M.randu(), stream.randu());
+    EXPECT_EQ(this->M.randn(), stream.randn());
+    EXPECT_EQ(this->M(), stream());
+    EXPECT_EQ(this->M.resample_dist(weights), stream.resample_dist(weights));
+    auto u = this->M.randu(this->Nsample);
+    auto u2 = stream.randu(this->Nsample);
+    for(IdxT i=0; i<u.n_elem; i++) ASSERT_EQ(u(i), u2(i));
+    auto z = this->M.randn(31,17);
+    auto z2 = stream.randn(31,17);
+    for(IdxT i=0; i<z.n_elem; i++) ASSERT_EQ(z(i), z2(i));
+    EXPECT_EQ(this->M.randu(), M2.randu()) << "Handle did not advance the manager's stream.";
+}
+
+TEST( StreamHandleTest, ParallelRegion)
+{
+    auto M = parallel_rng::make_parallel_rng_manager(5);
+    auto M2 = M;
+    int nthreads = std::min<int>(M.get_num_threads(), omp_get_max_threads());
+    arma::mat samp(1000, nthreads), samp2(1000, nthreads);
+    #pragma omp parallel num_threads(nthreads)
+    {
+        auto stream = M.local();
+        int t = omp_get_thread_num();
+        for(IdxT i=0; i<samp.n_rows; i++) samp(i,t) = stream.randn();
+        #pragma omp barrier
+        for(IdxT i=0; i<samp2.n_rows; i++) samp2(i,t) = M2.randn();
+    }
+    for(IdxT i=0; i<samp.n_elem; i++) ASSERT_EQ(samp(i), samp2(i));
+}
+
+TEST( StreamHandleTest, NumaLocalPlacement)
+{
+    parallel_rng::ParallelRngManager<> M(5, omp_get_max_threads()), M2(5, omp_get_max_threads(),
+                                                                       parallel_rng::StreamPlacement::NumaLocal);
+    EXPECT_EQ(parallel_rng::StreamPlacement::NumaLocal, M2.stream_placement());
+    M2.materialize_streams();
+    int nthreads = omp_get_max_threads();
+    arma::mat samp(1000, nthreads), samp2(1000, nthreads);
+    #pragma omp parallel num_threads(nthreads)
+    {
+        int t = omp_get_thread_num();
+        M.fill_randu(samp.colptr(t), samp.n_rows);
+        M2.fill_randu(samp2.colptr(t), samp2.n_rows);
+    }
+    for(IdxT i=0; i<samp.n_elem; i++) ASSERT_EQ(samp(i), samp2(i)) << "Placement changed the samples.";
+    M2.reset();
+    EXPECT_EQ(parallel_rng::StreamPlacement::NumaLocal, M2.stream_placement());
+}
+
+template<class ManagerT>
+void check_matches_default_manager(ManagerT &M2)
+{
+    parallel_rng::ParallelRngManager<> M(5, omp_get_max_threads());
+    int nthreads = omp_get_max_threads();
+    arma::mat samp(1000, nthreads), samp2(1000, nthreads);
+    #pragma omp parallel num_threads(nthreads)
+    {
+        int t = omp_get_thread_num();
+        M.fill_randn(samp.colptr(t), samp.n_rows);
+        M2.fill_randn(samp2.colptr(t), samp2.n_rows);
+    }
+    for(IdxT i=0; i<samp.n_elem; i++) ASSERT_EQ(samp(i), samp2(i)) << "Allocator changed the samples.";
+    arma::vec weights(50);
+    for(IdxT k=0; k<weights.n_elem; k++) weights(k) = 1 + k;
+    for(auto scheme: {parallel_rng::ResampleScheme::Stratified, parallel_rng::ResampleScheme::Residual}) {
+        auto counts = M.resample_counts(scheme, weights, IdxT(1000));
+        auto counts2 = M2.resample_counts(scheme, weights, IdxT(1000));
+        for(IdxT k=0; k<counts.n_elem; k++) ASSERT_EQ(counts(k), counts2(k)) << "Category: "<<k;
+    }
+}
+
+TEST( StreamHandleTest, ArenaAllocator)
+{
+    std::vector<unsigned char> buf(1<<22);
+    aligned_array::Arena arena(buf.data(), buf.size());
+    using ManagerT = parallel_rng::ParallelRngManager<parallel_rng::DefaultParallelRngT, double,
+                                                      aligned_array::ArenaAllocator>;
+    ManagerT M(5, omp_get_max_threads(), parallel_rng::StreamPlacement::Cache, aligned_array::ArenaAllocator{arena});
+    check_matches_default_manager(M);
+    EXPECT_GT(arena.used(), 0);
+    M.reset();
+    parallel_rng::ParallelRngManager<> M0(5, omp_get_max_threads());
+    EXPECT_EQ(M0.randu(), M.randu());
+    EXPECT_GT(arena.used(), 0) << "Streams made after reset() should be in the arena.";
+}
+
+TEST( StreamHandleTest, HugePageAllocator)
+{
+    parallel_rng::ParallelRngManager<parallel_rng::DefaultParallelRngT, double, aligned_array::HugePageAllocator>
+        M(5, omp_get_max_threads());
+    check_matches_default_manager(M);
+}
+
+TYPED_TEST( ParallelRngManagerTest, StreamForScheduleInvariant)
+{
+    IdxT ntasks = 64, nsamp = 50;
+    auto r = this->M.randu();
+    this->M.reset();
+    arma::mat samp(nsamp, ntasks);
+    for(IdxT i=0; i<ntasks; i++) this->M.stream_for(i).fill_randn(samp.col(i));
+    EXPECT_EQ(r, this->M.randu()) << "stream_for() advanced the thread streams.";
+    EXPECT_NE(samp(0,0), samp(0,1));
+    int max_threads = omp_get_max_threads();
+    for(int nthreads: {1,2,3,5}) {
+        omp_set_num_threads(nthreads);
+        arma::mat samp2(nsamp, ntasks);
+        #pragma omp parallel for schedule(dynamic,1)
+        for(IdxT i=0; i<ntasks; i++) {
+            auto stream = this->M.stream_for(ntasks-1-i);
+            for(IdxT k=0; k<nsamp; k++) samp2(k,ntasks-1-i) = stream.randn();
+        }
+        for(IdxT i=0; i<samp.n_elem; i++) ASSERT_EQ(samp(i), samp2(i)) << "Threads: "<<nthreads<<" Sample: "<<i;
+    }
+    omp_set_num_threads(max_threads);
+    auto stream = this->M.stream_for(3);
+    auto u = stream.randu();
+    auto copy = stream;
+    EXPECT_EQ(stream.randu(), copy.randu()) << "TaskStream copy does not own its engine.";
+    EXPECT_EQ(u, this->M.stream_for(3).randu());
+}
+
+/* Root positions [first,last] used by a kind of stream.  Inclusive, as the last region may end at 2^64. */
+struct StreamRegion
+{
+    uint64_t first, last;
+};
+
+/* Regions of the thread, nested, overflow and task streams, checked to be disjoint and within the first period values */
+template<class RngT>
+void check_stream_regions(uint64_t period_last)
+{
+    using Layout = parallel_rng::StreamLayout<RngT>;
+    const std::vector<StreamRegion> regions = {
+        {0, Layout::thread_stream_end - 1},
+        {Layout::nested_stream_offset,
+         Layout::nested_stream_offset + Layout::max_nested_streams*Layout::nested_stream_length - 1},
+        {Layout::overflow_stream_offset,
+         Layout::overflow_stream_offset + Layout::max_overflow_streams*Layout::overflow_stream_length - 1},
+        {Layout::task_stream_offset, Layout::task_stream_offset + Layout::max_task_streams*Layout::task_stream_length - 1}};
+    for(IdxT i=0; i<regions.size(); i++) {
+        EXPECT_LE(regions[i].first, regions[i].last) << "Region: "<<i;
+        EXPECT_LE(regions[i].last, period_last) << "Region wraps around the period: "<<i;
+        for(IdxT j=0; j<i; j++)
+            EXPECT_TRUE(regions[j].last < regions[i].first || regions[i].last < regions[j].first) << "Regions: "<<j<<","<<i;
+    }
+}
+
+TEST( StreamLayoutTest, StreamsWithinPeriod)
+{
+    //Streams of yarn2, with period 2^62-2^32, must not wrap into each other or into the per-thread streams
+    using Yarn2Layout = parallel_rng::StreamLayout<trng::yarn2>;
+    using LcgLayout = parallel_rng::StreamLayout<trng::lcg64_shift>;
+    EXPECT_EQ(61u, Yarn2Layout::period_bits);
+    EXPECT_EQ(64u, LcgLayout::period_bits);
+    EXPECT_EQ(64u, parallel_rng::StreamLayout<trng::yarn3>::period_bits);
+    check_stream_regions<trng::yarn2>((uint64_t(1)<<62) - (uint64_t(1)<<32) - 1);
+    check_stream_regions<trng::lcg64_shift>(~uint64_t(0));
+    EXPECT_EQ(uint64_t(1)<<63, LcgLayout::task_stream_offset);
+    EXPECT_EQ(uint64_t(1)<<31, LcgLayout::max_task_streams);
+    EXPECT_EQ(uint64_t(1)<<22, LcgLayout::max_overflow_streams);
+    auto M = parallel_rng::make_parallel_rng_manager<trng::yarn2>(3);
+    EXPECT_THROW(M.stream_for(Yarn2Layout::max_task_streams), parallel_rng::ParallelRngManagerError);
+}
+
+TEST( StreamLayoutTest, NestedStreamLimit)
+{
+    //Every path at max_nested_depth() has a stream, and the largest path one level deeper throws
+    using parallel_rng::ParallelRngManagerError;
+    parallel_rng::ParallelRngManager<trng::lcg64_shift> M(1, 4), M256(1, 256);
+    parallel_rng::ParallelRngManager<trng::yarn2> Y(1, 4);
+    parallel_rng::ParallelRngManager<parallel_rng::Philox4x64> P(1, 4);
+    EXPECT_EQ(3, M.max_nested_depth()); //64^2+64^3 <= 2^21 nested streams
+    EXPECT_EQ(2, M256.max_nested_depth());
+    EXPECT_EQ(2, Y.max_nested_depth()); //2^18 nested streams
+    EXPECT_EQ(P.max_thread_depth, P.max_nested_depth());
+    for(uint64_t fanout: {64, 256}) {
+        uint64_t num_streams = parallel_rng::StreamLayout<trng::lcg64_shift>::max_nested_streams;
+        IdxT depth = parallel_rng::max_nested_depth(fanout, num_streams, 8);
+        std::vector<IdxT> ids(depth+1, fanout-1);
+        EXPECT_LT(parallel_rng::nested_stream_index(ids.data(), depth, fanout, num_streams), num_streams);
+        EXPECT_THROW(parallel_rng::nested_stream_index(ids.data(), depth+1, fanout, num_streams), ParallelRngManagerError);
+        ids[0] = fanout;
+        EXPECT_THROW(parallel_rng::nested_stream_index(ids.data(), 2, fanout, num_streams), ParallelRngManagerError);
+    }
+    //Paths of increasing depth number the tree in order
+    const IdxT a[] = {0, 1}, b[] = {63, 63}, c[] = {0, 0, 1};
+    EXPECT_EQ(1, parallel_rng::nested_stream_index(a, 2, 64, 1<<21));
+    EXPECT_EQ(64*64-1, parallel_rng::nested_stream_index(b, 2, 64, 1<<21));
+    EXPECT_EQ(64*64+1, parallel_rng::nested_stream_index(c, 3, 64, 1<<21));
+}
+
+TYPED_TEST( ParallelRngManagerTest, ThreadsBeyondMaxThreads)
+{
+    //Streams below max_threads keep their split numbering, and extra thread ids get distinct overflow streams
+    IdxT max_threads = 2, nthreads = 5;
+    parallel_rng::ParallelRngManager<TypeParam> M2(this->seed, max_threads);
+    parallel_rng::ParallelRngManager<TypeParam> M3(this->seed, max_threads);
+    arma::vec samp(nthreads), samp2(max_threads);
+    samp.fill(-1);
+    IdxT used = 0;
+    #pragma omp parallel num_threads(nthreads)
+    {
+        #pragma omp single
+        used = omp_get_num_threads();
+        samp(omp_get_thread_num()) = M2.randu();
+    }
+    #pragma omp parallel num_threads(max_threads)
+    samp2(omp_get_thread_num()) = M3.randu();
+    for(IdxT i=0; i<std::min(used,max_threads); i++) EXPECT_EQ(samp2(i), samp(i)) << "Thread: "<<i;
+    for(IdxT i=0; i<used; i++) for(IdxT j=0; j<i; j++) EXPECT_NE(samp(i), samp(j)) << "Threads: "<<i<<","<<j;
+}
+
+TYPED_TEST( ParallelRngManagerTest, NestedTeamsIndependentStreams)
+{
+    //Each thread of a nested team gets its own stream, and the master of an inner team keeps its outer stream
+    IdxT nouter = 2, ninner = 3;
+    int max_levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(2);
+    arma::mat samp(ninner, nouter), samp2(ninner, nouter);
+    arma::vec flat(nouter);
+    for(auto *S: {&samp, &samp2}) {
+        this->M.reset();
+        S->fill(-1);
+        #pragma omp parallel num_threads(nouter)
+        {
+            IdxT i = omp_get_thread_num();
+            #pragma omp parallel num_threads(ninner)
+            (*S)(omp_get_thread_num(), i) = this->M.randu();
+        }
+    }
+    this->M.reset();
+    #pragma omp parallel num_threads(nouter)
+    flat(omp_get_thread_num()) = this->M.randu();
+    omp_set_max_active_levels(max_levels);
+    for(IdxT i=0; i<samp.n_elem; i++) {
+        EXPECT_EQ(samp(i), samp2(i)) << "Nested streams are not reproducible.  Sample: "<<i;
+        if(samp(i) < 0) continue;
+        for(IdxT j=0; j<i; j++) EXPECT_NE(samp(i), samp(j)) << "Samples: "<<i<<","<<j;
+    }
+    for(IdxT i=0; i<nouter; i++) {
+        if(samp(0,i) >= 0) {
+            EXPECT_EQ(flat(i), samp(0,i));
+        }
+    }
+}
+
+TYPED_TEST( ParallelRngManagerTest, CheckpointRestore)
+{
+    //A restored manager continues every used stream exactly, including nested and overflow streams
+    IdxT nthreads = this->M.get_num_threads() + 2;
+    int max_levels = omp_get_max_active_levels();
+    omp_set_max_active_levels(2);
+    auto draw = [&](parallel_rng::ParallelRngManager<TypeParam> &M, arma::mat &samp) {
+        samp.set_size(2*nthreads, 3);
+        samp.fill(-1);
+        samp(0,2) = M.randn();
+        #pragma omp parallel num_threads(nthreads)
+        {
+            IdxT i = omp_get_thread_num();
+            samp(i,0) = M.randu();
+            #pragma omp parallel num_threads(2)
+            samp(2*i + omp_get_thread_num(), 1) = M.randu();
+        }
+    };
+    arma::mat warmup, samp, samp2, samp3;
+    draw(this->M, warmup);
+    std::stringstream ss;
+    this->M.save_checkpoint(ss);
+    draw(this->M, samp);
+
+    parallel_rng::ParallelRngManager<TypeParam> M2(this->seed+1, 1);
+    M2.load_checkpoint(ss);
+    EXPECT_EQ(this->seed, M2.get_init_seed());
+    EXPECT_EQ(this->M.get_num_threads(), M2.get_num_threads());
+    draw(M2, samp2);
+
+    std::string filename = ::testing::TempDir() + "parallel_rng_checkpoint.bin";
+    this->M.reset();
+    draw(this->M, warmup);
+    this->M.save_checkpoint(filename);
+    parallel_rng::ParallelRngManager<TypeParam> M3(this->seed+1, 1);
+    M3.load_checkpoint(filename);
+    std::remove(filename.c_str());
+    draw(M3, samp3);
+    omp_set_max_active_levels(max_levels);
+    for(IdxT i=0; i<samp.n_elem; i++) {
+        ASSERT_EQ(samp(i), samp2(i)) << "Sample: "<<i;
+        ASSERT_EQ(samp(i), samp3(i)) << "Sample: "<<i;
+    }
+
+    std::string bad = ss.str();
+    bad[0] = 'X';
+    EXPECT_THROW(M2.load_checkpoint(bad.data(), bad.size()), parallel_rng::ParallelRngManagerError);
+    EXPECT_THROW(M2.load_checkpoint(ss.str().data(), 10), parallel_rng::ParallelRngManagerError);
+}
+
 }  // namespace
 
 int main(int argc, char **argv) {